@@ -0,0 +1,65 @@
+# Measures raw decode throughput over a matrix of generated clips, nothing is rendered.
+# Requires a build with benchmarks=yes, run with:
+#   godot --headless --path <project> -s res://addons/ffmpeg/benchmarks/decode_benchmark.gd -- results.json
+# Clips are generated into user:// on the first run and reused afterwards. Encoders missing from the FFmpeg build are skipped.
+extends SceneTree
+
+const CLIP_DIRECTORY := "user://ffmpeg_benchmark_clips"
+const DURATION := 10.0
+const FPS := 30
+
+const CODECS := {
+	"h264": "mp4",
+	"vp8": "webm",
+	"vp9": "webm",
+	"av1": "mp4",
+}
+const SIZES := [Vector2i(640, 360), Vector2i(1280, 720), Vector2i(1920, 1080), Vector2i(3840, 2160)]
+const PIXEL_FORMATS := ["yuv420p", "yuva420p", "yuv444p"]
+
+
+func _format_summary(summary: Dictionary) -> String:
+	if summary.get("samples", 0) == 0:
+		return "n/a"
+	return "%.2f ms (p95 %.2f)" % [summary.median / 1000.0, summary.p95 / 1000.0]
+
+
+func _get_clip(codec: String, size: Vector2i, pixel_format: String) -> String:
+	var path := "%s/%s_%dx%d_%s.%s" % [CLIP_DIRECTORY, codec, size.x, size.y, pixel_format, CODECS[codec]]
+	if FileAccess.file_exists(path):
+		return path
+	var options := { "codec": codec, "size": size, "pixel_format": pixel_format, "fps": FPS, "duration": DURATION }
+	if FFmpegBenchmarks.generate_clip(path, options) != OK:
+		return ""
+	return path
+
+
+func _init() -> void:
+	var args := OS.get_cmdline_user_args()
+	var output_path: String = args[0] if not args.is_empty() else ""
+	DirAccess.make_dir_recursive_absolute(CLIP_DIRECTORY)
+
+	var results := []
+	for codec in CODECS:
+		for size in SIZES:
+			for pixel_format in PIXEL_FORMATS:
+				var path := _get_clip(codec, size, pixel_format)
+				if path.is_empty():
+					print("%-5s %-10s %-9s skipped, couldn't encode" % [codec, "%dx%d" % [size.x, size.y], pixel_format])
+					continue
+				var result: Dictionary = FFmpegBenchmarks.measure_decode(path)
+				result.codec = codec
+				result.pixel_format = pixel_format
+				results.push_back(result)
+				print("%-5s %-10s %-9s %7.1f fps, cpu %4.2f, decode %s, convert %s, decoder memory %d MiB" % [codec, "%dx%d" % [size.x, size.y], pixel_format,
+						result.fps, result.cpu_utilization, _format_summary(result.decode_usec), _format_summary(result.convert_usec),
+						result.peak_decoder_memory / (1024 * 1024)])
+
+	if not output_path.is_empty():
+		var file := FileAccess.open(output_path, FileAccess.WRITE)
+		if file == null:
+			printerr("Couldn't write %s" % output_path)
+			quit(1)
+			return
+		file.store_string(JSON.stringify(results, "\t"))
+	quit()
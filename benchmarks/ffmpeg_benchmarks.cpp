@@ -0,0 +1,560 @@
+/**************************************************************************/
+/*  ffmpeg_benchmarks.cpp                                                 */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_benchmarks.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#else
+#include "core/io/file_access.h"
+#include "core/os/os.h"
+#endif
+
+#include "../ffmpeg_io_source.h"
+#include "ffmpeg_test_clips.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#endif
+
+// Startup samples are abandoned if no frame shows up within this time.
+static const uint64_t FIRST_FRAME_TIMEOUT_USEC = 10000000;
+// Decode runs give up after this long unless told otherwise.
+static const uint64_t DECODE_TIMEOUT_USEC = 120000000;
+// Seek targets step through the clip by the golden ratio, spread out but identical between runs.
+static const double SEEK_TARGET_STEP = 0.6180339887;
+// Simulated time given to the playbacks to fill their queues before counters are sampled.
+static const double SCALING_WARMUP_SECONDS = 1.0;
+
+// Nearest-rank percentile of already sorted samples.
+static uint64_t sorted_percentile(const std::vector<uint64_t> &p_sorted, double p_percentile) {
+	const size_t rank = (size_t)Math::ceil(p_percentile * p_sorted.size());
+	return p_sorted[CLAMP(rank, (size_t)1, p_sorted.size()) - 1];
+}
+
+VideoDecoder::ProbeOptions FFmpegBenchmarks::_probe_options_from_dictionary(const Dictionary &p_options) {
+	VideoDecoder::ProbeOptions options;
+	options.probe_size = p_options.get("probe_size", 0);
+	options.analyze_duration_usec = p_options.get("analyze_duration_usec", 0);
+	options.format_name = p_options.get("format", "");
+	options.trust_container = p_options.get("trust_container", false);
+	return options;
+}
+
+Dictionary FFmpegBenchmarks::summarize(const Vector<uint64_t> &p_samples) {
+	Dictionary summary;
+	summary["samples"] = p_samples.size();
+	if (p_samples.is_empty()) {
+		return summary;
+	}
+
+	std::vector<uint64_t> sorted(p_samples.ptr(), p_samples.ptr() + p_samples.size());
+	std::sort(sorted.begin(), sorted.end());
+	uint64_t total = 0;
+	for (uint64_t sample : sorted) {
+		total += sample;
+	}
+	summary["min"] = sorted.front();
+	summary["median"] = sorted[sorted.size() / 2];
+	summary["mean"] = total / (double)sorted.size();
+	summary["p95"] = sorted_percentile(sorted, 0.95);
+	summary["p99"] = sorted_percentile(sorted, 0.99);
+	summary["max"] = sorted.back();
+	return summary;
+}
+
+uint64_t FFmpegBenchmarks::_get_process_cpu_time_usec() {
+#ifdef _WIN32
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time)) {
+		return 0;
+	}
+	// FILETIME is in 100 ns units.
+	const uint64_t kernel = ((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+	const uint64_t user = ((uint64_t)user_time.dwHighDateTime << 32) | user_time.dwLowDateTime;
+	return (kernel + user) / 10;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+	return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#endif
+}
+
+int64_t FFmpegBenchmarks::_get_process_peak_memory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	// Linux and the BSDs report kilobytes.
+	return (int64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+Dictionary FFmpegBenchmarks::measure_startup(const String &p_path, const Dictionary &p_probe_options, int p_iterations) {
+	Dictionary result;
+	ERR_FAIL_COND_V(p_iterations <= 0, result);
+	const VideoDecoder::ProbeOptions probe_options = _probe_options_from_dictionary(p_probe_options);
+
+	Vector<uint64_t> open_samples;
+	Vector<uint64_t> first_frame_samples;
+	int failures = 0;
+	for (int i = 0; i < p_iterations; i++) {
+		Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::READ);
+		ERR_FAIL_COND_V_MSG(file.is_null(), result, vformat("Couldn't open %s.", p_path));
+		// Plain file reads so caches in the I/O layer don't hide the cost of probing.
+		Ref<VideoDecoder> decoder = memnew(VideoDecoder(memnew(FFmpegFileIOSource(file))));
+		decoder->set_probe_options(probe_options);
+
+		const uint64_t start = OS::get_singleton()->get_ticks_usec();
+		decoder->start_decoding();
+		const uint64_t opened = OS::get_singleton()->get_ticks_usec();
+		if (decoder->get_decoder_state() == VideoDecoder::FAULTED) {
+			failures++;
+			continue;
+		}
+
+		Vector<Ref<DecodedFrame>> frames;
+		while (frames.is_empty() && OS::get_singleton()->get_ticks_usec() - start < FIRST_FRAME_TIMEOUT_USEC) {
+			frames = decoder->get_decoded_frames();
+			if (frames.is_empty()) {
+				OS::get_singleton()->delay_usec(100);
+			}
+		}
+		const uint64_t first_frame = OS::get_singleton()->get_ticks_usec();
+		if (frames.is_empty()) {
+			failures++;
+			continue;
+		}
+		decoder->return_frames(frames);
+
+		open_samples.push_back(opened - start);
+		first_frame_samples.push_back(first_frame - start);
+	}
+
+	result["path"] = p_path;
+	result["open_usec"] = summarize(open_samples);
+	result["first_frame_usec"] = summarize(first_frame_samples);
+	result["failures"] = failures;
+	return result;
+}
+
+int64_t FFmpegBenchmarks::_get_process_memory() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+	mach_task_basic_info_data_t info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+		return 0;
+	}
+	return info.resident_size;
+#else
+	FILE *statm = fopen("/proc/self/statm", "r");
+	if (statm == nullptr) {
+		return 0;
+	}
+	long total_pages = 0;
+	long resident_pages = 0;
+	const int read = fscanf(statm, "%ld %ld", &total_pages, &resident_pages);
+	fclose(statm);
+	return read == 2 ? (int64_t)resident_pages * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+int FFmpegBenchmarks::_get_process_thread_count() {
+#ifdef _WIN32
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (snapshot == INVALID_HANDLE_VALUE) {
+		return -1;
+	}
+	const DWORD process_id = GetCurrentProcessId();
+	int count = 0;
+	THREADENTRY32 entry;
+	entry.dwSize = sizeof(entry);
+	for (BOOL found = Thread32First(snapshot, &entry); found; found = Thread32Next(snapshot, &entry)) {
+		if (entry.th32OwnerProcessID == process_id) {
+			count++;
+		}
+	}
+	CloseHandle(snapshot);
+	return count;
+#elif defined(__APPLE__)
+	thread_act_array_t threads;
+	mach_msg_type_number_t count = 0;
+	if (task_threads(mach_task_self(), &threads, &count) != KERN_SUCCESS) {
+		return -1;
+	}
+	for (mach_msg_type_number_t i = 0; i < count; i++) {
+		mach_port_deallocate(mach_task_self(), threads[i]);
+	}
+	vm_deallocate(mach_task_self(), (vm_address_t)threads, count * sizeof(thread_act_t));
+	return count;
+#else
+	FILE *status = fopen("/proc/self/status", "r");
+	if (status == nullptr) {
+		return -1;
+	}
+	int count = -1;
+	char line[256];
+	while (fgets(line, sizeof(line), status) != nullptr) {
+		if (sscanf(line, "Threads: %d", &count) == 1) {
+			break;
+		}
+	}
+	fclose(status);
+	return count;
+#endif
+}
+
+Error FFmpegBenchmarks::generate_clip(const String &p_path, const Dictionary &p_options) {
+	return FFmpegTestClips::generate(p_path, p_options);
+}
+
+Dictionary FFmpegBenchmarks::measure_decode(const String &p_path, const Dictionary &p_options) {
+	Dictionary result;
+	const int max_frames = p_options.get("max_frames", 0);
+	const Vector2i target_size = p_options.get("target_size", Vector2i());
+	const uint64_t timeout_usec = (int64_t)p_options.get("timeout_usec", (int64_t)DECODE_TIMEOUT_USEC);
+
+	Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::READ);
+	ERR_FAIL_COND_V_MSG(file.is_null(), result, vformat("Couldn't open %s.", p_path));
+	Ref<VideoDecoder> decoder = memnew(VideoDecoder(memnew(FFmpegFileIOSource(file))));
+	decoder->set_target_size(target_size);
+	decoder->set_collect_frame_timings(true);
+
+	const uint64_t cpu_start = _get_process_cpu_time_usec();
+	const uint64_t start = OS::get_singleton()->get_ticks_usec();
+	decoder->start_decoding();
+	ERR_FAIL_COND_V_MSG(decoder->get_decoder_state() == VideoDecoder::FAULTED, result, vformat("Couldn't decode %s.", p_path));
+
+	Vector<uint64_t> read_samples;
+	Vector<uint64_t> decode_samples;
+	Vector<uint64_t> convert_samples;
+	int frame_count = 0;
+	int64_t peak_decoder_memory = 0;
+	bool timed_out = false;
+	while (max_frames <= 0 || frame_count < max_frames) {
+		Vector<Ref<DecodedFrame>> frames = decoder->get_decoded_frames();
+		// Audio isn't consumed by anything here, drop it so it doesn't pile up.
+		for (const Ref<DecodedAudioFrame> &audio_frame : decoder->get_decoded_audio_frames()) {
+			decoder->return_audio_frame(audio_frame);
+		}
+		frame_count += frames.size();
+		peak_decoder_memory = MAX(peak_decoder_memory, decoder->get_memory_usage());
+		decoder->return_frames(frames);
+		if (frames.is_empty()) {
+			if (decoder->get_decoder_state() == VideoDecoder::END_OF_STREAM || decoder->get_decoder_state() == VideoDecoder::FAULTED) {
+				// The decoder may have queued frames between the two calls.
+				frames = decoder->get_decoded_frames();
+				frame_count += frames.size();
+				decoder->return_frames(frames);
+				if (frames.is_empty()) {
+					break;
+				}
+				continue;
+			}
+			if (OS::get_singleton()->get_ticks_usec() - start > timeout_usec) {
+				timed_out = true;
+				break;
+			}
+			OS::get_singleton()->delay_usec(100);
+		}
+	}
+	const uint64_t wall_usec = OS::get_singleton()->get_ticks_usec() - start;
+	const uint64_t cpu_usec = _get_process_cpu_time_usec() - cpu_start;
+
+	for (const VideoDecoder::FrameTiming &timing : decoder->take_frame_timings()) {
+		read_samples.push_back(timing.read_usec);
+		decode_samples.push_back(timing.decode_usec);
+		convert_samples.push_back(timing.convert_usec);
+	}
+
+	result["path"] = p_path;
+	result["size"] = decoder->get_size();
+	result["frames"] = frame_count;
+	result["wall_usec"] = wall_usec;
+	result["fps"] = wall_usec > 0 ? frame_count * 1000000.0 / wall_usec : 0.0;
+	result["cpu_usec"] = cpu_usec;
+	// Above 1.0 when decoding used more than one core.
+	result["cpu_utilization"] = wall_usec > 0 ? cpu_usec / (double)wall_usec : 0.0;
+	result["read_usec"] = summarize(read_samples);
+	result["decode_usec"] = summarize(decode_samples);
+	result["convert_usec"] = summarize(convert_samples);
+	result["peak_decoder_memory"] = peak_decoder_memory;
+	result["peak_process_memory"] = _get_process_peak_memory();
+	result["timed_out"] = timed_out;
+	return result;
+}
+
+bool FFmpegBenchmarks::_update_until(const Ref<FFmpegVideoStreamPlayback> &p_playback, bool (*p_condition)(const FFmpegPlaybackMetrics &, const FFmpegPlaybackMetrics &), const FFmpegPlaybackMetrics &p_start_metrics, uint64_t p_timeout_usec) {
+	const uint64_t start = OS::get_singleton()->get_ticks_usec();
+	FFmpegPlaybackMetrics metrics;
+	while (OS::get_singleton()->get_ticks_usec() - start < p_timeout_usec) {
+		p_playback->STREAM_FUNCNAME(update)(0.0);
+		p_playback->collect_metrics(metrics);
+		if (p_condition(p_start_metrics, metrics)) {
+			return true;
+		}
+		OS::get_singleton()->delay_usec(100);
+	}
+	return false;
+}
+
+Dictionary FFmpegBenchmarks::_measure_playbacks(const String &p_path, int p_instance_count, double p_duration, double p_tick_rate, bool p_real_time) {
+	Dictionary result;
+	const int64_t memory_before = _get_process_memory();
+	const int threads_before = _get_process_thread_count();
+
+	Vector<Ref<FFmpegVideoStreamPlayback>> playbacks;
+	for (int i = 0; i < p_instance_count; i++) {
+		Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::READ);
+		ERR_FAIL_COND_V_MSG(file.is_null(), result, vformat("Couldn't open %s.", p_path));
+		Ref<FFmpegVideoStreamPlayback> playback;
+		playback.instantiate();
+		// Nothing mixes audio here, and the clip has to outlast the run.
+		playback->set_audio_output_enabled(false);
+		// Pooled decoders and cached files would make instances cheaper than real ones. Shared decoding and the loop cache
+		// are off for playbacks that don't come from an FFmpegVideoStream.
+		playback->set_shared_caches_enabled(false);
+		playback->set_looping(true);
+		ERR_FAIL_COND_V_MSG(playback->load(file) != OK, result, vformat("Couldn't load %s.", p_path));
+		playbacks.push_back(playback);
+	}
+	for (Ref<FFmpegVideoStreamPlayback> &playback : playbacks) {
+		// update() and friends are the _-prefixed virtuals in GDExtension builds.
+		playback->STREAM_FUNCNAME(play)();
+	}
+
+	const double tick_delta = 1.0 / p_tick_rate;
+	const int warmup_ticks = (int)(SCALING_WARMUP_SECONDS * p_tick_rate);
+	const int measured_ticks = MAX(1, (int)(p_duration * p_tick_rate));
+	const uint64_t tick_usec = (uint64_t)(tick_delta * 1000000.0);
+
+	Vector<FFmpegPlaybackMetrics> start_metrics;
+	start_metrics.resize(playbacks.size());
+	Vector<uint64_t> update_samples;
+	uint64_t cpu_start = 0;
+	uint64_t wall_start = 0;
+	int peak_threads = -1;
+	uint64_t next_tick = OS::get_singleton()->get_ticks_usec();
+	for (int tick = 0; tick < warmup_ticks + measured_ticks; tick++) {
+		if (tick == warmup_ticks) {
+			for (int i = 0; i < playbacks.size(); i++) {
+				playbacks.write[i]->collect_metrics(start_metrics.write[i]);
+			}
+			cpu_start = _get_process_cpu_time_usec();
+			wall_start = OS::get_singleton()->get_ticks_usec();
+		}
+
+		const uint64_t update_start = OS::get_singleton()->get_ticks_usec();
+		for (Ref<FFmpegVideoStreamPlayback> &playback : playbacks) {
+			playback->STREAM_FUNCNAME(update)(tick_delta);
+		}
+		const uint64_t update_end = OS::get_singleton()->get_ticks_usec();
+		if (tick >= warmup_ticks) {
+			update_samples.push_back(update_end - update_start);
+			peak_threads = MAX(peak_threads, _get_process_thread_count());
+		}
+
+		if (p_real_time) {
+			next_tick += tick_usec;
+			const uint64_t now = OS::get_singleton()->get_ticks_usec();
+			if (next_tick > now) {
+				OS::get_singleton()->delay_usec(next_tick - now);
+			} else {
+				// Behind schedule, don't try to catch up with a burst of ticks.
+				next_tick = now;
+			}
+		}
+	}
+	const uint64_t wall_usec = OS::get_singleton()->get_ticks_usec() - wall_start;
+	const uint64_t cpu_usec = _get_process_cpu_time_usec() - cpu_start;
+	const int64_t memory_after = _get_process_memory();
+
+	FFmpegPlaybackMetrics totals;
+	for (int i = 0; i < playbacks.size(); i++) {
+		FFmpegPlaybackMetrics end_metrics;
+		playbacks.write[i]->collect_metrics(end_metrics);
+		totals.presented_frames += end_metrics.presented_frames - start_metrics[i].presented_frames;
+		totals.decoded_frames += end_metrics.decoded_frames - start_metrics[i].decoded_frames;
+		totals.late_frames += end_metrics.late_frames - start_metrics[i].late_frames;
+		totals.dropped_frames += end_metrics.dropped_frames - start_metrics[i].dropped_frames;
+		totals.memory_usage += end_metrics.memory_usage;
+	}
+	const double simulated_seconds = measured_ticks * tick_delta;
+
+	result["instances"] = p_instance_count;
+	result["presented_fps"] = totals.presented_frames / simulated_seconds;
+	result["presented_fps_per_instance"] = totals.presented_frames / simulated_seconds / p_instance_count;
+	result["decoded_fps"] = totals.decoded_frames / simulated_seconds;
+	result["late_frames"] = totals.late_frames;
+	result["dropped_frames"] = totals.dropped_frames;
+	result["update_usec"] = summarize(update_samples);
+	result["threads"] = peak_threads;
+	result["threads_per_instance"] = peak_threads >= 0 && threads_before >= 0 ? (peak_threads - threads_before) / (double)p_instance_count : -1.0;
+	result["cpu_utilization"] = wall_usec > 0 ? cpu_usec / (double)wall_usec : 0.0;
+	result["memory_per_instance"] = (memory_after - memory_before) / p_instance_count;
+	result["decoder_memory_per_instance"] = totals.memory_usage / p_instance_count;
+	return result;
+}
+
+Array FFmpegBenchmarks::measure_playback_scaling(const String &p_path, const Dictionary &p_options) {
+	Array results;
+	PackedInt32Array default_instance_counts;
+	for (int instance_count = 1; instance_count <= 64; instance_count *= 2) {
+		default_instance_counts.push_back(instance_count);
+	}
+	const PackedInt32Array instance_counts = p_options.get("instance_counts", default_instance_counts);
+	const double duration = p_options.get("duration", 10.0);
+	const double tick_rate = p_options.get("tick_rate", 60.0);
+	const bool real_time = p_options.get("real_time", true);
+	ERR_FAIL_COND_V(duration <= 0.0 || tick_rate <= 0.0, results);
+
+	for (int i = 0; i < instance_counts.size(); i++) {
+		const int instance_count = instance_counts[i];
+		ERR_CONTINUE(instance_count <= 0);
+		Dictionary result = _measure_playbacks(p_path, instance_count, duration, tick_rate, real_time);
+		if (result.is_empty()) {
+			break;
+		}
+		results.push_back(result);
+	}
+	return results;
+}
+
+Dictionary FFmpegBenchmarks::measure_latency(const String &p_path, const Dictionary &p_options) {
+	Dictionary result;
+	const int iterations = p_options.get("iterations", 20);
+	const int seeks = p_options.get("seeks", 10);
+	const uint64_t timeout_usec = (int64_t)p_options.get("timeout_usec", (int64_t)FIRST_FRAME_TIMEOUT_USEC);
+	ERR_FAIL_COND_V(iterations <= 0 || seeks < 0, result);
+
+	Vector<uint64_t> load_samples;
+	Vector<uint64_t> first_frame_samples;
+	Vector<uint64_t> seek_samples;
+	int failures = 0;
+	int seek_index = 0;
+	for (int i = 0; i < iterations; i++) {
+		Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::READ);
+		ERR_FAIL_COND_V_MSG(file.is_null(), result, vformat("Couldn't open %s.", p_path));
+		Ref<FFmpegVideoStreamPlayback> playback;
+		playback.instantiate();
+		playback->set_audio_output_enabled(false);
+		// A pooled decoder would already be prepared and make the load look instant.
+		playback->set_shared_caches_enabled(false);
+
+		const uint64_t start = OS::get_singleton()->get_ticks_usec();
+		if (playback->load(file) != OK) {
+			failures++;
+			continue;
+		}
+		const uint64_t loaded = OS::get_singleton()->get_ticks_usec();
+		playback->STREAM_FUNCNAME(play)();
+		const bool presented = _update_until(
+				playback, [](const FFmpegPlaybackMetrics &p_start, const FFmpegPlaybackMetrics &p_current) {
+					return p_current.presented_frames > p_start.presented_frames;
+				},
+				FFmpegPlaybackMetrics(), timeout_usec);
+		if (!presented || playback->STREAM_FUNCNAME(get_texture)().is_null()) {
+			failures++;
+			continue;
+		}
+		load_samples.push_back(loaded - start);
+		first_frame_samples.push_back(OS::get_singleton()->get_ticks_usec() - start);
+
+		const double length = playback->STREAM_FUNCNAME(get_length)();
+		for (int j = 0; j < seeks; j++) {
+			seek_index++;
+			const double target = Math::fmod(seek_index * SEEK_TARGET_STEP, 1.0) * length;
+			FFmpegPlaybackMetrics seek_start_metrics;
+			playback->collect_metrics(seek_start_metrics);
+			const uint64_t seek_start = OS::get_singleton()->get_ticks_usec();
+			playback->STREAM_FUNCNAME(seek)(target);
+			const bool seeked = _update_until(
+					playback, [](const FFmpegPlaybackMetrics &p_start, const FFmpegPlaybackMetrics &p_current) {
+						return p_current.completed_seeks > p_start.completed_seeks;
+					},
+					seek_start_metrics, timeout_usec);
+			if (!seeked) {
+				failures++;
+				break;
+			}
+			seek_samples.push_back(OS::get_singleton()->get_ticks_usec() - seek_start);
+		}
+	}
+
+	result["path"] = p_path;
+	result["load_usec"] = summarize(load_samples);
+	result["first_frame_usec"] = summarize(first_frame_samples);
+	result["seek_usec"] = summarize(seek_samples);
+	result["failures"] = failures;
+	return result;
+}
+
+void FFmpegBenchmarks::_bind_methods() {
+	ClassDB::bind_static_method("FFmpegBenchmarks", D_METHOD("measure_startup", "path", "probe_options", "iterations"), &FFmpegBenchmarks::measure_startup, DEFVAL(Dictionary()), DEFVAL(10));
+	ClassDB::bind_static_method("FFmpegBenchmarks", D_METHOD("generate_clip", "path", "options"), &FFmpegBenchmarks::generate_clip, DEFVAL(Dictionary()));
+	ClassDB::bind_static_method("FFmpegBenchmarks", D_METHOD("measure_decode", "path", "options"), &FFmpegBenchmarks::measure_decode, DEFVAL(Dictionary()));
+	ClassDB::bind_static_method("FFmpegBenchmarks", D_METHOD("measure_frame_paths", "options"), &FFmpegBenchmarks::measure_frame_paths, DEFVAL(Dictionary()));
+	ClassDB::bind_static_method("FFmpegBenchmarks", D_METHOD("measure_latency", "path", "options"), &FFmpegBenchmarks::measure_latency, DEFVAL(Dictionary()));
+	ClassDB::bind_static_method("FFmpegBenchmarks", D_METHOD("measure_playback_scaling", "path", "options"), &FFmpegBenchmarks::measure_playback_scaling, DEFVAL(Dictionary()));
+}
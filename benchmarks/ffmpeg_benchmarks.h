@@ -0,0 +1,113 @@
+/**************************************************************************/
+/*  ffmpeg_benchmarks.h                                                   */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_BENCHMARKS_H
+#define FFMPEG_BENCHMARKS_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/classes/object.hpp>
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/object/object.h"
+#include "core/variant/dictionary.h"
+
+#endif
+
+#include "../ffmpeg_video_stream.h"
+#include "../video_decoder.h"
+
+// Micro-benchmarks driving the decoder directly, only built with benchmarks=yes (FFMPEG_BENCHMARKS).
+// See startup_benchmark.gd for a runner.
+class FFmpegBenchmarks : public Object {
+	GDCLASS(FFmpegBenchmarks, Object);
+
+	static VideoDecoder::ProbeOptions _probe_options_from_dictionary(const Dictionary &p_options);
+	// Process wide, in microseconds of user + system time.
+	static uint64_t _get_process_cpu_time_usec();
+	// Peak resident set size of the process, in bytes.
+	static int64_t _get_process_peak_memory();
+	// Current resident set size of the process, in bytes. 0 where it can't be queried.
+	static int64_t _get_process_memory();
+	// -1 where it can't be queried.
+	static int _get_process_thread_count();
+	// Calls update() with a frozen clock until p_condition holds for r_metrics or p_timeout_usec passes.
+	static bool _update_until(const Ref<FFmpegVideoStreamPlayback> &p_playback, bool (*p_condition)(const FFmpegPlaybackMetrics &, const FFmpegPlaybackMetrics &), const FFmpegPlaybackMetrics &p_start_metrics, uint64_t p_timeout_usec);
+	static Dictionary _measure_playbacks(const String &p_path, int p_instance_count, double p_duration, double p_tick_rate, bool p_real_time);
+
+	// Frame path microbenchmarks, in ffmpeg_frame_benchmarks.cpp. Each returns one result and checks the output of a run against the expected one.
+	static Dictionary _measure_unwrap_yuv(AVPixelFormat p_format, const Vector2i &p_size, int p_iterations);
+	static Dictionary _measure_unwrap_rgba(const Vector2i &p_size, int p_iterations);
+	static Dictionary _measure_scale(AVPixelFormat p_format, AVPixelFormat p_target_format, const Vector2i &p_size, const Vector2i &p_target_size, int p_iterations);
+	static Dictionary _measure_audio_conversion(AVSampleFormat p_format, int p_sample_rate, int p_output_sample_rate, int p_iterations);
+
+protected:
+	static void _bind_methods();
+
+public:
+	// Returns min/median/mean/max and the 95th/99th percentiles of the given samples, in the samples' unit.
+	static Dictionary summarize(const Vector<uint64_t> &p_samples);
+
+	// Opens p_path p_iterations times with the given probe options ("probe_size", "analyze_duration_usec", "format", "trust_container")
+	// and measures how long opening the input and getting the first decoded frame takes, in microseconds.
+	static Dictionary measure_startup(const String &p_path, const Dictionary &p_probe_options, int p_iterations);
+
+	// See FFmpegTestClips::generate for the options.
+	static Error generate_clip(const String &p_path, const Dictionary &p_options);
+
+	// Decodes p_path as fast as possible without presenting anything, so it runs headless.
+	// Options: "max_frames" (0 decodes the whole file), "target_size" (Vector2i) and "timeout_usec".
+	// Reports throughput, CPU time, per stage timings per frame and peak memory.
+	static Dictionary measure_decode(const String &p_path, const Dictionary &p_options);
+
+	// Plays p_path on 1, 2, 4... playbacks at once, driving update() with a fixed step clock instead of the scene tree.
+	// Options: "instance_counts" (PackedInt32Array), "duration" (simulated seconds), "tick_rate" (updates per simulated second) and
+	// "real_time" (ticks are spaced out in real time like frames would be, when false they run back to back).
+	// Returns one dictionary per instance count with delivered fps, late and dropped frames, update cost, threads, CPU and memory.
+	static Array measure_playback_scaling(const String &p_path, const Dictionary &p_options);
+
+	// Measures load() -> play() -> first presented frame and seek() -> first presented frame, in microseconds.
+	// Playbacks are driven with a clock that doesn't move, so the frames waited for are the same on every run.
+	// Options: "iterations" (fresh loads), "seeks" (per load) and "timeout_usec" (per operation).
+	static Dictionary measure_latency(const String &p_path, const Dictionary &p_options);
+
+	// Runs the per frame unwrap, scaling and audio conversion paths of VideoDecoder on synthetic frames of many sizes and formats.
+	// Options: "iterations" (per case) and "sizes" (Array of Vector2i). Returns one dictionary per case with timings,
+	// throughput in input bytes per second and "golden", false if the output didn't match what the input should produce.
+	static Array measure_frame_paths(const Dictionary &p_options);
+};
+
+#endif // FFMPEG_BENCHMARKS_H
@@ -0,0 +1,277 @@
+/**************************************************************************/
+/*  ffmpeg_frame_benchmarks.cpp                                           */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_benchmarks.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/os.hpp>
+#else
+#include "core/os/os.h"
+#endif
+
+extern "C" {
+#include "libavutil/imgutils.h"
+#include "libavutil/pixdesc.h"
+}
+
+// Values the scaling benchmark fills Y, U, V and A with, mid grey which is ~130 in RGB with limited range BT.601.
+static const uint8_t UNIFORM_PLANE_VALUES[4] = { 128, 128, 128, 255 };
+static const int UNIFORM_RGB_VALUE = 130;
+static const int SCALE_TOLERANCE = 3;
+static const int AUDIO_SAMPLE_COUNT = 1024;
+// Resampler output is only compared once the filter has settled.
+static const int RESAMPLER_SETTLE_SAMPLES = 64;
+static const float AUDIO_CHANNEL_VALUES[2] = { 0.25f, -0.5f };
+
+static uint8_t pattern_value(int p_plane, int p_x, int p_y) {
+	return (uint8_t)(p_x * 3 + p_y * 7 + p_plane * 61);
+}
+
+static int get_plane_height(AVPixelFormat p_format, int p_plane, int p_height) {
+	const AVPixFmtDescriptor *descriptor = av_pix_fmt_desc_get(p_format);
+	return p_plane == 1 || p_plane == 2 ? AV_CEIL_RSHIFT(p_height, descriptor->log2_chroma_h) : p_height;
+}
+
+// Every byte of the visible area is filled, padding at the end of the rows is left as allocated.
+static Ref<FFmpegFrame> create_video_frame(AVPixelFormat p_format, const Vector2i &p_size, bool p_uniform) {
+	Ref<FFmpegFrame> frame;
+	frame.instantiate();
+	AVFrame *av_frame = frame->get_frame();
+	av_frame->format = p_format;
+	av_frame->width = p_size.x;
+	av_frame->height = p_size.y;
+	ERR_FAIL_COND_V(av_frame_get_buffer(av_frame, 0) < 0, Ref<FFmpegFrame>());
+
+	for (int plane = 0; plane < av_pix_fmt_count_planes(p_format); plane++) {
+		const int row_bytes = av_image_get_linesize(p_format, p_size.x, plane);
+		const int plane_height = get_plane_height(p_format, plane, p_size.y);
+		for (int y = 0; y < plane_height; y++) {
+			uint8_t *row = av_frame->data[plane] + y * av_frame->linesize[plane];
+			for (int x = 0; x < row_bytes; x++) {
+				row[x] = p_uniform ? UNIFORM_PLANE_VALUES[plane] : pattern_value(plane, x, y);
+			}
+		}
+	}
+	return frame;
+}
+
+static bool check_pattern(const PackedByteArray &p_data, int p_plane, int p_row_bytes, int p_height) {
+	if (p_data.size() != p_row_bytes * p_height) {
+		return false;
+	}
+	const uint8_t *data = p_data.ptr();
+	for (int y = 0; y < p_height; y++) {
+		for (int x = 0; x < p_row_bytes; x++) {
+			if (data[y * p_row_bytes + x] != pattern_value(p_plane, x, y)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static Dictionary make_frame_path_result(const String &p_stage, const String &p_format, const Vector2i &p_size, const Vector<uint64_t> &p_samples, int64_t p_bytes, bool p_golden) {
+	Dictionary result;
+	result["stage"] = p_stage;
+	result["format"] = p_format;
+	result["size"] = p_size;
+	const Dictionary summary = FFmpegBenchmarks::summarize(p_samples);
+	result["usec"] = summary;
+	const uint64_t median = summary.get("median", 0);
+	result["bytes_per_second"] = median > 0 ? p_bytes * 1000000.0 / median : 0.0;
+	result["golden"] = p_golden;
+	return result;
+}
+
+Dictionary FFmpegBenchmarks::_measure_unwrap_yuv(AVPixelFormat p_format, const Vector2i &p_size, int p_iterations) {
+	Ref<VideoDecoder> decoder = memnew(VideoDecoder(Ref<FFmpegIOSource>()));
+	Ref<FFmpegFrame> frame = create_video_frame(p_format, p_size, false);
+	ERR_FAIL_COND_V(frame.is_null(), Dictionary());
+	const FFmpegFrameFormat out_format = p_format == AV_PIX_FMT_YUVA420P ? FFmpegFrameFormat::YUVA420P : FFmpegFrameFormat::YUV420P;
+	const int plane_count = out_format == FFmpegFrameFormat::YUVA420P ? 4 : 3;
+
+	Vector<uint64_t> samples;
+	Ref<DecodedFrame> decoded_frame;
+	for (int i = 0; i < p_iterations; i++) {
+		const uint64_t start = OS::get_singleton()->get_ticks_usec();
+		decoded_frame = decoder->_unwrap_yuv_frame(0.0, frame, out_format);
+		samples.push_back(OS::get_singleton()->get_ticks_usec() - start);
+	}
+
+	bool golden = decoded_frame.is_valid();
+	for (int plane = 0; golden && plane < plane_count; plane++) {
+		const Ref<Image> image = decoded_frame->get_yuv_image_plane(plane);
+		golden = image.is_valid() && check_pattern(image->get_data(), plane, av_image_get_linesize(p_format, p_size.x, plane), get_plane_height(p_format, plane, p_size.y));
+	}
+	return make_frame_path_result("unwrap_yuv", av_get_pix_fmt_name(p_format), p_size, samples, av_image_get_buffer_size(p_format, p_size.x, p_size.y, 1), golden);
+}
+
+Dictionary FFmpegBenchmarks::_measure_unwrap_rgba(const Vector2i &p_size, int p_iterations) {
+	Ref<VideoDecoder> decoder = memnew(VideoDecoder(Ref<FFmpegIOSource>()));
+	Ref<FFmpegFrame> frame = create_video_frame(AV_PIX_FMT_RGBA, p_size, false);
+	ERR_FAIL_COND_V(frame.is_null(), Dictionary());
+
+	Vector<uint64_t> samples;
+	PackedByteArray buffer;
+	Ref<Image> image;
+	for (int i = 0; i < p_iterations; i++) {
+		const uint64_t start = OS::get_singleton()->get_ticks_usec();
+		image = decoder->_unwrap_rgba_frame(frame, buffer);
+		samples.push_back(OS::get_singleton()->get_ticks_usec() - start);
+	}
+
+	const bool golden = image.is_valid() && check_pattern(image->get_data(), 0, p_size.x * 4, p_size.y);
+	return make_frame_path_result("unwrap_rgba", "rgba", p_size, samples, (int64_t)p_size.x * p_size.y * 4, golden);
+}
+
+Dictionary FFmpegBenchmarks::_measure_scale(AVPixelFormat p_format, AVPixelFormat p_target_format, const Vector2i &p_size, const Vector2i &p_target_size, int p_iterations) {
+	Ref<VideoDecoder> decoder = memnew(VideoDecoder(Ref<FFmpegIOSource>()));
+	Ref<FFmpegFrame> frame = create_video_frame(p_format, p_size, true);
+	ERR_FAIL_COND_V(frame.is_null(), Dictionary());
+
+	Vector<uint64_t> samples;
+	bool golden = true;
+	for (int i = 0; i < p_iterations; i++) {
+		const uint64_t start = OS::get_singleton()->get_ticks_usec();
+		Ref<FFmpegFrame> scaled = decoder->_ensure_frame_pixel_format(frame, p_target_format, p_target_size);
+		samples.push_back(OS::get_singleton()->get_ticks_usec() - start);
+		if (scaled.is_null()) {
+			golden = false;
+			break;
+		}
+
+		// Only the last run is checked, scaler frames are pooled and must come back intact.
+		if (i == p_iterations - 1) {
+			const AVFrame *av_frame = scaled->get_frame();
+			golden = av_frame->width == p_target_size.x && av_frame->height == p_target_size.y && av_frame->format == p_target_format;
+			for (int y = 0; golden && y < p_target_size.y; y++) {
+				const uint8_t *row = av_frame->data[0] + y * av_frame->linesize[0];
+				for (int x = 0; golden && x < p_target_size.x; x++) {
+					if (p_target_format == AV_PIX_FMT_RGBA) {
+						golden = ABS(row[x * 4] - UNIFORM_RGB_VALUE) <= SCALE_TOLERANCE && ABS(row[x * 4 + 1] - UNIFORM_RGB_VALUE) <= SCALE_TOLERANCE && ABS(row[x * 4 + 2] - UNIFORM_RGB_VALUE) <= SCALE_TOLERANCE && row[x * 4 + 3] == 255;
+					} else {
+						golden = ABS(row[x] - UNIFORM_PLANE_VALUES[0]) <= 1;
+					}
+				}
+			}
+		}
+		scaled->do_return();
+	}
+	const String format = vformat("%s->%s", av_get_pix_fmt_name(p_format), av_get_pix_fmt_name(p_target_format));
+	const String stage = p_size == p_target_size ? "convert" : "scale";
+	Dictionary result = make_frame_path_result(stage, format, p_size, samples, av_image_get_buffer_size(p_format, p_size.x, p_size.y, 1), golden);
+	result["target_size"] = p_target_size;
+	return result;
+}
+
+Dictionary FFmpegBenchmarks::_measure_audio_conversion(AVSampleFormat p_format, int p_sample_rate, int p_output_sample_rate, int p_iterations) {
+	// Each case gets its own decoder, the resampler is only rebuilt when the input changes.
+	Ref<VideoDecoder> decoder = memnew(VideoDecoder(Ref<FFmpegIOSource>()));
+	const int channel_count = 2;
+	decoder->audio_output_sample_rate = p_output_sample_rate;
+	av_channel_layout_default(&decoder->audio_output_ch_layout, channel_count);
+
+	AVFrame *frame = av_frame_alloc();
+	frame->format = p_format;
+	frame->sample_rate = p_sample_rate;
+	frame->nb_samples = AUDIO_SAMPLE_COUNT;
+	av_channel_layout_default(&frame->ch_layout, channel_count);
+	if (av_frame_get_buffer(frame, 0) < 0) {
+		av_frame_free(&frame);
+		ERR_FAIL_V(Dictionary());
+	}
+	const bool planar = av_sample_fmt_is_planar(p_format);
+	const bool is_s16 = p_format == AV_SAMPLE_FMT_S16 || p_format == AV_SAMPLE_FMT_S16P;
+	for (int channel = 0; channel < channel_count; channel++) {
+		for (int sample = 0; sample < AUDIO_SAMPLE_COUNT; sample++) {
+			const int index = planar ? sample : sample * channel_count + channel;
+			uint8_t *data = frame->extended_data[planar ? channel : 0];
+			if (is_s16) {
+				((int16_t *)data)[index] = (int16_t)(AUDIO_CHANNEL_VALUES[channel] * 32768.0f);
+			} else {
+				((float *)data)[index] = AUDIO_CHANNEL_VALUES[channel];
+			}
+		}
+	}
+
+	Vector<uint64_t> samples;
+	PackedFloat32Array output;
+	bool golden = true;
+	for (int i = 0; i < p_iterations && golden; i++) {
+		const uint64_t start = OS::get_singleton()->get_ticks_usec();
+		golden = decoder->_convert_audio_frame(frame, output);
+		samples.push_back(OS::get_singleton()->get_ticks_usec() - start);
+	}
+
+	// With a constant input the output has to be the same constant per channel.
+	const int first_checked_sample = p_sample_rate != p_output_sample_rate && p_iterations == 1 ? RESAMPLER_SETTLE_SAMPLES : 0;
+	golden = golden && output.size() > first_checked_sample * channel_count && output.size() % channel_count == 0;
+	for (int i = first_checked_sample * channel_count; golden && i < output.size(); i++) {
+		golden = Math::abs(output[i] - AUDIO_CHANNEL_VALUES[i % channel_count]) < 0.001f;
+	}
+	av_frame_free(&frame);
+
+	const String format = vformat("%s %d->%d Hz", av_get_sample_fmt_name(p_format), p_sample_rate, p_output_sample_rate);
+	return make_frame_path_result("audio", format, Vector2i(AUDIO_SAMPLE_COUNT, channel_count), samples, (int64_t)AUDIO_SAMPLE_COUNT * channel_count * av_get_bytes_per_sample(p_format), golden);
+}
+
+Array FFmpegBenchmarks::measure_frame_paths(const Dictionary &p_options) {
+	Array results;
+	const int iterations = p_options.get("iterations", 100);
+	ERR_FAIL_COND_V(iterations <= 0, results);
+	Array sizes = p_options.get("sizes", Array());
+	if (sizes.is_empty()) {
+		// Odd sizes catch chroma rounding and row padding mistakes.
+		sizes.push_back(Vector2i(320, 180));
+		sizes.push_back(Vector2i(641, 361));
+		sizes.push_back(Vector2i(1280, 720));
+		sizes.push_back(Vector2i(1920, 1080));
+		sizes.push_back(Vector2i(3840, 2160));
+	}
+
+	for (int i = 0; i < sizes.size(); i++) {
+		const Vector2i size = sizes[i];
+		ERR_CONTINUE(size.x <= 0 || size.y <= 0);
+		const Vector2i half_size = Vector2i(MAX(1, size.x / 2), MAX(1, size.y / 2));
+		results.push_back(_measure_unwrap_yuv(AV_PIX_FMT_YUV420P, size, iterations));
+		results.push_back(_measure_unwrap_yuv(AV_PIX_FMT_YUVA420P, size, iterations));
+		results.push_back(_measure_unwrap_rgba(size, iterations));
+		results.push_back(_measure_scale(AV_PIX_FMT_YUV420P, AV_PIX_FMT_RGBA, size, size, iterations));
+		results.push_back(_measure_scale(AV_PIX_FMT_YUVA420P, AV_PIX_FMT_RGBA, size, size, iterations));
+		results.push_back(_measure_scale(AV_PIX_FMT_YUV444P, AV_PIX_FMT_RGBA, size, size, iterations));
+		results.push_back(_measure_scale(AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P, size, half_size, iterations));
+	}
+
+	results.push_back(_measure_audio_conversion(AV_SAMPLE_FMT_FLT, 48000, 48000, iterations));
+	results.push_back(_measure_audio_conversion(AV_SAMPLE_FMT_FLTP, 48000, 48000, iterations));
+	results.push_back(_measure_audio_conversion(AV_SAMPLE_FMT_S16, 48000, 48000, iterations));
+	results.push_back(_measure_audio_conversion(AV_SAMPLE_FMT_FLTP, 44100, 48000, iterations));
+	return results;
+}
@@ -0,0 +1,236 @@
+/**************************************************************************/
+/*  ffmpeg_test_clips.cpp                                                 */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_test_clips.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/dir_access.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/project_settings.hpp>
+#else
+#include "core/config/project_settings.h"
+#include "core/io/dir_access.h"
+#include "core/io/file_access.h"
+#endif
+
+#include "../video_decoder.h"
+
+extern "C" {
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+}
+
+// Encoder defaults are tuned for quality, benchmark clips only need to exist quickly.
+static void set_fast_encoder_options(AVCodecContext *p_context) {
+	const String encoder_name = p_context->codec->name;
+	if (encoder_name == "libx264" || encoder_name == "libx265") {
+		av_opt_set(p_context->priv_data, "preset", "ultrafast", 0);
+	} else if (encoder_name == "libvpx" || encoder_name == "libvpx-vp9") {
+		av_opt_set(p_context->priv_data, "deadline", "realtime", 0);
+		av_opt_set_int(p_context->priv_data, "cpu-used", 8, 0);
+	} else if (encoder_name == "libaom-av1") {
+		av_opt_set(p_context->priv_data, "usage", "realtime", 0);
+		av_opt_set_int(p_context->priv_data, "cpu-used", 8, 0);
+	} else if (encoder_name == "libsvtav1") {
+		av_opt_set_int(p_context->priv_data, "preset", 12, 0);
+	}
+}
+
+static int write_encoded_packets(AVCodecContext *p_encoder, AVFormatContext *p_format_context, AVStream *p_stream, AVPacket *p_packet) {
+	while (true) {
+		int result = avcodec_receive_packet(p_encoder, p_packet);
+		if (result == AVERROR(EAGAIN) || result == AVERROR_EOF) {
+			return 0;
+		}
+		if (result < 0) {
+			return result;
+		}
+		av_packet_rescale_ts(p_packet, p_encoder->time_base, p_stream->time_base);
+		p_packet->stream_index = p_stream->index;
+		result = av_interleaved_write_frame(p_format_context, p_packet);
+		if (result < 0) {
+			return result;
+		}
+	}
+}
+
+Error FFmpegTestClips::generate(const String &p_path, const Dictionary &p_options) {
+	const String codec_name = p_options.get("codec", "h264");
+	const Vector2i size = p_options.get("size", Vector2i(1280, 720));
+	const String pixel_format_name = p_options.get("pixel_format", "yuv420p");
+	const int fps = p_options.get("fps", 30);
+	const double duration = p_options.get("duration", 5.0);
+	const int gop = p_options.get("gop", fps * 2);
+	const String source = p_options.get("source", "testsrc");
+	ERR_FAIL_COND_V(size.x <= 0 || size.y <= 0 || fps <= 0 || duration <= 0.0, ERR_INVALID_PARAMETER);
+
+	const AVCodec *codec = avcodec_find_encoder_by_name(codec_name.utf8().get_data());
+	if (codec == nullptr) {
+		const AVCodecDescriptor *descriptor = avcodec_descriptor_get_by_name(codec_name.utf8().get_data());
+		codec = descriptor != nullptr ? avcodec_find_encoder(descriptor->id) : nullptr;
+	}
+	ERR_FAIL_NULL_V_MSG(codec, ERR_UNAVAILABLE, vformat("No encoder for %s in this FFmpeg build.", codec_name));
+	const AVPixelFormat pixel_format = av_get_pix_fmt(pixel_format_name.utf8().get_data());
+	ERR_FAIL_COND_V_MSG(pixel_format == AV_PIX_FMT_NONE, ERR_INVALID_PARAMETER, vformat("Unknown pixel format %s.", pixel_format_name));
+
+	const String os_path = ProjectSettings::get_singleton()->globalize_path(p_path);
+	const CharString os_path_utf8 = os_path.utf8();
+
+	AVFilterGraph *graph = nullptr;
+	AVFilterInOut *graph_inputs = nullptr;
+	AVFormatContext *format_context = nullptr;
+	AVCodecContext *encoder = nullptr;
+	AVFrame *frame = av_frame_alloc();
+	AVPacket *packet = av_packet_alloc();
+	Error error = FAILED;
+	int result = 0;
+	// Set once avio_open may have created or truncated the output.
+	bool output_touched = false;
+
+	// Same cleanup for every outcome, breaking out of this loop is the error path.
+	do {
+		graph = avfilter_graph_alloc();
+		AVFilterContext *sink = nullptr;
+		result = avfilter_graph_create_filter(&sink, avfilter_get_by_name("buffersink"), "out", nullptr, nullptr, graph);
+		if (result < 0) {
+			break;
+		}
+		graph_inputs = avfilter_inout_alloc();
+		graph_inputs->name = av_strdup("out");
+		graph_inputs->filter_ctx = sink;
+		graph_inputs->pad_idx = 0;
+		graph_inputs->next = nullptr;
+		const String graph_description = vformat("%s=size=%dx%d:rate=%d:duration=%f,format=%s", source, size.x, size.y, fps, duration, pixel_format_name);
+		result = avfilter_graph_parse_ptr(graph, graph_description.utf8().get_data(), &graph_inputs, nullptr, nullptr);
+		if (result < 0) {
+			break;
+		}
+		result = avfilter_graph_config(graph, nullptr);
+		if (result < 0) {
+			break;
+		}
+
+		result = avformat_alloc_output_context2(&format_context, nullptr, nullptr, os_path_utf8.get_data());
+		if (result < 0) {
+			break;
+		}
+		AVStream *stream = avformat_new_stream(format_context, nullptr);
+		encoder = avcodec_alloc_context3(codec);
+		if (stream == nullptr || encoder == nullptr) {
+			result = AVERROR(ENOMEM);
+			break;
+		}
+		encoder->width = size.x;
+		encoder->height = size.y;
+		encoder->pix_fmt = pixel_format;
+		encoder->time_base = AVRational{ 1, fps };
+		encoder->framerate = AVRational{ fps, 1 };
+		encoder->gop_size = gop;
+		if (format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+			encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+		}
+		set_fast_encoder_options(encoder);
+		result = avcodec_open2(encoder, codec, nullptr);
+		if (result < 0) {
+			break;
+		}
+		result = avcodec_parameters_from_context(stream->codecpar, encoder);
+		if (result < 0) {
+			break;
+		}
+		stream->time_base = encoder->time_base;
+
+		output_touched = true;
+		result = avio_open(&format_context->pb, os_path_utf8.get_data(), AVIO_FLAG_WRITE);
+		if (result < 0) {
+			break;
+		}
+		result = avformat_write_header(format_context, nullptr);
+		if (result < 0) {
+			break;
+		}
+
+		int64_t frame_index = 0;
+		while ((result = av_buffersink_get_frame(sink, frame)) >= 0) {
+			frame->pts = frame_index++;
+			frame->pict_type = AV_PICTURE_TYPE_NONE;
+			result = avcodec_send_frame(encoder, frame);
+			av_frame_unref(frame);
+			if (result < 0) {
+				break;
+			}
+			result = write_encoded_packets(encoder, format_context, stream, packet);
+			if (result < 0) {
+				break;
+			}
+		}
+		if (result != AVERROR_EOF) {
+			break;
+		}
+		// Flush the encoder.
+		result = avcodec_send_frame(encoder, nullptr);
+		if (result < 0) {
+			break;
+		}
+		result = write_encoded_packets(encoder, format_context, stream, packet);
+		if (result < 0) {
+			break;
+		}
+		result = av_write_trailer(format_context);
+		if (result < 0) {
+			break;
+		}
+		error = OK;
+	} while (false);
+
+	if (error != OK) {
+		ERR_PRINT(vformat("Couldn't generate %s: %s", p_path, ffmpeg_get_error_message(result)));
+	}
+
+	if (format_context != nullptr) {
+		if (format_context->pb != nullptr) {
+			avio_closep(&format_context->pb);
+		}
+		avformat_free_context(format_context);
+	}
+	avcodec_free_context(&encoder);
+	avfilter_inout_free(&graph_inputs);
+	avfilter_graph_free(&graph);
+	av_frame_free(&frame);
+	av_packet_free(&packet);
+
+	// Don't leave a truncated clip behind that looks like a usable one.
+	if (error != OK && output_touched && FileAccess::exists(os_path)) {
+		DirAccess::remove_absolute(os_path);
+	}
+	return error;
+}
@@ -0,0 +1,58 @@
+/**************************************************************************/
+/*  ffmpeg_test_clips.h                                                   */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_TEST_CLIPS_H
+#define FFMPEG_TEST_CLIPS_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/error/error_list.h"
+#include "core/variant/dictionary.h"
+
+#endif
+
+// Encodes synthetic clips from lavfi test sources so benchmarks don't depend on media files being around.
+class FFmpegTestClips {
+public:
+	// Options: "codec" (encoder or codec name, e.g. "h264", "vp8", "vp9", "av1"), "size" (Vector2i), "pixel_format" (e.g. "yuv420p", "yuva420p"),
+	// "fps", "duration" (seconds), "gop" (frames between keyframes) and "source" (a lavfi source filter, "testsrc" by default).
+	// The container is picked from the extension of p_path.
+	static Error generate(const String &p_path, const Dictionary &p_options);
+};
+
+#endif // FFMPEG_TEST_CLIPS_H
@@ -0,0 +1,29 @@
+# Microbenchmarks of the per frame unwrap, pixel format conversion and audio conversion paths on synthetic frames.
+# Requires a build with benchmarks=yes, run with:
+#   godot --headless --path <project> -s res://addons/ffmpeg/benchmarks/frame_benchmark.gd -- [results.json]
+# Exits with 1 if any path produced the wrong output, so it can gate changes to those paths.
+extends SceneTree
+
+const OPTIONS := { "iterations": 100 }
+
+
+func _init() -> void:
+	var args := OS.get_cmdline_user_args()
+	var output_path: String = args[0] if not args.is_empty() else ""
+
+	var results: Array = FFmpegBenchmarks.measure_frame_paths(OPTIONS)
+	var failed := false
+	for result in results:
+		var size: Vector2i = result.size
+		print("%-12s %-26s %-10s %9.3f ms %10.1f MB/s %s" % [result.stage, result.format, "%dx%d" % [size.x, size.y], result.usec.median / 1000.0,
+				result.bytes_per_second / 1000000.0, "" if result.golden else "WRONG OUTPUT"])
+		failed = failed or not result.golden
+
+	if not output_path.is_empty():
+		var file := FileAccess.open(output_path, FileAccess.WRITE)
+		if file == null:
+			printerr("Couldn't write %s" % output_path)
+			quit(1)
+			return
+		file.store_string(JSON.stringify(results, "\t"))
+	quit(1 if failed else 0)
@@ -0,0 +1,68 @@
+# Measures time-to-first-frame and seek latency of full playbacks on generated clips with different keyframe intervals and containers.
+# Requires a build with benchmarks=yes, run with:
+#   godot --headless --path <project> -s res://addons/ffmpeg/benchmarks/latency_benchmark.gd -- [results.json]
+extends SceneTree
+
+const CLIP_DIRECTORY := "user://ffmpeg_benchmark_clips"
+const SIZE := Vector2i(1280, 720)
+const FPS := 30
+const DURATION := 20.0
+const OPTIONS := { "iterations": 20, "seeks": 10 }
+
+# Container extension -> codec.
+const CONTAINERS := {
+	"mp4": "h264",
+	"mkv": "h264",
+	"webm": "vp9",
+}
+# Keyframe intervals in frames, all intra up to one keyframe every ~8 seconds.
+const GOPS := [1, 15, 60, 250]
+
+
+func _format_summary(summary: Dictionary) -> String:
+	if summary.get("samples", 0) == 0:
+		return "n/a"
+	return "p50 %7.2f  p95 %7.2f  p99 %7.2f ms" % [summary.median / 1000.0, summary.p95 / 1000.0, summary.p99 / 1000.0]
+
+
+func _get_clip(container: String, gop: int) -> String:
+	var codec: String = CONTAINERS[container]
+	var path := "%s/latency_%s_gop%d.%s" % [CLIP_DIRECTORY, codec, gop, container]
+	if FileAccess.file_exists(path):
+		return path
+	var options := { "codec": codec, "size": SIZE, "fps": FPS, "duration": DURATION, "gop": gop }
+	if FFmpegBenchmarks.generate_clip(path, options) != OK:
+		return ""
+	return path
+
+
+func _init() -> void:
+	var args := OS.get_cmdline_user_args()
+	var output_path: String = args[0] if not args.is_empty() else ""
+	DirAccess.make_dir_recursive_absolute(CLIP_DIRECTORY)
+
+	var results := []
+	for container in CONTAINERS:
+		for gop in GOPS:
+			var path := _get_clip(container, gop)
+			if path.is_empty():
+				print("%-5s gop %-4d skipped, couldn't encode" % [container, gop])
+				continue
+			var result: Dictionary = FFmpegBenchmarks.measure_latency(path, OPTIONS)
+			result.container = container
+			result.gop = gop
+			results.push_back(result)
+			print("%-5s gop %-4d" % [container, gop])
+			print("  first frame  %s" % _format_summary(result.first_frame_usec))
+			print("  seek         %s" % _format_summary(result.seek_usec))
+			if result.failures > 0:
+				print("  %d failed" % result.failures)
+
+	if not output_path.is_empty():
+		var file := FileAccess.open(output_path, FileAccess.WRITE)
+		if file == null:
+			printerr("Couldn't write %s" % output_path)
+			quit(1)
+			return
+		file.store_string(JSON.stringify(results, "\t"))
+	quit()
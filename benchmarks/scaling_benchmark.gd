@@ -0,0 +1,44 @@
+# Measures how frame delivery degrades as more videos play at once.
+# Requires a build with benchmarks=yes, run with:
+#   godot --headless --path <project> -s res://addons/ffmpeg/benchmarks/scaling_benchmark.gd -- [video] [results.json]
+# Without a video a 720p h264 clip is generated into user://.
+extends SceneTree
+
+const GENERATED_CLIP := "user://ffmpeg_benchmark_clips/scaling_h264_1280x720.mp4"
+const OPTIONS := {
+	"instance_counts": PackedInt32Array([1, 2, 4, 8, 16, 32, 64]),
+	"duration": 10.0,
+	"tick_rate": 60.0,
+	"real_time": true,
+}
+
+
+func _init() -> void:
+	var args := OS.get_cmdline_user_args()
+	var path: String = args[0] if args.size() > 0 else ""
+	var output_path: String = args[1] if args.size() > 1 else ""
+
+	if path.is_empty():
+		path = GENERATED_CLIP
+		if not FileAccess.file_exists(path):
+			DirAccess.make_dir_recursive_absolute(path.get_base_dir())
+			if FFmpegBenchmarks.generate_clip(path, { "codec": "h264", "size": Vector2i(1280, 720), "fps": 30, "duration": 10.0 }) != OK:
+				printerr("Couldn't generate a clip, pass a video after --")
+				quit(1)
+				return
+
+	var results: Array = FFmpegBenchmarks.measure_playback_scaling(path, OPTIONS)
+	print("%9s %10s %8s %8s %14s %8s %5s %12s" % ["instances", "fps/inst", "late", "dropped", "update p95 ms", "threads", "cpu", "MiB/inst"])
+	for result in results:
+		print("%9d %10.1f %8d %8d %14.2f %8d %5.2f %12.1f" % [result.instances, result.presented_fps_per_instance, result.late_frames,
+				result.dropped_frames, result.update_usec.get("p95", 0) / 1000.0, result.threads, result.cpu_utilization,
+				result.memory_per_instance / (1024.0 * 1024.0)])
+
+	if not output_path.is_empty():
+		var file := FileAccess.open(output_path, FileAccess.WRITE)
+		if file == null:
+			printerr("Couldn't write %s" % output_path)
+			quit(1)
+			return
+		file.store_string(JSON.stringify(results, "\t"))
+	quit()
@@ -0,0 +1,34 @@
+# Measures time-to-first-frame under different probing settings.
+# Requires a build with benchmarks=yes, run with:
+#   godot --headless --path <project> -s res://addons/ffmpeg/benchmarks/startup_benchmark.gd -- video.mp4 video.webm video.mkv
+extends SceneTree
+
+const ITERATIONS := 10
+
+const PROFILES := {
+	"default": {},
+	"small probe": { "probe_size": 32768, "analyze_duration_usec": 100000 },
+	"trust container": { "trust_container": true },
+	"small probe + trust": { "probe_size": 32768, "analyze_duration_usec": 100000, "trust_container": true },
+}
+
+
+func _format_summary(summary: Dictionary) -> String:
+	if summary.get("samples", 0) == 0:
+		return "n/a"
+	return "%.2f ms (min %.2f, max %.2f)" % [summary.median / 1000.0, summary.min / 1000.0, summary.max / 1000.0]
+
+
+func _init() -> void:
+	var paths := OS.get_cmdline_user_args()
+	if paths.is_empty():
+		printerr("Pass the files to benchmark after --")
+		quit(1)
+		return
+
+	for path in paths:
+		print(path)
+		for profile_name in PROFILES:
+			var result: Dictionary = FFmpegBenchmarks.measure_startup(path, PROFILES[profile_name], ITERATIONS)
+			print("  %-20s open %s, first frame %s, %d failed" % [profile_name, _format_summary(result.open_usec), _format_summary(result.first_frame_usec), result.failures])
+	quit()
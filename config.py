@@ -15,6 +15,7 @@ def get_opts(platform):
 
     return [
         ("ffmpeg_path", "FFmpeg path", ""),
+        BoolVariable("ffmpeg_benchmarks", "Build the FFmpegBenchmarks class used by the scripts in benchmarks/", False),
     ]
 
 
@@ -0,0 +1,155 @@
+/**************************************************************************/
+/*  ffmpeg_decoder_pool.cpp                                               */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_decoder_pool.h"
+
+#include "ffmpeg_settings.h"
+#include "tracy_import.h"
+
+Mutex *FFmpegDecoderPool::mutex = nullptr;
+Vector<FFmpegDecoderPool::Entry> *FFmpegDecoderPool::entries = nullptr;
+uint64_t FFmpegDecoderPool::use_counter = 0;
+
+int64_t FFmpegDecoderPool::_get_entry_memory(const Entry &p_entry) {
+	Ref<FFmpegIOSource> io_source = p_entry.decoder->get_io_source();
+	return p_entry.decoder->get_memory_usage() + (io_source.is_valid() ? io_source->get_memory_usage() : 0);
+}
+
+void FFmpegDecoderPool::_evict(Vector<Entry> &r_evicted) {
+	const int max_decoders = FFmpegSettings::get_setting("ffmpeg/decoder_pool/max_decoders");
+	const int64_t memory_limit = FFmpegSettings::get_setting("ffmpeg/decoder_pool/memory_limit");
+
+	while (entries->size() > 0) {
+		int64_t memory_usage = 0;
+		int oldest = 0;
+		for (int i = 0; i < entries->size(); i++) {
+			memory_usage += _get_entry_memory(entries->get(i));
+			if (entries->get(i).last_used < entries->get(oldest).last_used) {
+				oldest = i;
+			}
+		}
+		if (entries->size() <= max_decoders && memory_usage <= memory_limit) {
+			break;
+		}
+		r_evicted.push_back(entries->get(oldest));
+		entries->remove_at(oldest);
+	}
+}
+
+void FFmpegDecoderPool::add(const String &p_key, Ref<VideoDecoder> p_decoder) {
+	ERR_FAIL_COND(p_decoder.is_null());
+	if (mutex == nullptr) {
+		return;
+	}
+	// Evicted decoders are destroyed outside the lock, joining their threads can take a moment.
+	Vector<Entry> evicted;
+	{
+		MutexLock lock(*mutex);
+		if (entries == nullptr) {
+			entries = memnew(Vector<Entry>);
+		}
+		Entry entry;
+		entry.key = p_key;
+		entry.decoder = p_decoder;
+		entry.last_used = ++use_counter;
+		entries->push_back(entry);
+		_evict(evicted);
+		TracyPlot("FFmpeg decoder pool", (int64_t)entries->size());
+	}
+}
+
+bool FFmpegDecoderPool::claim(const String &p_key, Ref<VideoDecoder> &r_decoder) {
+	if (mutex == nullptr) {
+		return false;
+	}
+	MutexLock lock(*mutex);
+	if (entries == nullptr) {
+		return false;
+	}
+	// Any matching decoder will do, take the newest one.
+	for (int i = entries->size() - 1; i >= 0; i--) {
+		const Entry &entry = entries->get(i);
+		if (entry.key != p_key || entry.decoder->get_decoder_state() == VideoDecoder::FAULTED) {
+			continue;
+		}
+		r_decoder = entry.decoder;
+		entries->remove_at(i);
+		TracyPlot("FFmpeg decoder pool", (int64_t)entries->size());
+		return true;
+	}
+	return false;
+}
+
+void FFmpegDecoderPool::trim(int64_t p_bytes) {
+	Vector<Entry> evicted;
+	{
+		if (mutex == nullptr) {
+			return;
+		}
+		MutexLock lock(*mutex);
+		if (entries == nullptr) {
+			return;
+		}
+		int64_t freed = 0;
+		while (freed < p_bytes && entries->size() > 0) {
+			int oldest = 0;
+			for (int i = 1; i < entries->size(); i++) {
+				if (entries->get(i).last_used < entries->get(oldest).last_used) {
+					oldest = i;
+				}
+			}
+			freed += _get_entry_memory(entries->get(oldest));
+			evicted.push_back(entries->get(oldest));
+			entries->remove_at(oldest);
+		}
+		TracyPlot("FFmpeg decoder pool", (int64_t)entries->size());
+	}
+}
+
+void FFmpegDecoderPool::initialize() {
+	mutex = memnew(Mutex);
+}
+
+void FFmpegDecoderPool::clear() {
+	if (mutex == nullptr) {
+		return;
+	}
+	Vector<Entry> *old_entries = nullptr;
+	{
+		MutexLock lock(*mutex);
+		old_entries = entries;
+		entries = nullptr;
+	}
+	if (old_entries != nullptr) {
+		memdelete(old_entries);
+	}
+	memdelete(mutex);
+	mutex = nullptr;
+}
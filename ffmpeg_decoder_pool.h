@@ -0,0 +1,65 @@
+/**************************************************************************/
+/*  ffmpeg_decoder_pool.h                                                 */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_DECODER_POOL_H
+#define FFMPEG_DECODER_POOL_H
+
+#include "video_decoder.h"
+
+// Decoders that were opened and pre-rolled ahead of time (see FFmpegVideoStream::prewarm), waiting for a playback to claim them.
+// Least recently added decoders are dropped once there are too many or they use too much memory.
+class FFmpegDecoderPool {
+	struct Entry {
+		String key;
+		Ref<VideoDecoder> decoder;
+		uint64_t last_used = 0;
+	};
+
+	// Created in initialize(), engine objects can't be constructed before the engine is up.
+	static Mutex *mutex;
+	// Allocated on first use and freed in clear(), so nothing is left to destroy after the engine shut down.
+	static Vector<Entry> *entries;
+	static uint64_t use_counter;
+
+	static void _evict(Vector<Entry> &r_evicted);
+	static int64_t _get_entry_memory(const Entry &p_entry);
+
+public:
+	// p_key identifies the file and every setting that affects decoding, only playbacks with the same key can claim the decoder.
+	static void add(const String &p_key, Ref<VideoDecoder> p_decoder);
+	static bool claim(const String &p_key, Ref<VideoDecoder> &r_decoder);
+	// Drops the least recently added decoders until at least p_bytes were freed or the pool is empty.
+	static void trim(int64_t p_bytes);
+	static void initialize();
+	// Frees everything, calls made afterwards (playbacks outliving the module) do nothing.
+	static void clear();
+};
+
+#endif // FFMPEG_DECODER_POOL_H
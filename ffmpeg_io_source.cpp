@@ -0,0 +1,510 @@
+/**************************************************************************/
+/*  ffmpeg_io_source.cpp                                                  */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_io_source.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/project_settings.hpp>
+#else
+#include "core/config/project_settings.h"
+#include "core/io/file_access_pack.h"
+#include "core/os/os.h"
+#include "core/os/thread.h"
+#endif
+
+#include "ffmpeg_trace.h"
+#include "tracy_import.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include "libavformat/avio.h"
+}
+
+#include <cstdio>
+#include <cstring>
+
+static TracySumPlot read_ahead_buffered_plot("FFmpeg read-ahead buffered");
+
+// Bytes read through FileAccess to make sure a mapping has the same contents.
+const int64_t MAPPED_FILE_COMPARE_SIZE = 4096;
+
+int FFmpegFileIOSource::read(uint8_t *p_buffer, int p_size) {
+	const uint64_t read_start = OS::get_singleton()->get_ticks_usec();
+	uint64_t read_bytes = file->get_buffer(p_buffer, p_size);
+	read_time_usec.add(OS::get_singleton()->get_ticks_usec() - read_start);
+	bytes_read.add(read_bytes);
+	read_count.increment();
+	return read_bytes;
+}
+
+int64_t FFmpegFileIOSource::seek(int64_t p_offset, int p_whence) {
+	switch (p_whence) {
+		case SEEK_CUR: {
+			file->seek(file->get_position() + p_offset);
+		} break;
+		case SEEK_SET: {
+			file->seek(p_offset);
+		} break;
+		case SEEK_END: {
+			file->seek_end(p_offset);
+		} break;
+		case AVSEEK_SIZE: {
+			return file->get_length();
+		} break;
+		default: {
+			return -1;
+		} break;
+	}
+	return file->get_position();
+}
+
+int64_t FFmpegFileIOSource::get_length() const {
+	return file->get_length();
+}
+
+FFmpegIOSource::Statistics FFmpegFileIOSource::get_statistics() const {
+	// Reads happen on the decoder thread, so all of the read time is time the decoder was stalled.
+	Statistics statistics;
+	statistics.bytes_read = bytes_read.get();
+	statistics.source_bytes_read = bytes_read.get();
+	statistics.source_read_time_usec = read_time_usec.get();
+	statistics.stall_time_usec = read_time_usec.get();
+	statistics.stall_count = read_count.get();
+	return statistics;
+}
+
+FFmpegFileIOSource::FFmpegFileIOSource(Ref<FileAccess> p_file) {
+	file = p_file;
+}
+
+bool FFmpegMappedFileIOSource::_map(const String &p_os_path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileW((LPCWSTR)(p_os_path.utf16().get_data()), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	mapping_handle = mapping;
+	data = (const uint8_t *)view;
+	length = file_size.QuadPart;
+#else
+	int fd = ::open(p_os_path.utf8().get_data(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void *mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file.
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+	data = (const uint8_t *)mapping;
+	length = file_stat.st_size;
+#endif
+	return true;
+}
+
+int FFmpegMappedFileIOSource::read(uint8_t *p_buffer, int p_size) {
+	const uint64_t read_start = OS::get_singleton()->get_ticks_usec();
+	const int read_bytes = MAX((int64_t)0, MIN((int64_t)p_size, length - position));
+	memcpy(p_buffer, data + position, read_bytes);
+	position += read_bytes;
+	read_time_usec.add(OS::get_singleton()->get_ticks_usec() - read_start);
+	bytes_read.add(read_bytes);
+	read_count.increment();
+	return read_bytes;
+}
+
+int64_t FFmpegMappedFileIOSource::seek(int64_t p_offset, int p_whence) {
+	switch (p_whence) {
+		case SEEK_CUR: {
+			position += p_offset;
+		} break;
+		case SEEK_SET: {
+			position = p_offset;
+		} break;
+		case SEEK_END: {
+			position = length + p_offset;
+		} break;
+		case AVSEEK_SIZE: {
+			return length;
+		} break;
+		default: {
+			return -1;
+		} break;
+	}
+	position = CLAMP(position, (int64_t)0, length);
+	return position;
+}
+
+int64_t FFmpegMappedFileIOSource::get_length() const {
+	return length;
+}
+
+FFmpegIOSource::Statistics FFmpegMappedFileIOSource::get_statistics() const {
+	// Page faults are taken during the copy, so the copy time is the time spent waiting on storage.
+	Statistics statistics;
+	statistics.bytes_read = bytes_read.get();
+	statistics.source_bytes_read = bytes_read.get();
+	statistics.source_read_time_usec = read_time_usec.get();
+	statistics.stall_time_usec = read_time_usec.get();
+	statistics.stall_count = read_count.get();
+	return statistics;
+}
+
+Ref<FFmpegIOSource> FFmpegMappedFileIOSource::open(Ref<FileAccess> p_file_access) {
+	ERR_FAIL_COND_V(p_file_access.is_null(), Ref<FFmpegIOSource>());
+	String path = p_file_access->get_path();
+	// Resources can come from a PCK (and be encrypted) while a stale file sits at the same place on disk, only map them
+	// when it's certain they don't. user:// and absolute paths always refer to the filesystem.
+	if (path.begins_with("res://")) {
+#ifdef GDEXTENSION
+		// Extensions can't ask where a resource comes from, exported projects keep theirs in PCKs.
+		if (OS::get_singleton()->has_feature("template")) {
+			return Ref<FFmpegIOSource>();
+		}
+#else
+		if (PackedData::get_singleton() != nullptr && PackedData::get_singleton()->has_path(path)) {
+			return Ref<FFmpegIOSource>();
+		}
+#endif
+	}
+	String os_path = ProjectSettings::get_singleton()->globalize_path(path);
+	if (os_path.begins_with("res://") || os_path.begins_with("user://")) {
+		return Ref<FFmpegIOSource>();
+	}
+
+	FFmpegMappedFileIOSource *source = memnew(FFmpegMappedFileIOSource);
+	Ref<FFmpegIOSource> source_ref = source;
+	if (!source->_map(os_path)) {
+		return Ref<FFmpegIOSource>();
+	}
+
+	// Encrypted and compressed handles, or a pack loaded at runtime overriding the resource, don't read what's on disk.
+	// Their length rarely matches, and if it does the start of the file won't.
+	if (source->length != (int64_t)p_file_access->get_length()) {
+		return Ref<FFmpegIOSource>();
+	}
+	const int64_t compare_size = MIN(source->length, MAPPED_FILE_COMPARE_SIZE);
+	const uint64_t file_position = p_file_access->get_position();
+	p_file_access->seek(0);
+	Vector<uint8_t> file_start;
+	file_start.resize(compare_size);
+	const uint64_t compared_bytes = p_file_access->get_buffer(file_start.ptrw(), compare_size);
+	p_file_access->seek(file_position);
+	if ((int64_t)compared_bytes != compare_size || memcmp(file_start.ptr(), source->data, compare_size) != 0) {
+		return Ref<FFmpegIOSource>();
+	}
+	return source_ref;
+}
+
+FFmpegMappedFileIOSource::~FFmpegMappedFileIOSource() {
+	if (data == nullptr) {
+		return;
+	}
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle((HANDLE)mapping_handle);
+	CloseHandle((HANDLE)file_handle);
+#else
+	munmap((void *)data, length);
+#endif
+}
+
+int FFmpegMemoryIOSource::read(uint8_t *p_buffer, int p_size) {
+	const int read_bytes = MAX((int64_t)0, MIN((int64_t)p_size, (int64_t)data.size() - position));
+	memcpy(p_buffer, data.ptr() + position, read_bytes);
+	position += read_bytes;
+	bytes_read.add(read_bytes);
+	return read_bytes;
+}
+
+int64_t FFmpegMemoryIOSource::seek(int64_t p_offset, int p_whence) {
+	switch (p_whence) {
+		case SEEK_CUR: {
+			position += p_offset;
+		} break;
+		case SEEK_SET: {
+			position = p_offset;
+		} break;
+		case SEEK_END: {
+			position = data.size() + p_offset;
+		} break;
+		case AVSEEK_SIZE: {
+			return data.size();
+		} break;
+		default: {
+			return -1;
+		} break;
+	}
+	position = CLAMP(position, (int64_t)0, (int64_t)data.size());
+	return position;
+}
+
+int64_t FFmpegMemoryIOSource::get_length() const {
+	return data.size();
+}
+
+FFmpegIOSource::Statistics FFmpegMemoryIOSource::get_statistics() const {
+	Statistics statistics;
+	statistics.bytes_read = bytes_read.get();
+	return statistics;
+}
+
+FFmpegMemoryIOSource::FFmpegMemoryIOSource(const PackedByteArray &p_data) {
+	data = p_data;
+}
+
+void FFmpegReadAheadIOSource::_copy_from_cache(int64_t p_offset, uint8_t *p_buffer, int p_size) const {
+	const int capacity = cache.size();
+	const int ring_offset = p_offset % capacity;
+	const int first_part = MIN(p_size, capacity - ring_offset);
+	memcpy(p_buffer, cache.ptr() + ring_offset, first_part);
+	if (first_part < p_size) {
+		memcpy(p_buffer + first_part, cache.ptr(), p_size - first_part);
+	}
+}
+
+void FFmpegReadAheadIOSource::_copy_to_cache(int64_t p_offset, const uint8_t *p_buffer, int p_size) {
+	const int capacity = cache.size();
+	const int ring_offset = p_offset % capacity;
+	const int first_part = MIN(p_size, capacity - ring_offset);
+	memcpy(cache.ptrw() + ring_offset, p_buffer, first_part);
+	if (first_part < p_size) {
+		memcpy(cache.ptrw(), p_buffer + first_part, p_size - first_part);
+	}
+}
+
+bool FFmpegReadAheadIOSource::_can_fill() const {
+	// Never overwrite data the reader hasn't consumed yet, everything behind it may be recycled.
+	return thread_abort || (!source_exhausted && cache_end - position < cache.size());
+}
+
+void FFmpegReadAheadIOSource::_thread_func(void *p_userdata) {
+	FFmpegReadAheadIOSource *read_ahead = (FFmpegReadAheadIOSource *)p_userdata;
+#ifdef GDEXTENSION
+	const String thread_name = vformat("FFmpeg I/O %d", OS::get_singleton()->get_thread_caller_id());
+#else
+	const String thread_name = vformat("FFmpeg I/O %d", Thread::get_caller_id());
+#endif
+	TracySetThreadName(thread_name.utf8().get_data());
+	FFmpegTrace::set_thread_name(thread_name);
+	Vector<uint8_t> block;
+	block.resize(read_ahead->block_size);
+	int64_t source_position = -1;
+
+	while (true) {
+		int64_t fill_offset;
+		uint64_t fill_generation;
+		int fill_size;
+		read_ahead->mutex.lock();
+		while (!read_ahead->_can_fill()) {
+			read_ahead->mutex.unlock();
+			read_ahead->space_available.wait();
+			read_ahead->mutex.lock();
+		}
+		if (read_ahead->thread_abort) {
+			read_ahead->mutex.unlock();
+			break;
+		}
+		fill_offset = read_ahead->cache_end;
+		fill_generation = read_ahead->generation;
+		// Blocks are kept aligned to the block size, reads after a seek only fill up to the next boundary.
+		fill_size = read_ahead->block_size - (fill_offset % read_ahead->block_size);
+		fill_size = MIN((int64_t)fill_size, read_ahead->cache.size() - (read_ahead->cache_end - read_ahead->position));
+		read_ahead->mutex.unlock();
+
+		const uint64_t read_start = OS::get_singleton()->get_ticks_usec();
+		if (source_position != fill_offset) {
+			source_position = read_ahead->source->seek(fill_offset, SEEK_SET);
+		}
+		int read_bytes = source_position == fill_offset ? read_ahead->source->read(block.ptrw(), fill_size) : 0;
+		source_position = read_bytes > 0 ? source_position + read_bytes : -1;
+		const uint64_t read_time = OS::get_singleton()->get_ticks_usec() - read_start;
+
+		MutexLock lock(read_ahead->mutex);
+		read_ahead->source_bytes_read += MAX(read_bytes, 0);
+		read_ahead->source_read_time_usec += read_time;
+		if (fill_generation != read_ahead->generation) {
+			// The reader seeked somewhere else while we were reading, this block is useless now.
+			continue;
+		}
+		if (read_bytes <= 0) {
+			read_ahead->source_exhausted = true;
+		} else {
+			read_ahead->_copy_to_cache(fill_offset, block.ptr(), read_bytes);
+			read_ahead->cache_end += read_bytes;
+			read_ahead->cache_start = MAX(read_ahead->cache_start, read_ahead->cache_end - read_ahead->cache.size());
+		}
+		read_ahead_buffered_plot.report(read_ahead->plotted_buffered, read_ahead->cache_end - read_ahead->position);
+		read_ahead->data_available.post();
+	}
+}
+
+int FFmpegReadAheadIOSource::read(uint8_t *p_buffer, int p_size) {
+	mutex.lock();
+	if (position >= cache_end && !source_exhausted) {
+		const uint64_t stall_start = OS::get_singleton()->get_ticks_usec();
+		while (position >= cache_end && !source_exhausted && !thread_abort) {
+			mutex.unlock();
+			data_available.wait();
+			mutex.lock();
+		}
+		stall_time_usec += OS::get_singleton()->get_ticks_usec() - stall_start;
+		stall_count++;
+	}
+
+	if (position >= cache_end) {
+		mutex.unlock();
+		return 0;
+	}
+
+	const int read_size = MIN((int64_t)p_size, cache_end - position);
+	_copy_from_cache(position, p_buffer, read_size);
+	position += read_size;
+	bytes_read += read_size;
+	mutex.unlock();
+	space_available.post();
+	return read_size;
+}
+
+int64_t FFmpegReadAheadIOSource::seek(int64_t p_offset, int p_whence) {
+	MutexLock lock(mutex);
+	int64_t target;
+	switch (p_whence) {
+		case SEEK_CUR: {
+			target = position + p_offset;
+		} break;
+		case SEEK_SET: {
+			target = p_offset;
+		} break;
+		case SEEK_END: {
+			target = length + p_offset;
+		} break;
+		case AVSEEK_SIZE: {
+			return length;
+		} break;
+		default: {
+			return -1;
+		} break;
+	}
+	target = CLAMP(target, (int64_t)0, length);
+
+	if (target >= cache_start && target <= cache_end) {
+		// Seeking within the cached window is just moving the read position.
+		position = target;
+		space_available.post();
+		return position;
+	}
+
+	// Drop the cache and restart filling from the block containing the target.
+	position = target;
+	cache_start = target - (target % block_size);
+	cache_end = cache_start;
+	source_exhausted = false;
+	generation++;
+	space_available.post();
+	return position;
+}
+
+int64_t FFmpegReadAheadIOSource::get_length() const {
+	return length;
+}
+
+FFmpegIOSource::Statistics FFmpegReadAheadIOSource::get_statistics() const {
+	MutexLock lock(mutex);
+	Statistics statistics;
+	statistics.bytes_read = bytes_read;
+	statistics.source_bytes_read = source_bytes_read;
+	statistics.source_read_time_usec = source_read_time_usec;
+	statistics.stall_time_usec = stall_time_usec;
+	statistics.stall_count = stall_count;
+	return statistics;
+}
+
+int64_t FFmpegReadAheadIOSource::get_memory_usage() const {
+	// The I/O thread also keeps a block sized staging buffer.
+	return cache.size() + block_size + (source.is_valid() ? source->get_memory_usage() : 0);
+}
+
+FFmpegReadAheadIOSource::FFmpegReadAheadIOSource(Ref<FFmpegIOSource> p_source, int p_cache_size, int p_block_size) {
+	source = p_source;
+	length = source->get_length();
+	block_size = MAX(p_block_size, 4096);
+	cache.resize(MAX(p_cache_size, block_size));
+	memory_account.set(cache.size() + block_size);
+	thread = memnew(std::thread(_thread_func, this));
+}
+
+FFmpegReadAheadIOSource::~FFmpegReadAheadIOSource() {
+	{
+		MutexLock lock(mutex);
+		thread_abort = true;
+	}
+	space_available.post();
+	data_available.post();
+	thread->join();
+	memdelete(thread);
+	read_ahead_buffered_plot.report(plotted_buffered, 0);
+}
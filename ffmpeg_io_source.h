@@ -0,0 +1,193 @@
+/**************************************************************************/
+/*  ffmpeg_io_source.h                                                    */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_IO_SOURCE_H
+#define FFMPEG_IO_SOURCE_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/classes/semaphore.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/templates/safe_refcount.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/io/file_access.h"
+#include "core/object/ref_counted.h"
+#include "core/os/mutex.h"
+#include "core/os/semaphore.h"
+#include "core/templates/safe_refcount.h"
+#include "core/templates/vector.h"
+
+#endif
+
+#include "ffmpeg_memory_budget.h"
+
+#include <thread>
+
+// Byte source libavformat reads through, seek follows the AVIOContext seek callback semantics (including AVSEEK_SIZE).
+class FFmpegIOSource : public RefCounted {
+public:
+	struct Statistics {
+		// Bytes handed to libavformat.
+		uint64_t bytes_read = 0;
+		// Bytes read from the underlying storage and how long that took.
+		uint64_t source_bytes_read = 0;
+		uint64_t source_read_time_usec = 0;
+		// Time the decoder thread spent blocked waiting for data.
+		uint64_t stall_time_usec = 0;
+		uint64_t stall_count = 0;
+	};
+
+	// Returns the amount of bytes read, 0 means end of file.
+	virtual int read(uint8_t *p_buffer, int p_size) = 0;
+	virtual int64_t seek(int64_t p_offset, int p_whence) = 0;
+	virtual int64_t get_length() const = 0;
+	virtual Statistics get_statistics() const { return Statistics(); }
+	// Heap memory owned by this source, shared or OS-managed memory (page cache, mappings) isn't counted.
+	virtual int64_t get_memory_usage() const { return 0; }
+};
+
+class FFmpegFileIOSource : public FFmpegIOSource {
+	Ref<FileAccess> file;
+	SafeNumeric<uint64_t> bytes_read;
+	SafeNumeric<uint64_t> read_time_usec;
+	SafeNumeric<uint64_t> read_count;
+
+public:
+	virtual int read(uint8_t *p_buffer, int p_size) override;
+	virtual int64_t seek(int64_t p_offset, int p_whence) override;
+	virtual int64_t get_length() const override;
+	virtual Statistics get_statistics() const override;
+
+	FFmpegFileIOSource(Ref<FileAccess> p_file);
+};
+
+// Serves reads straight out of a read-only memory mapping of a file on the local filesystem.
+class FFmpegMappedFileIOSource : public FFmpegIOSource {
+	const uint8_t *data = nullptr;
+	int64_t length = 0;
+	int64_t position = 0;
+#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+#endif
+	SafeNumeric<uint64_t> bytes_read;
+	SafeNumeric<uint64_t> read_time_usec;
+	SafeNumeric<uint64_t> read_count;
+
+	bool _map(const String &p_os_path);
+
+	FFmpegMappedFileIOSource() {}
+
+public:
+	virtual int read(uint8_t *p_buffer, int p_size) override;
+	virtual int64_t seek(int64_t p_offset, int p_whence) override;
+	virtual int64_t get_length() const override;
+	virtual Statistics get_statistics() const override;
+
+	// Maps the file backing p_file_access, returns null when it doesn't live as-is on disk (packed, encrypted...).
+	// Reads the start of the file through p_file_access to check, its position is restored.
+	static Ref<FFmpegIOSource> open(Ref<FileAccess> p_file_access);
+	~FFmpegMappedFileIOSource();
+};
+
+// Reads from a file that was loaded into memory in its entirety, the data is shared (copy-on-write) between sources.
+class FFmpegMemoryIOSource : public FFmpegIOSource {
+	PackedByteArray data;
+	int64_t position = 0;
+	SafeNumeric<uint64_t> bytes_read;
+
+public:
+	virtual int read(uint8_t *p_buffer, int p_size) override;
+	virtual int64_t seek(int64_t p_offset, int p_whence) override;
+	virtual int64_t get_length() const override;
+	virtual Statistics get_statistics() const override;
+
+	FFmpegMemoryIOSource(const PackedByteArray &p_data);
+};
+
+// Keeps a window of the wrapped source read ahead of the reader, filled in large aligned blocks by its own thread.
+class FFmpegReadAheadIOSource : public FFmpegIOSource {
+	Ref<FFmpegIOSource> source;
+	int64_t length = 0;
+	int block_size = 0;
+
+	// Ring buffer holding the file range [cache_start, cache_end).
+	Vector<uint8_t> cache;
+	int64_t cache_start = 0;
+	int64_t cache_end = 0;
+	int64_t position = 0;
+	// Bumped on every seek outside the cached range so in-flight blocks for the old position are discarded.
+	uint64_t generation = 0;
+	bool source_exhausted = false;
+	FFmpegMemoryAccount memory_account{ FFmpegMemoryBudget::CATEGORY_IO };
+
+	mutable Mutex mutex;
+	// Posted whenever the state they are named after may have changed, waiters check again under the mutex.
+	Semaphore data_available;
+	Semaphore space_available;
+	std::thread *thread = nullptr;
+	bool thread_abort = false;
+
+	uint64_t source_bytes_read = 0;
+	uint64_t source_read_time_usec = 0;
+	uint64_t bytes_read = 0;
+	uint64_t stall_time_usec = 0;
+	uint64_t stall_count = 0;
+	// Only touched by the read-ahead thread until it is joined.
+	int64_t plotted_buffered = 0;
+
+	static void _thread_func(void *p_userdata);
+	void _copy_from_cache(int64_t p_offset, uint8_t *p_buffer, int p_size) const;
+	void _copy_to_cache(int64_t p_offset, const uint8_t *p_buffer, int p_size);
+	bool _can_fill() const;
+
+public:
+	virtual int read(uint8_t *p_buffer, int p_size) override;
+	virtual int64_t seek(int64_t p_offset, int p_whence) override;
+	virtual int64_t get_length() const override;
+	virtual Statistics get_statistics() const override;
+
+	virtual int64_t get_memory_usage() const override;
+
+	FFmpegReadAheadIOSource(Ref<FFmpegIOSource> p_source, int p_cache_size, int p_block_size);
+	~FFmpegReadAheadIOSource();
+};
+
+#endif // FFMPEG_IO_SOURCE_H
@@ -0,0 +1,227 @@
+/**************************************************************************/
+/*  ffmpeg_loop_cache.cpp                                                 */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_loop_cache.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/file_access.hpp>
+#else
+#include "core/io/compression.h"
+#endif
+
+#include "ffmpeg_video_stream.h"
+
+static PackedByteArray compress_plane(const PackedByteArray &p_data) {
+#ifdef GDEXTENSION
+	return p_data.compress(FileAccess::COMPRESSION_ZSTD);
+#else
+	PackedByteArray compressed;
+	compressed.resize(Compression::get_max_compressed_buffer_size(p_data.size(), Compression::MODE_ZSTD));
+	const int compressed_size = Compression::compress(compressed.ptrw(), p_data.ptr(), p_data.size(), Compression::MODE_ZSTD);
+	ERR_FAIL_COND_V(compressed_size < 0, PackedByteArray());
+	compressed.resize(compressed_size);
+	return compressed;
+#endif
+}
+
+static PackedByteArray decompress_plane(const PackedByteArray &p_data, int p_size) {
+#ifdef GDEXTENSION
+	return p_data.decompress(p_size, FileAccess::COMPRESSION_ZSTD);
+#else
+	PackedByteArray decompressed;
+	decompressed.resize(p_size);
+	const int decompressed_size = Compression::decompress(decompressed.ptrw(), p_size, p_data.ptr(), p_data.size(), Compression::MODE_ZSTD);
+	ERR_FAIL_COND_V(decompressed_size != p_size, PackedByteArray());
+	return decompressed;
+#endif
+}
+
+FFmpegLoopCache::CachedPlane FFmpegLoopCache::_cache_plane(const Ref<Image> &p_image) {
+	CachedPlane plane;
+	if (p_image.is_null()) {
+		return plane;
+	}
+	plane.size = p_image->get_size();
+	plane.format = p_image->get_format();
+	PackedByteArray data = p_image->get_data();
+	plane.data_size = data.size();
+	if (mode == MODE_RAM_COMPRESSED) {
+		plane.compressed_data = compress_plane(data);
+	} else {
+		// The decoder never writes to an image it handed out, keeping a reference is enough.
+		plane.image = p_image;
+	}
+	return plane;
+}
+
+Ref<Image> FFmpegLoopCache::_restore_plane(const CachedPlane &p_plane) const {
+	if (p_plane.image.is_valid() || p_plane.compressed_data.is_empty()) {
+		return p_plane.image;
+	}
+	PackedByteArray data = decompress_plane(p_plane.compressed_data, p_plane.data_size);
+	ERR_FAIL_COND_V(data.size() != p_plane.data_size, Ref<Image>());
+	return Image::create_from_data(p_plane.size.x, p_plane.size.y, false, (Image::Format)p_plane.format, data);
+}
+
+int64_t FFmpegLoopCache::total_memory_usage = 0;
+
+bool FFmpegLoopCache::_can_add_frame(int64_t p_frame_memory) const {
+	return total_memory_usage + p_frame_memory <= memory_limit && !FFmpegMemoryBudget::is_over_budget(p_frame_memory);
+}
+
+bool FFmpegLoopCache::_add_frame(const CachedFrame &p_frame, int64_t p_frame_memory) {
+	if (!_can_add_frame(p_frame_memory)) {
+		// The clip doesn't qualify, don't keep a partial cache around.
+		clear();
+		failed = true;
+		return false;
+	}
+	memory_usage += p_frame_memory;
+	total_memory_usage += p_frame_memory;
+	memory_account.set(memory_usage);
+	frames.push_back(p_frame);
+	return true;
+}
+
+void FFmpegLoopCache::record_frame(const Ref<DecodedFrame> &p_frame, double p_time) {
+	ERR_FAIL_COND(p_frame.is_null());
+	if (complete || failed) {
+		return;
+	}
+	if (!frames.is_empty() && p_time <= frames[frames.size() - 1].time) {
+		// Frames have to be in presentation order for the lookup, this also skips frames presented twice.
+		return;
+	}
+
+	CachedFrame frame;
+	frame.time = p_time;
+	frame.format = p_frame->get_format();
+	int64_t frame_memory = 0;
+
+	if (mode == MODE_VRAM) {
+		ERR_FAIL_COND(converter.is_null());
+		frame.texture_size = converter->get_frame_size();
+		frame_memory = (int64_t)frame.texture_size.x * frame.texture_size.y * 4;
+		if (_can_add_frame(frame_memory)) {
+			frame.texture = converter->create_output_snapshot();
+		}
+	} else if (frame.format == FFmpegFrameFormat::RGBA8) {
+		frame.planes[0] = _cache_plane(p_frame->get_image());
+	} else {
+		for (int i = 0; i < 4; i++) {
+			frame.planes[i] = _cache_plane(p_frame->get_yuv_image_plane(i));
+		}
+	}
+
+	if (mode != MODE_VRAM) {
+		for (int i = 0; i < 4; i++) {
+			frame_memory += mode == MODE_RAM_COMPRESSED ? frame.planes[i].compressed_data.size() : frame.planes[i].data_size;
+		}
+	}
+
+	_add_frame(frame, frame_memory);
+}
+
+void FFmpegLoopCache::finish(double p_duration) {
+	if (failed || frames.is_empty()) {
+		return;
+	}
+	duration = MAX(p_duration, frames[frames.size() - 1].time);
+	complete = duration > 0.0;
+}
+
+void FFmpegLoopCache::clear() {
+	if (converter.is_valid()) {
+		for (const CachedFrame &frame : frames) {
+			if (frame.texture.is_valid()) {
+				converter->free_snapshot(frame.texture);
+			}
+		}
+	}
+	frames.clear();
+	total_memory_usage -= memory_usage;
+	memory_usage = 0;
+	memory_account.set(0);
+	duration = 0.0;
+	complete = false;
+}
+
+int FFmpegLoopCache::get_frame_index(double p_time) const {
+	ERR_FAIL_COND_V(frames.is_empty() || duration <= 0.0, -1);
+	const double time = Math::fposmod(p_time, duration);
+	// Last frame starting at or before the given time.
+	int low = 0;
+	int high = frames.size() - 1;
+	while (low < high) {
+		const int mid = (low + high + 1) / 2;
+		if (frames[mid].time <= time) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return low;
+}
+
+Ref<DecodedFrame> FFmpegLoopCache::get_frame(int p_index) const {
+	ERR_FAIL_INDEX_V(p_index, frames.size(), Ref<DecodedFrame>());
+	const CachedFrame &frame = frames[p_index];
+	if (frame.format == FFmpegFrameFormat::RGBA8) {
+		return memnew(DecodedFrame(frame.time, _restore_plane(frame.planes[0])));
+	}
+	Ref<DecodedFrame> decoded_frame = memnew(DecodedFrame(frame.time, Ref<Image>()));
+	for (int i = 0; i < 4; i++) {
+		decoded_frame->set_yuv_image_plane(i, _restore_plane(frame.planes[i]));
+	}
+	decoded_frame->set_format(frame.format);
+	return decoded_frame;
+}
+
+void FFmpegLoopCache::present_texture(int p_index) {
+	ERR_FAIL_INDEX(p_index, frames.size());
+	ERR_FAIL_COND(converter.is_null());
+	const CachedFrame &frame = frames[p_index];
+	ERR_FAIL_COND(!frame.texture.is_valid());
+	converter->present_snapshot(frame.texture, frame.texture_size);
+}
+
+FFmpegLoopCache::FFmpegLoopCache(Mode p_mode, int64_t p_memory_limit, Ref<YUVGPUConverter> p_converter) {
+	mode = p_mode;
+	memory_limit = p_memory_limit;
+	converter = p_converter;
+	if (mode == MODE_VRAM && converter.is_null()) {
+		// No rendering device, keep the frames in RAM instead.
+		mode = MODE_RAM;
+	}
+}
+
+FFmpegLoopCache::~FFmpegLoopCache() {
+	clear();
+}
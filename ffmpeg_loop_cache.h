@@ -0,0 +1,130 @@
+/**************************************************************************/
+/*  ffmpeg_loop_cache.h                                                   */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_LOOP_CACHE_H
+#define FFMPEG_LOOP_CACHE_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/classes/image.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/io/image.h"
+#include "core/object/ref_counted.h"
+#include "core/templates/vector.h"
+
+#endif
+
+#include "video_decoder.h"
+
+class YUVGPUConverter;
+
+// Every frame of one pass through a short clip, recorded while it plays the first time so later loops don't decode anything.
+class FFmpegLoopCache : public RefCounted {
+public:
+	enum Mode {
+		MODE_DISABLED,
+		// Decoded planes kept as images, converted again on every loop.
+		MODE_RAM,
+		// Same as MODE_RAM but every plane is zstd compressed, trades a bit of CPU for a lot less memory.
+		MODE_RAM_COMPRESSED,
+		// Converted output textures, presenting a frame is a GPU copy. Needs a rendering device.
+		MODE_VRAM,
+	};
+
+private:
+	struct CachedPlane {
+		Ref<Image> image;
+		PackedByteArray compressed_data;
+		Vector2i size;
+		int format = 0;
+		int data_size = 0;
+	};
+
+	struct CachedFrame {
+		double time = 0.0;
+		FFmpegFrameFormat format = FFmpegFrameFormat::RGBA8;
+		CachedPlane planes[4];
+		RID texture;
+		Vector2i texture_size;
+	};
+
+	Mode mode = MODE_DISABLED;
+	// ffmpeg/loop_cache/max_memory, a limit on all loop caches together.
+	int64_t memory_limit = 0;
+	int64_t memory_usage = 0;
+	// Of every loop cache, only touched from the main thread.
+	static int64_t total_memory_usage;
+	FFmpegMemoryAccount memory_account{ FFmpegMemoryBudget::CATEGORY_CACHES };
+	Vector<CachedFrame> frames;
+	double duration = 0.0;
+	bool complete = false;
+	bool failed = false;
+	Ref<YUVGPUConverter> converter;
+
+	CachedPlane _cache_plane(const Ref<Image> &p_image);
+	Ref<Image> _restore_plane(const CachedPlane &p_plane) const;
+	bool _can_add_frame(int64_t p_frame_memory) const;
+	bool _add_frame(const CachedFrame &p_frame, int64_t p_frame_memory);
+
+public:
+	Mode get_mode() const { return mode; }
+	bool is_complete() const { return complete; }
+	bool has_failed() const { return failed; }
+	int64_t get_memory_usage() const { return memory_usage; }
+	double get_duration() const { return duration; }
+	int get_frame_count() const { return frames.size(); }
+
+	// RAM modes record the decoded frames, VRAM mode snapshots the converter output after p_frame was presented.
+	// Once all loop caches together would exceed the memory limit everything recorded so far is dropped and the cache stays failed.
+	// p_time is the frame's time within the recorded pass.
+	void record_frame(const Ref<DecodedFrame> &p_frame, double p_time);
+	void finish(double p_duration);
+	void clear();
+
+	// Index of the frame that should be visible at p_time, which is wrapped to the cached duration.
+	int get_frame_index(double p_time) const;
+	// RAM modes, rebuilds the frame so it can go through the regular presentation path.
+	Ref<DecodedFrame> get_frame(int p_index) const;
+	// VRAM mode, copies the cached texture to the converter output.
+	void present_texture(int p_index);
+
+	FFmpegLoopCache(Mode p_mode, int64_t p_memory_limit, Ref<YUVGPUConverter> p_converter);
+	~FFmpegLoopCache();
+};
+
+#endif // FFMPEG_LOOP_CACHE_H
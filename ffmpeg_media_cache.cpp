@@ -0,0 +1,145 @@
+/**************************************************************************/
+/*  ffmpeg_media_cache.cpp                                                */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_media_cache.h"
+
+#include "ffmpeg_memory_budget.h"
+#include "ffmpeg_settings.h"
+
+Mutex *FFmpegMediaCache::mutex = nullptr;
+FFmpegMediaCache::EntryMap *FFmpegMediaCache::entries = nullptr;
+int64_t FFmpegMediaCache::total_size = 0;
+int64_t FFmpegMediaCache::accounted_size = 0;
+uint64_t FFmpegMediaCache::use_counter = 0;
+
+void FFmpegMediaCache::_evict(int64_t p_max_total_size) {
+	while (total_size > p_max_total_size && entries->size() > 0) {
+		const String *oldest = nullptr;
+		uint64_t oldest_use = UINT64_MAX;
+		for (const KeyValue<String, Entry> &E : *entries) {
+			if (E.value.last_used < oldest_use) {
+				oldest_use = E.value.last_used;
+				oldest = &E.key;
+			}
+		}
+		total_size -= entries->get(*oldest).data.size();
+		entries->erase(*oldest);
+	}
+}
+
+void FFmpegMediaCache::_update_accounting() {
+	FFmpegMemoryBudget::add(FFmpegMemoryBudget::CATEGORY_CACHES, total_size - accounted_size);
+	accounted_size = total_size;
+}
+
+PackedByteArray FFmpegMediaCache::get_file_data(Ref<FileAccess> p_file_access) {
+	ERR_FAIL_COND_V(p_file_access.is_null(), PackedByteArray());
+	if (mutex == nullptr) {
+		return PackedByteArray();
+	}
+	const int64_t max_file_size = (int64_t)FFmpegSettings::get_setting("ffmpeg/io/memory_cache/max_file_size");
+	const int64_t max_total_size = (int64_t)FFmpegSettings::get_setting("ffmpeg/io/memory_cache/max_total_size");
+	const int64_t length = p_file_access->get_length();
+	if (length <= 0 || length > max_file_size || length > max_total_size) {
+		return PackedByteArray();
+	}
+
+	const String path = p_file_access->get_path();
+	const uint64_t modified_time = FileAccess::get_modified_time(path);
+
+	{
+		MutexLock lock(*mutex);
+		Entry *entry = entries != nullptr ? entries->getptr(path) : nullptr;
+		// Files changed on disk (e.g. reimported in the editor) are loaded again.
+		if (entry != nullptr && entry->modified_time == modified_time) {
+			entry->last_used = ++use_counter;
+			return entry->data;
+		}
+	}
+	if (FFmpegMemoryBudget::is_over_budget(length)) {
+		return PackedByteArray();
+	}
+
+	// Read without holding the lock, if two playbacks race for the same file the last one wins, which is harmless.
+	p_file_access->seek(0);
+	PackedByteArray data = p_file_access->get_buffer(length);
+	ERR_FAIL_COND_V_MSG(data.size() != length, PackedByteArray(), vformat("Failed to read %s into the media cache.", path));
+
+	MutexLock lock(*mutex);
+	if (entries == nullptr) {
+		entries = memnew(EntryMap);
+	}
+	Entry *entry = entries->getptr(path);
+	if (entry != nullptr) {
+		total_size -= entry->data.size();
+	}
+	Entry new_entry;
+	new_entry.data = data;
+	new_entry.modified_time = modified_time;
+	new_entry.last_used = ++use_counter;
+	entries->insert(path, new_entry);
+	total_size += length;
+	_evict(max_total_size);
+	_update_accounting();
+	return data;
+}
+
+void FFmpegMediaCache::trim(int64_t p_bytes) {
+	if (mutex == nullptr) {
+		return;
+	}
+	MutexLock lock(*mutex);
+	if (entries == nullptr || p_bytes <= 0) {
+		return;
+	}
+	_evict(MAX(total_size - p_bytes, (int64_t)0));
+	_update_accounting();
+}
+
+void FFmpegMediaCache::initialize() {
+	mutex = memnew(Mutex);
+}
+
+void FFmpegMediaCache::clear() {
+	if (mutex == nullptr) {
+		return;
+	}
+	{
+		MutexLock lock(*mutex);
+		if (entries != nullptr) {
+			memdelete(entries);
+			entries = nullptr;
+		}
+		total_size = 0;
+		_update_accounting();
+	}
+	memdelete(mutex);
+	mutex = nullptr;
+}
@@ -0,0 +1,86 @@
+/**************************************************************************/
+/*  ffmpeg_media_cache.h                                                  */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_MEDIA_CACHE_H
+#define FFMPEG_MEDIA_CACHE_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/io/file_access.h"
+#include "core/os/mutex.h"
+#include "core/templates/hash_map.h"
+
+#endif
+
+// Keeps small media files in memory so playbacks of the same clip don't go back to the filesystem.
+// Least recently used files are evicted once the total size goes over the limit.
+class FFmpegMediaCache {
+	struct Entry {
+		PackedByteArray data;
+		uint64_t modified_time = 0;
+		uint64_t last_used = 0;
+	};
+
+	typedef HashMap<String, Entry> EntryMap;
+
+	// Created in initialize(), engine objects can't be constructed before the engine is up.
+	static Mutex *mutex;
+	// Allocated on first use and freed in clear(), so nothing is left to destroy after the engine shut down.
+	static EntryMap *entries;
+	static int64_t total_size;
+	// What total_size was last reported to FFmpegMemoryBudget as.
+	static int64_t accounted_size;
+	static uint64_t use_counter;
+
+	static void _evict(int64_t p_max_total_size);
+	static void _update_accounting();
+
+public:
+	// Returns the whole contents of the file, or an empty array if it doesn't qualify for caching.
+	static PackedByteArray get_file_data(Ref<FileAccess> p_file_access);
+	// Evicts least recently used files until at least p_bytes were freed or the cache is empty.
+	static void trim(int64_t p_bytes);
+	static void initialize();
+	// Frees everything, calls made afterwards (playbacks outliving the module) do nothing.
+	static void clear();
+};
+
+#endif // FFMPEG_MEDIA_CACHE_H
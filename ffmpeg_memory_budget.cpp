@@ -0,0 +1,118 @@
+/**************************************************************************/
+/*  ffmpeg_memory_budget.cpp                                              */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_memory_budget.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/engine.hpp>
+#else
+#include "core/config/engine.h"
+#endif
+
+#include "ffmpeg_decoder_pool.h"
+#include "ffmpeg_media_cache.h"
+#include "tracy_import.h"
+
+static const char *const CATEGORY_NAMES[FFmpegMemoryBudget::CATEGORY_MAX] = {
+	"decoded_frames",
+	"scaler_frames",
+	"gpu_textures",
+	"audio",
+	"packets",
+	"codec",
+	"io",
+	"caches",
+};
+
+SafeNumeric<int64_t> FFmpegMemoryBudget::usage[CATEGORY_MAX];
+SafeNumeric<int64_t> FFmpegMemoryBudget::budget;
+uint64_t FFmpegMemoryBudget::last_enforce_frame = UINT64_MAX;
+
+void FFmpegMemoryBudget::add(Category p_category, int64_t p_bytes) {
+	ERR_FAIL_INDEX(p_category, CATEGORY_MAX);
+	if (p_bytes != 0) {
+		usage[p_category].add(p_bytes);
+	}
+}
+
+int64_t FFmpegMemoryBudget::get_usage() {
+	int64_t total = 0;
+	for (int i = 0; i < CATEGORY_MAX; i++) {
+		total += usage[i].get();
+	}
+	return total;
+}
+
+int64_t FFmpegMemoryBudget::get_usage(Category p_category) {
+	ERR_FAIL_INDEX_V(p_category, CATEGORY_MAX, 0);
+	return usage[p_category].get();
+}
+
+void FFmpegMemoryBudget::set_budget(int64_t p_budget) {
+	budget.set(MAX(p_budget, (int64_t)0));
+}
+
+int64_t FFmpegMemoryBudget::get_budget() {
+	return budget.get();
+}
+
+bool FFmpegMemoryBudget::is_over_budget(int64_t p_extra_bytes) {
+	const int64_t limit = get_budget();
+	return limit > 0 && get_usage() + p_extra_bytes > limit;
+}
+
+void FFmpegMemoryBudget::enforce() {
+	// Every playback calls this from its update, the pool and cache only need trimming once per frame.
+	const uint64_t frame = Engine::get_singleton()->get_process_frames();
+	if (frame == last_enforce_frame) {
+		return;
+	}
+	last_enforce_frame = frame;
+
+	TracyPlot("FFmpeg accounted memory", get_usage());
+	if (!is_over_budget()) {
+		return;
+	}
+	// Idle resources go first, nothing visible depends on them.
+	FFmpegDecoderPool::trim(get_usage() - get_budget());
+	if (is_over_budget()) {
+		FFmpegMediaCache::trim(get_usage() - get_budget());
+	}
+}
+
+Dictionary FFmpegMemoryBudget::get_usage_dictionary() {
+	Dictionary result;
+	result["budget"] = get_budget();
+	result["total"] = get_usage();
+	for (int i = 0; i < CATEGORY_MAX; i++) {
+		result[CATEGORY_NAMES[i]] = usage[i].get();
+	}
+	return result;
+}
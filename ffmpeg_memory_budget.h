@@ -0,0 +1,107 @@
+/**************************************************************************/
+/*  ffmpeg_memory_budget.h                                                */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_MEMORY_BUDGET_H
+#define FFMPEG_MEMORY_BUDGET_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/templates/safe_refcount.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/templates/safe_refcount.h"
+#include "core/variant/dictionary.h"
+
+#endif
+
+// Bytes held by all decoders, playbacks and caches, checked against the ffmpeg/memory/budget project setting.
+// While over budget decoders queue fewer frames ahead, caches stop growing or are trimmed and prewarming is refused.
+// Codec internals can't be measured, they are estimated from the frame size and thread count when the codec is opened.
+class FFmpegMemoryBudget {
+public:
+	enum Category {
+		CATEGORY_DECODED_FRAMES,
+		CATEGORY_SCALER_FRAMES,
+		CATEGORY_GPU_TEXTURES,
+		CATEGORY_AUDIO,
+		CATEGORY_PACKETS,
+		CATEGORY_CODEC,
+		CATEGORY_IO,
+		CATEGORY_CACHES,
+		CATEGORY_MAX,
+	};
+
+private:
+	static SafeNumeric<int64_t> usage[CATEGORY_MAX];
+	// 0 means unlimited.
+	static SafeNumeric<int64_t> budget;
+	// Only touched by enforce() on the main thread.
+	static uint64_t last_enforce_frame;
+
+public:
+	// Negative to release.
+	static void add(Category p_category, int64_t p_bytes);
+	static int64_t get_usage();
+	static int64_t get_usage(Category p_category);
+	static void set_budget(int64_t p_budget);
+	static int64_t get_budget();
+	// Whether usage is, or would be after allocating p_extra_bytes more, over the budget.
+	static bool is_over_budget(int64_t p_extra_bytes = 0);
+	// Drops idle decoders from the decoder pool and files from the memory cache until usage fits again, at most once per process frame. Called from the main thread.
+	static void enforce();
+	// "budget", "total" and the usage of each category, in bytes.
+	static Dictionary get_usage_dictionary();
+};
+
+// Bytes one owner holds in one category, only the owner updates it but anyone may read it.
+class FFmpegMemoryAccount {
+	FFmpegMemoryBudget::Category category;
+	SafeNumeric<int64_t> bytes;
+
+public:
+	void set(int64_t p_bytes) {
+		FFmpegMemoryBudget::add(category, p_bytes - bytes.get());
+		bytes.set(p_bytes);
+	}
+	int64_t get() const { return bytes.get(); }
+
+	FFmpegMemoryAccount(FFmpegMemoryBudget::Category p_category) { category = p_category; }
+	FFmpegMemoryAccount(const FFmpegMemoryAccount &) = delete;
+	FFmpegMemoryAccount &operator=(const FFmpegMemoryAccount &) = delete;
+	~FFmpegMemoryAccount() { set(0); }
+};
+
+#endif // FFMPEG_MEMORY_BUDGET_H
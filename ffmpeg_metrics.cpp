@@ -0,0 +1,254 @@
+/**************************************************************************/
+/*  ffmpeg_metrics.cpp                                                    */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_metrics.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/engine.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/performance.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#else
+#include "core/config/engine.h"
+#include "core/os/os.h"
+#include "main/performance.h"
+#endif
+
+#include "ffmpeg_memory_budget.h"
+#include "ffmpeg_video_stream.h"
+
+static const char *const MONITOR_NAMES[] = {
+	"playbacks",
+	"decode_ms",
+	"conversion_ms",
+	"upload_ms",
+	"queue_depth",
+	"dropped_frames",
+	"late_frames",
+	"seeks",
+	"seek_latency_ms",
+	"buffering_ms",
+	"bytes_read",
+	"memory",
+	"memory_accounted",
+};
+
+static const char *const AVERAGE_MONITOR_NAMES[] = {
+	"decode_ms",
+	"conversion_ms",
+	"upload_ms",
+	"seek_latency_ms",
+};
+
+void FFmpegPlaybackMetrics::add(const FFmpegPlaybackMetrics &p_metrics) {
+	decode_time_usec += p_metrics.decode_time_usec;
+	conversion_time_usec += p_metrics.conversion_time_usec;
+	decoded_frames += p_metrics.decoded_frames;
+	upload_time_usec += p_metrics.upload_time_usec;
+	presented_frames += p_metrics.presented_frames;
+	queued_frames += p_metrics.queued_frames;
+	dropped_frames += p_metrics.dropped_frames;
+	late_frames += p_metrics.late_frames;
+	seeks += p_metrics.seeks;
+	completed_seeks += p_metrics.completed_seeks;
+	seek_latency_usec += p_metrics.seek_latency_usec;
+	buffering_time_usec += p_metrics.buffering_time_usec;
+	bytes_read += p_metrics.bytes_read;
+	memory_usage += p_metrics.memory_usage;
+}
+
+FFmpegPlaybackMetrics FFmpegPlaybackMetrics::since(const FFmpegPlaybackMetrics &p_start) const {
+	FFmpegPlaybackMetrics difference = *this;
+	difference.decode_time_usec -= p_start.decode_time_usec;
+	difference.conversion_time_usec -= p_start.conversion_time_usec;
+	difference.decoded_frames -= p_start.decoded_frames;
+	difference.upload_time_usec -= p_start.upload_time_usec;
+	difference.presented_frames -= p_start.presented_frames;
+	difference.dropped_frames -= p_start.dropped_frames;
+	difference.late_frames -= p_start.late_frames;
+	difference.seeks -= p_start.seeks;
+	difference.completed_seeks -= p_start.completed_seeks;
+	difference.seek_latency_usec -= p_start.seek_latency_usec;
+	difference.buffering_time_usec -= p_start.buffering_time_usec;
+	difference.bytes_read -= p_start.bytes_read;
+	return difference;
+}
+
+Dictionary FFmpegPlaybackMetrics::to_dictionary() const {
+	Dictionary metrics;
+	metrics["decode_ms"] = decoded_frames > 0 ? decode_time_usec / 1000.0 / decoded_frames : 0.0;
+	metrics["conversion_ms"] = decoded_frames > 0 ? conversion_time_usec / 1000.0 / decoded_frames : 0.0;
+	metrics["upload_ms"] = presented_frames > 0 ? upload_time_usec / 1000.0 / presented_frames : 0.0;
+	metrics["decoded_frames"] = (int64_t)decoded_frames;
+	metrics["presented_frames"] = (int64_t)presented_frames;
+	metrics["queue_depth"] = queued_frames;
+	metrics["dropped_frames"] = (int64_t)dropped_frames;
+	metrics["late_frames"] = (int64_t)late_frames;
+	metrics["seeks"] = (int64_t)seeks;
+	metrics["seek_latency_ms"] = completed_seeks > 0 ? seek_latency_usec / 1000.0 / completed_seeks : 0.0;
+	metrics["buffering_ms"] = buffering_time_usec / 1000.0;
+	metrics["bytes_read"] = (int64_t)bytes_read;
+	metrics["memory"] = memory_usage;
+	return metrics;
+}
+
+FFmpegMetrics *FFmpegMetrics::singleton = nullptr;
+
+FFmpegMetrics *FFmpegMetrics::get_singleton() {
+	return singleton;
+}
+
+void FFmpegMetrics::register_monitors() {
+	Performance *performance = Performance::get_singleton();
+	if (monitors_registered || performance == nullptr) {
+		return;
+	}
+	for (const char *name : MONITOR_NAMES) {
+		Array arguments;
+		arguments.push_back(String(name));
+		performance->add_custom_monitor(StringName(String("FFmpeg/") + name), callable_mp(this, &FFmpegMetrics::_get_monitor_value), arguments);
+	}
+	monitors_registered = true;
+}
+
+void FFmpegMetrics::unregister_monitors() {
+	Performance *performance = Performance::get_singleton();
+	if (!monitors_registered || performance == nullptr) {
+		return;
+	}
+	for (const char *name : MONITOR_NAMES) {
+		const StringName id = String("FFmpeg/") + name;
+		if (performance->has_custom_monitor(id)) {
+			performance->remove_custom_monitor(id);
+		}
+	}
+	monitors_registered = false;
+}
+
+void FFmpegMetrics::add_playback(FFmpegVideoStreamPlayback *p_playback) {
+	MutexLock lock(mutex);
+	playbacks.push_back(p_playback);
+}
+
+void FFmpegMetrics::remove_playback(FFmpegVideoStreamPlayback *p_playback) {
+	FFmpegPlaybackMetrics metrics;
+	const bool has_metrics = p_playback->collect_metrics(metrics);
+	MutexLock lock(mutex);
+	playbacks.erase(p_playback);
+	if (has_metrics) {
+		retired_metrics.add(metrics);
+	}
+}
+
+void FFmpegMetrics::_update_snapshot() {
+	const uint64_t frame = Engine::get_singleton()->get_process_frames();
+	if (frame == snapshot_frame) {
+		return;
+	}
+	snapshot_frame = frame;
+
+	FFmpegPlaybackMetrics totals;
+	FFmpegPlaybackMetrics all_time_totals;
+	int playback_count = 0;
+	{
+		MutexLock lock(mutex);
+		for (FFmpegVideoStreamPlayback *playback : playbacks) {
+			FFmpegPlaybackMetrics metrics;
+			// Shared decode followers report their leader's numbers, they are only counted once through the leader.
+			if (playback->collect_metrics(metrics)) {
+				totals.add(metrics);
+				playback_count++;
+			}
+		}
+		all_time_totals = totals;
+		all_time_totals.add(retired_metrics);
+	}
+	snapshot = totals.to_dictionary();
+	snapshot["playbacks"] = playback_count;
+	snapshot["memory_accounted"] = FFmpegMemoryBudget::get_usage();
+	snapshot["memory_budget"] = FFmpegMemoryBudget::get_budget();
+
+	// Gauges and counters follow every frame, averages only change once an interval is complete.
+	Dictionary averages = monitor_values;
+	const uint64_t now_usec = OS::get_singleton()->get_ticks_usec();
+	if (interval_start_usec == 0 || now_usec - interval_start_usec >= MONITOR_INTERVAL_USEC) {
+		averages = all_time_totals.since(interval_start).to_dictionary();
+		interval_start = all_time_totals;
+		interval_start_usec = now_usec;
+	}
+	monitor_values = snapshot.duplicate();
+	for (const char *name : AVERAGE_MONITOR_NAMES) {
+		monitor_values[name] = averages.get(name, 0.0);
+	}
+}
+
+Variant FFmpegMetrics::_get_monitor_value(const String &p_name) {
+	_update_snapshot();
+	return monitor_values.get(p_name, Variant());
+}
+
+Dictionary FFmpegMetrics::get_metrics() {
+	_update_snapshot();
+	return snapshot.duplicate();
+}
+
+Variant FFmpegMetrics::get_metric(const String &p_name) {
+	_update_snapshot();
+	return snapshot.get(p_name, Variant());
+}
+
+Dictionary FFmpegMetrics::get_memory_usage() {
+	return FFmpegMemoryBudget::get_usage_dictionary();
+}
+
+void FFmpegMetrics::set_memory_budget(int64_t p_budget) {
+	FFmpegMemoryBudget::set_budget(p_budget);
+}
+
+int64_t FFmpegMetrics::get_memory_budget() const {
+	return FFmpegMemoryBudget::get_budget();
+}
+
+void FFmpegMetrics::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("get_metrics"), &FFmpegMetrics::get_metrics);
+	ClassDB::bind_method(D_METHOD("get_metric", "name"), &FFmpegMetrics::get_metric);
+	ClassDB::bind_method(D_METHOD("get_memory_usage"), &FFmpegMetrics::get_memory_usage);
+	ClassDB::bind_method(D_METHOD("set_memory_budget", "budget"), &FFmpegMetrics::set_memory_budget);
+	ClassDB::bind_method(D_METHOD("get_memory_budget"), &FFmpegMetrics::get_memory_budget);
+}
+
+FFmpegMetrics::FFmpegMetrics() {
+	singleton = this;
+}
+
+FFmpegMetrics::~FFmpegMetrics() {
+	unregister_monitors();
+	singleton = nullptr;
+}
@@ -0,0 +1,131 @@
+/**************************************************************************/
+/*  ffmpeg_metrics.h                                                      */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_METRICS_H
+#define FFMPEG_METRICS_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/classes/object.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/templates/vector.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/object/object.h"
+#include "core/os/mutex.h"
+#include "core/templates/vector.h"
+#include "core/variant/dictionary.h"
+
+#endif
+
+class FFmpegVideoStreamPlayback;
+
+// Raw counters of one playback, totals are sums of these. Times are cumulative, averages are only worked out for reporting.
+struct FFmpegPlaybackMetrics {
+	uint64_t decode_time_usec = 0;
+	uint64_t conversion_time_usec = 0;
+	uint64_t decoded_frames = 0;
+	uint64_t upload_time_usec = 0;
+	uint64_t presented_frames = 0;
+	int64_t queued_frames = 0;
+	uint64_t dropped_frames = 0;
+	uint64_t late_frames = 0;
+	uint64_t seeks = 0;
+	uint64_t completed_seeks = 0;
+	uint64_t seek_latency_usec = 0;
+	uint64_t buffering_time_usec = 0;
+	uint64_t bytes_read = 0;
+	int64_t memory_usage = 0;
+
+	void add(const FFmpegPlaybackMetrics &p_metrics);
+	// What the cumulative counters grew by since p_start, gauges (queue depth and memory) are kept as they are.
+	FFmpegPlaybackMetrics since(const FFmpegPlaybackMetrics &p_start) const;
+	// Per frame and per seek averages in milliseconds, everything else as is.
+	Dictionary to_dictionary() const;
+};
+
+// Totals over every live playback, also registered as "FFmpeg/..." Performance monitors.
+// The monitors report averages over the last second instead of since startup, so they follow changes.
+class FFmpegMetrics : public Object {
+	GDCLASS(FFmpegMetrics, Object);
+
+	const uint64_t MONITOR_INTERVAL_USEC = 1000000;
+
+	static FFmpegMetrics *singleton;
+
+	Mutex mutex;
+	Vector<FFmpegVideoStreamPlayback *> playbacks;
+	// Counters of playbacks that are gone, keeps the sum over all playbacks from going backwards.
+	FFmpegPlaybackMetrics retired_metrics;
+	bool monitors_registered = false;
+
+	// Worked out at most once per frame, every monitor reads from it.
+	uint64_t snapshot_frame = UINT64_MAX;
+	Dictionary snapshot;
+	Dictionary monitor_values;
+	FFmpegPlaybackMetrics interval_start;
+	uint64_t interval_start_usec = 0;
+
+	void _update_snapshot();
+	Variant _get_monitor_value(const String &p_name);
+
+protected:
+	static void _bind_methods();
+
+public:
+	static FFmpegMetrics *get_singleton();
+
+	void add_playback(FFmpegVideoStreamPlayback *p_playback);
+	void remove_playback(FFmpegVideoStreamPlayback *p_playback);
+	// Performance is only set up after the extension, this is deferred to the first frame.
+	void register_monitors();
+	void unregister_monitors();
+
+	Dictionary get_metrics();
+	Variant get_metric(const String &p_name);
+
+	// Accounted bytes per category plus "total" and "budget", covers pooled decoders and caches that aren't part of any playback.
+	Dictionary get_memory_usage();
+	// Overrides ffmpeg/memory/budget at runtime, 0 is unlimited.
+	void set_memory_budget(int64_t p_budget);
+	int64_t get_memory_budget() const;
+
+	FFmpegMetrics();
+	~FFmpegMetrics();
+};
+
+#endif // FFMPEG_METRICS_H
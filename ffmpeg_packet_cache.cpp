@@ -0,0 +1,153 @@
+/**************************************************************************/
+/*  ffmpeg_packet_cache.cpp                                               */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_packet_cache.h"
+
+#include "tracy_import.h"
+
+// Tracy identifies memory pools by the name's pointer.
+static const char *const TRACY_PACKET_CACHE_POOL = "FFmpeg packet cache";
+
+int64_t FFmpegPacketCache::_get_packet_memory(const AVPacket *p_packet) {
+	return p_packet->size + (int64_t)sizeof(AVPacket);
+}
+
+void FFmpegPacketCache::_evict_first_gop() {
+	// Whole GOPs are evicted so the cached stretch always starts at a keyframe.
+	int cut = 1;
+	while (cut < packets.size() && !(packets[cut]->stream_index == video_stream_index && (packets[cut]->flags & AV_PKT_FLAG_KEY))) {
+		cut++;
+	}
+	for (int i = 0; i < cut; i++) {
+		memory_usage -= _get_packet_memory(packets[i]);
+		TracyFreeN(packets[i], TRACY_PACKET_CACHE_POOL);
+		av_packet_free(&packets.write[i]);
+	}
+	packets = packets.slice(cut);
+	has_file_start = false;
+	memory_account.set(memory_usage);
+}
+
+void FFmpegPacketCache::reset(int p_video_stream_index, bool p_at_file_start) {
+	for (int i = 0; i < packets.size(); i++) {
+		TracyFreeN(packets[i], TRACY_PACKET_CACHE_POOL);
+		av_packet_free(&packets.write[i]);
+	}
+	packets.clear();
+	memory_usage = 0;
+	memory_account.set(0);
+	replay_index = -1;
+	video_stream_index = p_video_stream_index;
+	has_file_start = p_at_file_start;
+}
+
+void FFmpegPacketCache::push(const AVPacket *p_packet) {
+	if (!is_enabled()) {
+		return;
+	}
+	const int64_t packet_memory = _get_packet_memory(p_packet);
+	if (packet_memory > memory_limit) {
+		reset(video_stream_index, false);
+		return;
+	}
+	while (packets.size() > 0 && (memory_usage + packet_memory > memory_limit || FFmpegMemoryBudget::is_over_budget(packet_memory))) {
+		_evict_first_gop();
+	}
+	if (FFmpegMemoryBudget::is_over_budget(packet_memory)) {
+		// Nothing left to give back, stop caching until there is room again.
+		reset(video_stream_index, false);
+		return;
+	}
+	AVPacket *packet = av_packet_clone(p_packet);
+	if (packet == nullptr) {
+		// Can't keep the stretch contiguous anymore.
+		reset(video_stream_index, false);
+		return;
+	}
+	TracyAllocN(packet, packet_memory, TRACY_PACKET_CACHE_POOL);
+	packets.push_back(packet);
+	memory_usage += packet_memory;
+	memory_account.set(memory_usage);
+}
+
+bool FFmpegPacketCache::start_replay(int64_t p_video_timestamp) {
+	replay_index = -1;
+	int keyframe_index = -1;
+	int64_t last_video_timestamp = AV_NOPTS_VALUE;
+	for (int i = 0; i < packets.size(); i++) {
+		const AVPacket *packet = packets[i];
+		if (packet->stream_index != video_stream_index) {
+			continue;
+		}
+		const int64_t timestamp = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+		if (timestamp == AV_NOPTS_VALUE) {
+			continue;
+		}
+		if ((packet->flags & AV_PKT_FLAG_KEY) && timestamp <= p_video_timestamp) {
+			keyframe_index = i;
+		}
+		last_video_timestamp = MAX(last_video_timestamp, timestamp);
+	}
+	// Targets past the last cached packet are left to the demuxer, decoding up to them from here could take a while.
+	if (keyframe_index < 0 || last_video_timestamp == AV_NOPTS_VALUE || p_video_timestamp > last_video_timestamp) {
+		return false;
+	}
+	// Audio interleaved right before the keyframe may cover the target time too.
+	while (keyframe_index > 0 && packets[keyframe_index - 1]->stream_index != video_stream_index) {
+		keyframe_index--;
+	}
+	replay_index = keyframe_index;
+	return true;
+}
+
+bool FFmpegPacketCache::start_replay_from_file_start() {
+	replay_index = has_file_start && packets.size() > 0 ? 0 : -1;
+	return replay_index >= 0;
+}
+
+bool FFmpegPacketCache::read(AVPacket *r_packet) {
+	if (replay_index < 0 || replay_index >= packets.size()) {
+		replay_index = -1;
+		return false;
+	}
+	if (av_packet_ref(r_packet, packets[replay_index]) < 0) {
+		replay_index = -1;
+		return false;
+	}
+	replay_index++;
+	if (replay_index >= packets.size()) {
+		replay_index = -1;
+	}
+	return true;
+}
+
+FFmpegPacketCache::~FFmpegPacketCache() {
+	reset(-1, false);
+}
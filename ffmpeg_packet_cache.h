@@ -0,0 +1,89 @@
+/**************************************************************************/
+/*  ffmpeg_packet_cache.h                                                 */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_PACKET_CACHE_H
+#define FFMPEG_PACKET_CACHE_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/templates/vector.h"
+
+#endif
+
+#include "ffmpeg_memory_budget.h"
+
+extern "C" {
+#include "libavcodec/packet.h"
+}
+
+// Compressed packets of the most recently demuxed stretch of the file, in demuxing order. Seeks that land inside it are
+// served from memory without touching the demuxer, which stays positioned right after the last cached packet.
+// Only used from the decoder thread, except for get_memory_usage.
+class FFmpegPacketCache {
+	Vector<AVPacket *> packets;
+	int64_t memory_limit = 0;
+	int64_t memory_usage = 0;
+	FFmpegMemoryAccount memory_account{ FFmpegMemoryBudget::CATEGORY_PACKETS };
+	int video_stream_index = -1;
+	// Nothing was evicted since demuxing started at the beginning of the file.
+	bool has_file_start = false;
+	int replay_index = -1;
+
+	static int64_t _get_packet_memory(const AVPacket *p_packet);
+	void _evict_first_gop();
+
+public:
+	void set_memory_limit(int64_t p_memory_limit) { memory_limit = p_memory_limit; }
+	bool is_enabled() const { return memory_limit > 0; }
+	int64_t get_memory_usage() const { return memory_account.get(); }
+
+	// Starts a new stretch, called whenever the demuxer was moved.
+	void reset(int p_video_stream_index, bool p_at_file_start);
+	void push(const AVPacket *p_packet);
+
+	// Positions the replay on the last video keyframe at or before p_video_timestamp, fails if it isn't cached.
+	bool start_replay(int64_t p_video_timestamp);
+	bool start_replay_from_file_start();
+	bool is_replaying() const { return replay_index >= 0; }
+	// Returns false once the replay caught up with the demuxer.
+	bool read(AVPacket *r_packet);
+
+	~FFmpegPacketCache();
+};
+
+#endif // FFMPEG_PACKET_CACHE_H
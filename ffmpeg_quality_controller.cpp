@@ -0,0 +1,99 @@
+/**************************************************************************/
+/*  ffmpeg_quality_controller.cpp                                         */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_quality_controller.h"
+
+void FFmpegQualityController::reset(VideoDecoder::DecodeProfile p_best_profile, VideoDecoder::DecodeProfile p_worst_profile) {
+	best_profile = p_best_profile;
+	worst_profile = MAX(p_best_profile, p_worst_profile);
+	profile = p_best_profile;
+	window_started = false;
+	settling = false;
+	headroom_windows = 0;
+	load = 0.0;
+}
+
+bool FFmpegQualityController::is_window_complete(uint64_t p_now_usec) const {
+	return !window_started || p_now_usec - window_start_usec >= WINDOW_USEC;
+}
+
+bool FFmpegQualityController::update(const Sample &p_sample, uint64_t p_now_usec) {
+	if (!window_started) {
+		window_start = p_sample;
+		window_start_usec = p_now_usec;
+		window_started = true;
+		return false;
+	}
+	if (p_sample.discontinuities != window_start.discontinuities) {
+		window_start = p_sample;
+		window_start_usec = p_now_usec;
+		return false;
+	}
+
+	const uint64_t frames = p_sample.decoded_frames - window_start.decoded_frames;
+	const uint64_t window_usec = p_now_usec - window_start_usec;
+	if (frames < MIN_WINDOW_FRAMES || window_usec == 0) {
+		return false;
+	}
+	const uint64_t busy_usec = p_sample.busy_usec - window_start.busy_usec;
+	const uint64_t dropped_frames = p_sample.dropped_frames - window_start.dropped_frames;
+	window_start = p_sample;
+	window_start_usec = p_now_usec;
+	load = busy_usec / (double)window_usec;
+
+	if (settling) {
+		settling = false;
+		return false;
+	}
+
+	const bool overloaded = load > STEP_DOWN_LOAD || (dropped_frames > MAX_DROPPED_FRAMES && load > STEP_UP_LOAD);
+	if (overloaded) {
+		headroom_windows = 0;
+		if (profile < worst_profile) {
+			profile = (VideoDecoder::DecodeProfile)(profile + 1);
+			settling = true;
+			return true;
+		}
+		return false;
+	}
+
+	if (load >= STEP_UP_LOAD || dropped_frames > 0) {
+		headroom_windows = 0;
+		return false;
+	}
+	headroom_windows++;
+	if (headroom_windows >= STEP_UP_WINDOWS && profile > best_profile) {
+		profile = (VideoDecoder::DecodeProfile)(profile - 1);
+		headroom_windows = 0;
+		settling = true;
+		return true;
+	}
+	return false;
+}
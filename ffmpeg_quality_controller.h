@@ -0,0 +1,85 @@
+/**************************************************************************/
+/*  ffmpeg_quality_controller.h                                           */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_QUALITY_CONTROLLER_H
+#define FFMPEG_QUALITY_CONTROLLER_H
+
+#include "video_decoder.h"
+
+// Steps a playback through cheaper decode profiles while decoding can't keep up with the frame rate, and back up once there is headroom.
+// Load is the share of wall-clock time the decoder thread spent sending packets, receiving and converting frames during a window.
+// Per-frame cost over the frame interval would overstate it on profiles that skip frames, their packets cost time but produce nothing.
+class FFmpegQualityController {
+public:
+	// Cumulative counters, windows are the difference between two samples.
+	struct Sample {
+		uint64_t busy_usec = 0;
+		uint64_t decoded_frames = 0;
+		uint64_t dropped_frames = 0;
+		// A window spanning a seek or loop is thrown away, the decoder re-reads and catches up around them.
+		uint64_t discontinuities = 0;
+	};
+
+private:
+	const uint64_t WINDOW_USEC = 1000000;
+	// Windows are extended until enough frames were decoded, paused playbacks don't produce a useful average.
+	const uint64_t MIN_WINDOW_FRAMES = 5;
+	const double STEP_DOWN_LOAD = 0.85;
+	const double STEP_UP_LOAD = 0.5;
+	// Main thread hitches drop frames too, they only count against decoding once it is at least moderately loaded.
+	const uint64_t MAX_DROPPED_FRAMES = 2;
+	// Consecutive windows with headroom before stepping back up.
+	const int STEP_UP_WINDOWS = 5;
+
+	VideoDecoder::DecodeProfile best_profile = VideoDecoder::DECODE_PROFILE_QUALITY;
+	VideoDecoder::DecodeProfile worst_profile = VideoDecoder::DECODE_PROFILE_FAST;
+	VideoDecoder::DecodeProfile profile = VideoDecoder::DECODE_PROFILE_QUALITY;
+	Sample window_start;
+	uint64_t window_start_usec = 0;
+	bool window_started = false;
+	// The window after a change is skipped, reopening the codec drops frames until the next keyframe.
+	bool settling = false;
+	int headroom_windows = 0;
+	double load = 0.0;
+
+public:
+	// Starts over at p_best_profile, the controller never goes above it or below p_worst_profile.
+	void reset(VideoDecoder::DecodeProfile p_best_profile, VideoDecoder::DecodeProfile p_worst_profile);
+	bool is_window_complete(uint64_t p_now_usec) const;
+	// Closes the current window if it has enough frames, returns true when the profile changed.
+	bool update(const Sample &p_sample, uint64_t p_now_usec);
+	// Drops the current window, the next update starts a new one. For pauses, the decoder sits idle through them.
+	void restart_window() { window_started = false; }
+	VideoDecoder::DecodeProfile get_profile() const { return profile; }
+	// Of the last complete window.
+	double get_load() const { return load; }
+};
+
+#endif // FFMPEG_QUALITY_CONTROLLER_H
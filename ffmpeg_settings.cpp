@@ -0,0 +1,112 @@
+/**************************************************************************/
+/*  ffmpeg_settings.cpp                                                   */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_settings.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/project_settings.hpp>
+#else
+#include "core/config/project_settings.h"
+#endif
+
+void FFmpegSettings::_global_def(const PropertyInfo &p_info, const Variant &p_default) {
+#ifdef GDEXTENSION
+	ProjectSettings *project_settings = ProjectSettings::get_singleton();
+	if (!project_settings->has_setting(p_info.name)) {
+		project_settings->set_setting(p_info.name, p_default);
+	}
+	project_settings->set_initial_value(p_info.name, p_default);
+
+	Dictionary property_info;
+	property_info["name"] = p_info.name;
+	property_info["type"] = p_info.type;
+	property_info["hint"] = p_info.hint;
+	property_info["hint_string"] = p_info.hint_string;
+	project_settings->add_property_info(property_info);
+#else
+	GLOBAL_DEF(p_info, p_default);
+#endif
+}
+
+void FFmpegSettings::register_settings() {
+	// Plain files on the local filesystem are memory mapped instead of read through FileAccess.
+	_global_def(PropertyInfo(Variant::BOOL, "ffmpeg/io/use_mmap"), true);
+	// Size of the buffer libavformat reads through, every refill is one call into the I/O source.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/io/avio_buffer_size", PROPERTY_HINT_RANGE, "4096,4194304,4096,suffix:B"), 65536);
+	// Bytes kept read ahead of the decoder by a background I/O thread, 0 reads on the decoder thread instead.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/io/read_ahead_size", PROPERTY_HINT_RANGE, "0,67108864,65536,suffix:B"), 4194304);
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/io/read_ahead_block_size", PROPERTY_HINT_RANGE, "4096,4194304,4096,suffix:B"), 262144);
+	// Files up to this size are kept in memory and shared by all playbacks of the same clip, 0 (the default) disables the cache.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/io/memory_cache/max_file_size", PROPERTY_HINT_RANGE, "0,268435456,65536,suffix:B"), 0);
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/io/memory_cache/max_total_size", PROPERTY_HINT_RANGE, "0,1073741824,65536,suffix:B"), 67108864);
+	// Compressed packets of the recently demuxed part of each playing file, seeks and loops inside it skip reading and demuxing.
+	// Large enough values keep whole files. 0 disables the packet cache.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/io/packet_cache_size", PROPERTY_HINT_RANGE, "0,1073741824,65536,suffix:B"), 0);
+
+	// Decoders opened ahead of time with FFmpegVideoStream.prewarm() that haven't been claimed by a playback yet.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/decoder_pool/max_decoders", PROPERTY_HINT_RANGE, "0,64,1"), 4);
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/decoder_pool/memory_limit", PROPERTY_HINT_RANGE, "0,2147483648,1048576,suffix:B"), 134217728);
+
+	// Limits on how much is read and decoded while opening a file, 0 keeps FFmpeg's defaults (5 MB and 5 seconds).
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/probing/probe_size", PROPERTY_HINT_RANGE, "0,52428800,1024,suffix:B"), 0);
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/probing/analyze_duration", PROPERTY_HINT_RANGE, "0,60000,1,suffix:ms"), 0);
+	// Demuxer to open files with instead of guessing from the contents, e.g. "matroska,webm" or "mov,mp4,m4a,3gp,3g2,mj2".
+	_global_def(PropertyInfo(Variant::STRING, "ffmpeg/probing/format"), "");
+	// Don't decode frames to find stream parameters if the container header already has them.
+	_global_def(PropertyInfo(Variant::BOOL, "ffmpeg/probing/trust_container"), false);
+
+	// Decode profile of streams left at "Project Default": Quality, Balanced, Fast or Thumbnail. Lower profiles skip
+	// deblocking and non-reference frames, useful on weak hardware or for videos that are small or offscreen.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/decoding/profile", PROPERTY_HINT_ENUM, "Quality,Balanced,Fast,Thumbnail"), 0);
+	// Cheapest profile streams with auto_decode_profile fall back to when decoding can't keep up, Thumbnail only shows keyframes.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/decoding/auto_profile_lowest", PROPERTY_HINT_ENUM, "Quality,Balanced,Fast,Thumbnail"), 2);
+
+	// Memory all decoders, playbacks and caches together try to stay under, 0 is unlimited.
+	// Over budget, decoders queue fewer frames, pooled decoders and cached files are dropped and caches stop growing.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/memory/budget", PROPERTY_HINT_RANGE, "0,17179869184,1048576,suffix:B"), 0);
+
+	// Looping clips up to this long are decoded once and replayed from memory, only used for clips without audio.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/loop_cache/max_duration", PROPERTY_HINT_RANGE, "0,60000,1,suffix:ms"), 5000);
+	// Memory all loop caches together may take, clips that don't fit in what is left keep decoding on every loop.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/loop_cache/max_memory", PROPERTY_HINT_RANGE, "0,2147483648,1048576,suffix:B"), 268435456);
+
+	// Spans FFmpegTrace keeps, a frame takes around half a dozen.
+	_global_def(PropertyInfo(Variant::INT, "ffmpeg/trace/max_events", PROPERTY_HINT_RANGE, "1024,4194304,1024"), 65536);
+	// Record from startup so a trace can be dumped whenever a stutter is reported.
+	_global_def(PropertyInfo(Variant::BOOL, "ffmpeg/trace/record_on_startup"), false);
+}
+
+Variant FFmpegSettings::get_setting(const String &p_name) {
+#ifdef GDEXTENSION
+	return ProjectSettings::get_singleton()->get_setting_with_override(p_name);
+#else
+	return GLOBAL_GET(p_name);
+#endif
+}
@@ -0,0 +1,109 @@
+/**************************************************************************/
+/*  ffmpeg_shared_decode.cpp                                              */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_shared_decode.h"
+
+#include "ffmpeg_video_stream.h"
+
+Mutex *FFmpegSharedDecodeRegistry::mutex = nullptr;
+FFmpegSharedDecodeRegistry::EntryMap *FFmpegSharedDecodeRegistry::entries = nullptr;
+
+Ref<FFmpegVideoStreamPlayback> FFmpegSharedDecodeRegistry::acquire(const String &p_key) {
+	if (mutex == nullptr) {
+		return Ref<FFmpegVideoStreamPlayback>();
+	}
+	MutexLock lock(*mutex);
+	Entry *entry = entries != nullptr ? entries->getptr(p_key) : nullptr;
+	if (entry == nullptr) {
+		return Ref<FFmpegVideoStreamPlayback>();
+	}
+	entry->followers++;
+	return entry->leader;
+}
+
+Ref<FFmpegVideoStreamPlayback> FFmpegSharedDecodeRegistry::add(const String &p_key, Ref<FFmpegVideoStreamPlayback> p_leader) {
+	ERR_FAIL_COND_V(p_leader.is_null(), p_leader);
+	if (mutex == nullptr) {
+		return p_leader;
+	}
+	MutexLock lock(*mutex);
+	if (entries == nullptr) {
+		entries = memnew(EntryMap);
+	}
+	Entry *entry = entries->getptr(p_key);
+	if (entry == nullptr) {
+		Entry new_entry;
+		new_entry.leader = p_leader;
+		entry = &entries->insert(p_key, new_entry)->value;
+	}
+	entry->followers++;
+	return entry->leader;
+}
+
+void FFmpegSharedDecodeRegistry::release(const String &p_key) {
+	// The leader is destroyed outside the lock, stopping its decoder thread can take a moment.
+	Ref<FFmpegVideoStreamPlayback> released_leader;
+	{
+		// Playbacks referenced past module uninitialization release their group after clear(), it's gone already.
+		if (mutex == nullptr) {
+			return;
+		}
+		MutexLock lock(*mutex);
+		Entry *entry = entries != nullptr ? entries->getptr(p_key) : nullptr;
+		ERR_FAIL_NULL(entry);
+		entry->followers--;
+		if (entry->followers > 0) {
+			return;
+		}
+		released_leader = entry->leader;
+		entries->erase(p_key);
+	}
+}
+
+void FFmpegSharedDecodeRegistry::initialize() {
+	mutex = memnew(Mutex);
+}
+
+void FFmpegSharedDecodeRegistry::clear() {
+	if (mutex == nullptr) {
+		return;
+	}
+	EntryMap *old_entries = nullptr;
+	{
+		MutexLock lock(*mutex);
+		old_entries = entries;
+		entries = nullptr;
+	}
+	if (old_entries != nullptr) {
+		memdelete(old_entries);
+	}
+	memdelete(mutex);
+	mutex = nullptr;
+}
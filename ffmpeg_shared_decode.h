@@ -0,0 +1,81 @@
+/**************************************************************************/
+/*  ffmpeg_shared_decode.h                                                */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_SHARED_DECODE_H
+#define FFMPEG_SHARED_DECODE_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/classes/ref.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/object/ref_counted.h"
+#include "core/os/mutex.h"
+#include "core/templates/hash_map.h"
+
+#endif
+
+class FFmpegVideoStreamPlayback;
+
+// Leader playbacks doing the decoding for every playback with FFmpegVideoStream.shared_decode enabled on the same key.
+// Leaders are reference counted by their followers and dropped with the last one.
+class FFmpegSharedDecodeRegistry {
+	struct Entry {
+		Ref<FFmpegVideoStreamPlayback> leader;
+		int followers = 0;
+	};
+
+	typedef HashMap<String, Entry> EntryMap;
+
+	// Created in initialize(), engine objects can't be constructed before the engine is up.
+	static Mutex *mutex;
+	// Allocated on first use and freed in clear(), so nothing is left to destroy after the engine shut down.
+	static EntryMap *entries;
+
+public:
+	// Returns the leader for p_key and counts the caller as one of its followers, or null if there is none yet.
+	static Ref<FFmpegVideoStreamPlayback> acquire(const String &p_key);
+	// Registers p_leader for p_key and counts the caller as a follower. If another leader got registered in the meantime, that one is returned instead.
+	static Ref<FFmpegVideoStreamPlayback> add(const String &p_key, Ref<FFmpegVideoStreamPlayback> p_leader);
+	static void release(const String &p_key);
+	static void initialize();
+	// Frees everything, calls made afterwards (playbacks outliving the module) do nothing.
+	static void clear();
+};
+
+#endif // FFMPEG_SHARED_DECODE_H
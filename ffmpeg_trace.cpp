@@ -0,0 +1,249 @@
+/**************************************************************************/
+/*  ffmpeg_trace.cpp                                                      */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "ffmpeg_trace.h"
+
+#ifdef GDEXTENSION
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#else
+#include "core/io/file_access.h"
+#include "core/os/os.h"
+#endif
+
+#include "ffmpeg_settings.h"
+
+#include <atomic>
+
+FFmpegTrace *FFmpegTrace::singleton = nullptr;
+SafeFlag FFmpegTrace::recording;
+SafeFlag FFmpegTrace::alive;
+SafeNumeric<int> FFmpegTrace::active_writers;
+SafeNumeric<int> FFmpegTrace::thread_count;
+
+int FFmpegTrace::_get_thread_index() {
+	static thread_local int thread_index = -1;
+	if (thread_index < 0) {
+		thread_index = thread_count.increment();
+	}
+	return thread_index;
+}
+
+FFmpegTrace *FFmpegTrace::get_singleton() {
+	return singleton;
+}
+
+void FFmpegTrace::_begin_write() {
+	active_writers.increment();
+	// Pairs with the fence in _wait_for_writers, either the waiter sees this writer or the writer sees the cleared flags.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void FFmpegTrace::_wait_for_writers() {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	while (active_writers.get() > 0) {
+		OS::get_singleton()->delay_usec(1);
+	}
+}
+
+void FFmpegTrace::_reset_slots() {
+	for (int i = 0; i < slot_count; i++) {
+		slots[i].sequence.set(0);
+	}
+	write_index.set(0);
+}
+
+void FFmpegTrace::_push_event(const Event &p_event) {
+	const uint64_t index = write_index.postincrement();
+	Slot &slot = slots[index % slot_count];
+	// Readers skip the slot until the sequence matches again.
+	slot.sequence.set(0);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.event = p_event;
+	slot.sequence.set(index + 1);
+}
+
+void FFmpegTrace::record(const char *p_name, uint64_t p_start_usec, uint64_t p_end_usec, double p_frame_time, bool p_async) {
+	if (!is_active()) {
+		return;
+	}
+	_begin_write();
+	if (!is_active()) {
+		active_writers.decrement();
+		return;
+	}
+	Event event;
+	event.name = p_name;
+	event.start_usec = p_start_usec;
+	event.duration_usec = p_end_usec > p_start_usec ? p_end_usec - p_start_usec : 0;
+	event.thread_index = _get_thread_index();
+	event.frame_time = p_frame_time;
+	event.async = p_async;
+	singleton->_push_event(event);
+	active_writers.decrement();
+}
+
+void FFmpegTrace::set_thread_name(const String &p_name) {
+	const int thread_index = _get_thread_index();
+	_begin_write();
+	if (alive.is_set()) {
+		MutexLock lock(singleton->thread_names_mutex);
+		singleton->thread_names[thread_index] = p_name;
+	}
+	active_writers.decrement();
+}
+
+void FFmpegTrace::start(int p_max_events) {
+	if (p_max_events <= 0) {
+		p_max_events = FFmpegSettings::get_setting("ffmpeg/trace/max_events");
+	}
+	ERR_FAIL_COND(p_max_events <= 0);
+	MutexLock lock(mutex);
+	// Stop first so nothing is pushed while the buffer is replaced.
+	recording.clear();
+	_wait_for_writers();
+	if (slot_count != p_max_events) {
+		if (slots != nullptr) {
+			memdelete_arr(slots);
+		}
+		slots = memnew_arr(Slot, p_max_events);
+		slot_count = p_max_events;
+	}
+	_reset_slots();
+	recording.set();
+}
+
+void FFmpegTrace::stop() {
+	recording.clear();
+}
+
+bool FFmpegTrace::is_recording() const {
+	return is_active();
+}
+
+void FFmpegTrace::clear() {
+	MutexLock lock(mutex);
+	const bool was_recording = is_active();
+	recording.clear();
+	_wait_for_writers();
+	_reset_slots();
+	recording.set_to(was_recording);
+}
+
+String FFmpegTrace::get_trace_json() {
+	Vector<Event> recorded;
+	HashMap<int, String> names;
+	{
+		MutexLock lock(mutex);
+		// Oldest first. Writers keep going meanwhile, slots they are rewriting are left out.
+		const uint64_t end_index = write_index.get();
+		const uint64_t start_index = end_index > (uint64_t)slot_count ? end_index - slot_count : 0;
+		for (uint64_t i = start_index; i < end_index; i++) {
+			const Slot &slot = slots[i % slot_count];
+			if (slot.sequence.get() != i + 1) {
+				continue;
+			}
+			const Event event = slot.event;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.get() == i + 1) {
+				recorded.push_back(event);
+			}
+		}
+	}
+	{
+		MutexLock lock(thread_names_mutex);
+		names = thread_names;
+	}
+
+	PackedStringArray json_events;
+	for (const KeyValue<int, String> &E : names) {
+		json_events.push_back(vformat("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", E.key, E.value.json_escape()));
+	}
+	int async_id = 0;
+	for (const Event &event : recorded) {
+		const String args = event.frame_time >= 0.0 ? vformat(",\"args\":{\"frame_time_ms\":%f}", event.frame_time) : String();
+		if (event.async) {
+			async_id++;
+			json_events.push_back(vformat("{\"name\":\"%s\",\"cat\":\"ffmpeg\",\"ph\":\"b\",\"id\":%d,\"ts\":%d,\"pid\":1,\"tid\":%d%s}", event.name, async_id, (int64_t)event.start_usec, event.thread_index, args));
+			json_events.push_back(vformat("{\"name\":\"%s\",\"cat\":\"ffmpeg\",\"ph\":\"e\",\"id\":%d,\"ts\":%d,\"pid\":1,\"tid\":%d}", event.name, async_id, (int64_t)(event.start_usec + event.duration_usec), event.thread_index));
+		} else {
+			json_events.push_back(vformat("{\"name\":\"%s\",\"cat\":\"ffmpeg\",\"ph\":\"X\",\"ts\":%d,\"dur\":%d,\"pid\":1,\"tid\":%d%s}", event.name, (int64_t)event.start_usec, (int64_t)event.duration_usec, event.thread_index, args));
+		}
+	}
+	return "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" + String(",\n").join(json_events) + "\n]}\n";
+}
+
+Error FFmpegTrace::dump(const String &p_path) {
+	Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::WRITE);
+	ERR_FAIL_COND_V_MSG(file.is_null(), ERR_CANT_CREATE, vformat("Couldn't open %s for writing.", p_path));
+	file->store_string(get_trace_json());
+	return OK;
+}
+
+void FFmpegTrace::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("start", "max_events"), &FFmpegTrace::start, DEFVAL(0));
+	ClassDB::bind_method(D_METHOD("stop"), &FFmpegTrace::stop);
+	ClassDB::bind_method(D_METHOD("is_recording"), &FFmpegTrace::is_recording);
+	ClassDB::bind_method(D_METHOD("clear"), &FFmpegTrace::clear);
+	ClassDB::bind_method(D_METHOD("get_trace_json"), &FFmpegTrace::get_trace_json);
+	ClassDB::bind_method(D_METHOD("dump", "path"), &FFmpegTrace::dump);
+}
+
+FFmpegTrace::FFmpegTrace() {
+	singleton = this;
+	alive.set();
+}
+
+FFmpegTrace::~FFmpegTrace() {
+	// Threads that are still running (decoders being torn down later) may be in the middle of a write.
+	recording.clear();
+	alive.clear();
+	_wait_for_writers();
+	singleton = nullptr;
+	if (slots != nullptr) {
+		memdelete_arr(slots);
+	}
+}
+
+FFmpegTraceSpan::FFmpegTraceSpan(const char *p_name, double p_frame_time) {
+	name = p_name;
+	frame_time = p_frame_time;
+	if (FFmpegTrace::is_active()) {
+		start_usec = OS::get_singleton()->get_ticks_usec();
+	}
+}
+
+FFmpegTraceSpan::~FFmpegTraceSpan() {
+	// Spans that started before the recording did are left out.
+	if (start_usec != 0 && FFmpegTrace::is_active()) {
+		FFmpegTrace::record(name, start_usec, OS::get_singleton()->get_ticks_usec(), frame_time);
+	}
+}
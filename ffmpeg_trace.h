@@ -0,0 +1,140 @@
+/**************************************************************************/
+/*  ffmpeg_trace.h                                                        */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             EIRTeam.FFmpeg                             */
+/*                         https://ph.eirteam.moe                         */
+/**************************************************************************/
+/* Copyright (c) 2023-present Álex Román (EIRTeam) & contributors.        */
+/*                                                                        */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FFMPEG_TRACE_H
+#define FFMPEG_TRACE_H
+
+#ifdef GDEXTENSION
+
+// Headers for building as GDExtension plug-in.
+#include <godot_cpp/classes/mutex.hpp>
+#include <godot_cpp/classes/object.hpp>
+#include <godot_cpp/core/mutex_lock.hpp>
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/templates/hash_map.hpp>
+#include <godot_cpp/templates/safe_refcount.hpp>
+#include <godot_cpp/templates/vector.hpp>
+
+using namespace godot;
+
+#else
+
+#include "core/object/object.h"
+#include "core/os/mutex.h"
+#include "core/templates/hash_map.h"
+#include "core/templates/safe_refcount.h"
+#include "core/templates/vector.h"
+
+#endif
+
+// Timeline of the decode pipeline for machines Tracy can't be attached to.
+// While recording, spans go into a fixed size lock-free ring buffer, the oldest ones are overwritten.
+// The buffer is exported as Chrome trace JSON, which chrome://tracing and Perfetto open.
+class FFmpegTrace : public Object {
+	GDCLASS(FFmpegTrace, Object);
+
+	struct Event {
+		// Only static strings, events are copied around without owning their name.
+		const char *name = nullptr;
+		uint64_t start_usec = 0;
+		uint64_t duration_usec = 0;
+		int thread_index = 0;
+		// Presentation time of the frame the span worked on, negative if it isn't about a single frame.
+		double frame_time = -1.0;
+		// Spans that overlap others on the same thread (e.g. frames waiting in a queue) are exported as async events.
+		bool async = false;
+	};
+
+	struct Slot {
+		// 0 while the event is being written, otherwise one past the index it was written for.
+		SafeNumeric<uint64_t> sequence;
+		Event event;
+	};
+
+	static FFmpegTrace *singleton;
+	// Checked before anything else, so spans cost next to nothing while not recording.
+	static SafeFlag recording;
+	// Cleared before the singleton is destroyed.
+	static SafeFlag alive;
+	// Threads inside record() or set_thread_name(), the buffer and the singleton are only replaced or freed once it drops to 0.
+	static SafeNumeric<int> active_writers;
+	static SafeNumeric<int> thread_count;
+
+	// Writers claim an index each and never wait on one another.
+	Slot *slots = nullptr;
+	int slot_count = 0;
+	SafeNumeric<uint64_t> write_index;
+	// Serializes start, clear and export, writers never take it.
+	Mutex mutex;
+	Mutex thread_names_mutex;
+	HashMap<int, String> thread_names;
+
+	static int _get_thread_index();
+	static void _begin_write();
+	void _push_event(const Event &p_event);
+	void _wait_for_writers();
+	void _reset_slots();
+
+protected:
+	static void _bind_methods();
+
+public:
+	static FFmpegTrace *get_singleton();
+	static bool is_active() { return recording.is_set(); }
+	static void record(const char *p_name, uint64_t p_start_usec, uint64_t p_end_usec, double p_frame_time = -1.0, bool p_async = false);
+	// Names the calling thread in exported traces, works whether or not a recording is running.
+	static void set_thread_name(const String &p_name);
+
+	// p_max_events <= 0 uses ffmpeg/trace/max_events. Starting again clears the previous recording.
+	void start(int p_max_events = 0);
+	void stop();
+	bool is_recording() const;
+	void clear();
+	String get_trace_json();
+	Error dump(const String &p_path);
+
+	FFmpegTrace();
+	~FFmpegTrace();
+};
+
+// Records a span from construction to destruction.
+class FFmpegTraceSpan {
+	const char *name;
+	uint64_t start_usec = 0;
+	double frame_time = -1.0;
+
+public:
+	void set_frame_time(double p_frame_time) { frame_time = p_frame_time; }
+
+	FFmpegTraceSpan(const char *p_name, double p_frame_time = -1.0);
+	~FFmpegTraceSpan();
+};
+
+#endif // FFMPEG_TRACE_H
@@ -33,6 +33,8 @@
 
 #ifdef GDEXTENSION
 #include "gdextension_build/gdex_print.h"
+#include <godot_cpp/classes/audio_server.hpp>
+#include <godot_cpp/classes/engine.hpp>
 #include <godot_cpp/classes/rd_shader_file.hpp>
 #include <godot_cpp/classes/rd_shader_source.hpp>
 #include <godot_cpp/classes/rd_shader_spirv.hpp>
@@ -81,6 +83,9 @@ RDTextureFormatC tfc_from_rdtf(Ref<RDTextureFormat> p_texture_format) {
 typedef int64_t ComputeListID;
 #define TEXTURE_FORMAT_COMPAT(tf) tfc_from_rdtf(tf);
 #else
+#include "core/config/engine.h"
+#include "core/os/os.h"
+#include "servers/audio_server.h"
 #include "servers/rendering/rendering_device_binds.h"
 typedef RD::TextureFormat RDTextureFormatC;
 typedef RD::TextureView RDTextureViewC;
@@ -88,6 +93,11 @@ typedef RD::TextureView RDTextureViewC;
 typedef RD::ComputeListID ComputeListID;
 #endif
 
+#include "ffmpeg_decoder_pool.h"
+#include "ffmpeg_media_cache.h"
+#include "ffmpeg_settings.h"
+#include "ffmpeg_shared_decode.h"
+#include "ffmpeg_trace.h"
 #include "tracy_import.h"
 #include "yuv_to_rgb.glsl.gen.h"
 
@@ -96,7 +106,13 @@ typedef RD::ComputeListID ComputeListID;
 #else
 #define FREE_RD_RID(rid) RS::get_singleton()->get_rendering_device()->free(rid);
 #endif
+
+static TracySumPlot playback_queue_plot("FFmpeg playback queue");
+
 void FFmpegVideoStreamPlayback::seek_into_sync() {
+	metrics.seeks++;
+	seek_start_usec = OS::get_singleton()->get_ticks_usec();
+	playback_position = _wrap_loop_time(playback_position);
 	decoder->seek(playback_position);
 	Vector<Ref<DecodedFrame>> decoded_frames;
 	for (Ref<DecodedFrame> df : available_frames) {
@@ -105,6 +121,7 @@ void FFmpegVideoStreamPlayback::seek_into_sync() {
 	decoder->return_frames(decoded_frames);
 	available_frames.clear();
 	available_audio_frames.clear();
+	_reset_audio_output();
 }
 
 double FFmpegVideoStreamPlayback::get_current_frame_time() {
@@ -115,19 +132,186 @@ double FFmpegVideoStreamPlayback::get_current_frame_time() {
 }
 
 bool FFmpegVideoStreamPlayback::check_next_frame_valid(Ref<DecodedFrame> p_decoded_frame) {
-	// in the case of looping, we may start a seek back to the beginning but still receive some lingering frames from the end of the last loop. these should be allowed to continue playing.
-	if (looping && Math::abs((p_decoded_frame->get_time() - decoder->get_duration()) - playback_position) < LENIENCE_BEFORE_SEEK)
-		return true;
+	const double presentation_position = _get_presentation_position();
+	return p_decoded_frame->get_time() <= presentation_position && Math::abs(p_decoded_frame->get_time() - presentation_position) < LENIENCE_BEFORE_SEEK;
+}
 
+bool FFmpegVideoStreamPlayback::check_next_audio_frame_valid(Ref<DecodedAudioFrame> p_decoded_frame) {
 	return p_decoded_frame->get_time() <= playback_position && Math::abs(p_decoded_frame->get_time() - playback_position) < LENIENCE_BEFORE_SEEK;
 }
 
-bool FFmpegVideoStreamPlayback::check_next_audio_frame_valid(Ref<DecodedAudioFrame> p_decoded_frame) {
-	// in the case of looping, we may start a seek back to the beginning but still receive some lingering frames from the end of the last loop. these should be allowed to continue playing.
-	if (looping && Math::abs((p_decoded_frame->get_time() - decoder->get_duration()) - playback_position) < LENIENCE_BEFORE_SEEK)
-		return true;
+bool FFmpegVideoStreamPlayback::_is_resampling_audio() const {
+	// The player sets up its audio right after loading, with async preparation the mix format is the only one known by then.
+	return resample_audio_to_mix_rate || async_preparation;
+}
 
-	return p_decoded_frame->get_time() <= playback_position && Math::abs(p_decoded_frame->get_time() - playback_position) < LENIENCE_BEFORE_SEEK;
+bool FFmpegVideoStreamPlayback::_is_audio_clock_active() const {
+	return sync_to_audio && audio_clock_end_time >= 0.0 && decoder->get_audio_channel_count() > 0;
+}
+
+double FFmpegVideoStreamPlayback::_get_interpolated_audio_time() const {
+	double time = audio_clock_anchor_time;
+	if (!paused) {
+		time += (OS::get_singleton()->get_ticks_usec() - audio_clock_anchor_usec) / 1000.0;
+	}
+	return time;
+}
+
+double FFmpegVideoStreamPlayback::_get_audio_clock() const {
+	// Audio that was never accepted can't be heard, and everything that was is only heard after the output latency.
+	return MIN(_get_interpolated_audio_time(), audio_clock_end_time) - AudioServer::get_singleton()->get_output_latency() * 1000.0;
+}
+
+void FFmpegVideoStreamPlayback::_anchor_audio_clock() {
+	// Keeps the clock continuous, if it was held at the end of the accepted audio it resumes from there.
+	audio_clock_anchor_time = MIN(_get_interpolated_audio_time(), audio_clock_end_time);
+	audio_clock_anchor_usec = OS::get_singleton()->get_ticks_usec();
+}
+
+void FFmpegVideoStreamPlayback::_check_audio_underrun() {
+	if (!_is_audio_clock_active() || paused) {
+		return;
+	}
+	const bool audio_ended = decoder->get_decoder_state() == VideoDecoder::DecoderState::END_OF_STREAM && available_audio_frames.size() == 0 && audio_mix_buffer_frames == 0;
+	const double overrun = _get_interpolated_audio_time() - audio_clock_end_time;
+	if (overrun > (audio_ended ? 0.0 : AUDIO_UNDERRUN_THRESHOLD)) {
+		// The audio track ended or can't keep up, the frame delta takes over where the audio clock stopped.
+		// The next accepted block starts the audio clock over.
+		playback_position = _get_audio_clock();
+		audio_clock_end_time = -1.0;
+	}
+}
+
+void FFmpegVideoStreamPlayback::_reset_audio_output() {
+	audio_clock_end_time = -1.0;
+	audio_clock_anchor_time = 0.0;
+	audio_clock_anchor_usec = 0;
+	audio_mix_buffer_frames = 0;
+	audio_mix_buffer_start_time = 0.0;
+	audio_mix_buffer_duration = 0.0;
+}
+
+double FFmpegVideoStreamPlayback::_get_presentation_position() const {
+	if (_is_audio_clock_active()) {
+		return _get_audio_clock();
+	}
+	return playback_position;
+}
+
+void FFmpegVideoStreamPlayback::_mix_audio_frame(const Ref<DecodedAudioFrame> &p_audio_frame) {
+	if (!audio_output_enabled) {
+		return;
+	}
+	const int channel_count = decoder->get_audio_channel_count();
+	const PackedFloat32Array sample_data = p_audio_frame->get_sample_data();
+	const int sample_count = sample_data.size() / channel_count;
+	const double frame_duration = sample_count * 1000.0 / decoder->get_audio_mix_rate();
+
+	// Decoded frames vary in length between codecs, they are gathered into fixed-size blocks before being handed to the mixer.
+	if (audio_mix_buffer_frames == 0) {
+		audio_mix_buffer_start_time = p_audio_frame->get_time();
+	}
+	const int required_size = (audio_mix_buffer_frames + sample_count) * channel_count;
+	if (audio_mix_buffer.size() < required_size) {
+		audio_mix_buffer.resize(required_size);
+	}
+	memcpy(audio_mix_buffer.ptrw() + audio_mix_buffer_frames * channel_count, sample_data.ptr(), sample_count * channel_count * sizeof(float));
+	audio_mix_buffer_frames += sample_count;
+	audio_mix_buffer_duration += frame_duration;
+
+	while (audio_mix_buffer_frames >= AUDIO_MIX_BLOCK_SIZE) {
+		_flush_audio_mix_buffer(AUDIO_MIX_BLOCK_SIZE);
+	}
+}
+
+void FFmpegVideoStreamPlayback::_flush_audio_mix_buffer(int p_frame_count) {
+	if (p_frame_count <= 0) {
+		return;
+	}
+	const int channel_count = decoder->get_audio_channel_count();
+	// Frame durations are rounded to whole samples, the block's stream time is split proportionally instead.
+	const double flushed_duration = audio_mix_buffer_duration * p_frame_count / audio_mix_buffer_frames;
+
+#ifdef GDEXTENSION
+	const int accepted_frames = mix_audio(p_frame_count, audio_mix_buffer, 0);
+#else
+	const int accepted_frames = mix_callback(mix_udata, audio_mix_buffer.ptr(), p_frame_count);
+#endif
+	if (accepted_frames > 0) {
+		if (audio_clock_end_time < 0.0) {
+			// Nothing of ours is queued in the mixer, this block starts playing right away.
+			audio_clock_anchor_time = audio_mix_buffer_start_time;
+			audio_clock_anchor_usec = OS::get_singleton()->get_ticks_usec();
+		} else {
+			_anchor_audio_clock();
+		}
+		// Frames the mixer refused are never heard, the audio it did take is heard right after the previous block.
+		audio_clock_end_time = audio_mix_buffer_start_time + flushed_duration * MIN(accepted_frames, p_frame_count) / p_frame_count;
+	}
+
+	audio_mix_buffer_frames -= p_frame_count;
+	audio_mix_buffer_start_time += flushed_duration;
+	audio_mix_buffer_duration -= flushed_duration;
+	if (audio_mix_buffer_frames > 0) {
+		float *buffer_ptrw = audio_mix_buffer.ptrw();
+		memmove(buffer_ptrw, buffer_ptrw + p_frame_count * channel_count, audio_mix_buffer_frames * channel_count * sizeof(float));
+	}
+}
+
+void FFmpegVideoStreamPlayback::_present_frame(const Ref<DecodedFrame> &p_frame) {
+	const uint64_t upload_start = OS::get_singleton()->get_ticks_usec();
+	if (p_frame->get_queued_usec() != 0) {
+		// Frames wait in the queue side by side, async so they don't have to nest.
+		FFmpegTrace::record("queue", p_frame->get_queued_usec(), upload_start, p_frame->get_time(), true);
+		// Only the first presentation ends the wait, a frame shown again (e.g. from the loop cache) gets no second span.
+		p_frame->set_queued_usec(0);
+	}
+	FFmpegTraceSpan present_span("present", p_frame->get_time());
+	// Resolution can change mid-stream (adaptive streams, concatenated files), textures follow the frames.
+	const Vector2i new_frame_size = p_frame->get_size();
+	const bool frame_size_changed = new_frame_size != frame_size;
+	frame_size = new_frame_size;
+
+	if (yuv_converter.is_valid()) {
+		if (frame_size_changed) {
+			yuv_converter->set_frame_size(new_frame_size);
+		}
+		// YUV conversion
+		if (p_frame->get_format() == FFmpegFrameFormat::YUV420P || p_frame->get_format() == FFmpegFrameFormat::YUVA420P) {
+			Ref<Image> y_plane = p_frame->get_yuv_image_plane(0);
+			Ref<Image> u_plane = p_frame->get_yuv_image_plane(1);
+			Ref<Image> v_plane = p_frame->get_yuv_image_plane(2);
+			Ref<Image> a_plane = p_frame->get_yuv_image_plane(3);
+
+			ERR_FAIL_COND(!y_plane.is_valid());
+			ERR_FAIL_COND(!u_plane.is_valid());
+			ERR_FAIL_COND(!v_plane.is_valid());
+
+			yuv_converter->set_plane_image(0, y_plane);
+			yuv_converter->set_plane_image(1, u_plane);
+			yuv_converter->set_plane_image(2, v_plane);
+			yuv_converter->set_plane_image(3, a_plane);
+		} else {
+			ERR_FAIL_COND(!p_frame->get_image().is_valid());
+			yuv_converter->set_rgba_image(p_frame->get_image());
+		}
+		yuv_converter->convert();
+		// RGBA texture handling
+	} else if (texture.is_valid()) {
+		if (texture->get_size() != p_frame->get_image()->get_size() || texture->get_format() != p_frame->get_image()->get_format()) {
+			ZoneNamedN(__img_upate_slow, "Image update slow", true);
+			texture->set_image(p_frame->get_image());
+		} else {
+			ZoneNamedN(__img_upate_fast, "Image update fast", true);
+			texture->update(p_frame->get_image());
+		}
+	}
+	metrics.upload_time_usec += OS::get_singleton()->get_ticks_usec() - upload_start;
+	metrics.presented_frames++;
+
+	if (frame_size_changed) {
+		emit_signal("resolution_changed", frame_size);
+	}
 }
 
 const char *const upd_str = "update_internal";
@@ -135,11 +319,34 @@ const char *const upd_str = "update_internal";
 void FFmpegVideoStreamPlayback::update_internal(double p_delta) {
 	ZoneScopedN("update_internal");
 
+	FFmpegMemoryBudget::enforce();
+
+	if (shared_leader.is_valid()) {
+		shared_leader->_update_shared(p_delta);
+		return;
+	}
+
+	if (preparing) {
+		_poll_preparation();
+		// Playback starts on the next update, the first frames can't have been decoded yet anyway.
+		return;
+	}
+
 	if (paused || !playing) {
 		return;
 	}
 
 	playback_position += p_delta * 1000.0f;
+	if (buffering) {
+		metrics.buffering_time_usec += p_delta * 1000000.0;
+	}
+
+	if (_is_loop_cache_active()) {
+		_update_loop_cache();
+		return;
+	}
+
+	_update_auto_decode_profile();
 
 	if (decoder->get_decoder_state() == VideoDecoder::DecoderState::END_OF_STREAM && available_frames.size() == 0) {
 		// if at the end of the stream but our playback enters a valid time region again, a seek operation is required to get the decoder back on track.
@@ -155,11 +362,6 @@ void FFmpegVideoStreamPlayback::update_internal(double p_delta) {
 
 	if (peek_frame.is_valid()) {
 		out_of_sync = Math::abs(playback_position - peek_frame->get_time()) > LENIENCE_BEFORE_SEEK;
-
-		if (looping) {
-			out_of_sync &= Math::abs(playback_position - decoder->get_duration() - peek_frame->get_time()) > LENIENCE_BEFORE_SEEK &&
-					Math::abs(playback_position + decoder->get_duration() - peek_frame->get_time()) > LENIENCE_BEFORE_SEEK;
-		}
 	}
 
 	if (out_of_sync) {
@@ -170,6 +372,8 @@ void FFmpegVideoStreamPlayback::update_internal(double p_delta) {
 	double frame_time = get_current_frame_time();
 
 	bool got_new_frame = false;
+	int received_frames = 0;
+	const bool catching_up = just_seeked || seek_start_usec != 0;
 
 	List<Ref<DecodedFrame>>::Element *next_frame = available_frames.front();
 	while (next_frame && (check_next_frame_valid(next_frame->get()) || just_seeked)) {
@@ -182,43 +386,45 @@ void FFmpegVideoStreamPlayback::update_internal(double p_delta) {
 		}
 		last_frame = next_frame->get();
 		last_frame_image = last_frame->get_image();
+		_update_loop_cache_recording(last_frame);
+		if (loop_cache_recording && loop_cache->get_mode() != FFmpegLoopCache::MODE_VRAM) {
+			loop_cache->record_frame(last_frame, last_frame->get_time() - loop_cache_pass * decoder->get_duration());
+		}
 #ifdef FFMPEG_MT_GPU_UPLOAD
 		last_frame_texture = last_frame->get_texture();
 #endif
 		got_new_frame = true;
+		received_frames++;
 		next_frame = next_frame->next();
 		available_frames.pop_front();
 	}
 #ifndef FFMPEG_MT_GPU_UPLOAD
 	if (got_new_frame) {
-		// YUV conversion
-		if (last_frame->get_format() == FFmpegFrameFormat::YUV420P || last_frame->get_format() == FFmpegFrameFormat::YUVA420P) {
-			Ref<Image> y_plane = last_frame->get_yuv_image_plane(0);
-			Ref<Image> u_plane = last_frame->get_yuv_image_plane(1);
-			Ref<Image> v_plane = last_frame->get_yuv_image_plane(2);
-			Ref<Image> a_plane = last_frame->get_yuv_image_plane(3);
-
-			ERR_FAIL_COND(!y_plane.is_valid());
-			ERR_FAIL_COND(!u_plane.is_valid());
-			ERR_FAIL_COND(!v_plane.is_valid());
-
-			yuv_converter->set_plane_image(0, y_plane);
-			yuv_converter->set_plane_image(1, u_plane);
-			yuv_converter->set_plane_image(2, v_plane);
-			yuv_converter->set_plane_image(3, a_plane);
-			yuv_converter->convert();
-			// RGBA texture handling
-		} else if (texture.is_valid()) {
-			if (texture->get_size() != last_frame_image->get_size() || texture->get_format() != last_frame_image->get_format()) {
-				ZoneNamedN(__img_upate_slow, "Image update slow", true);
-				texture->set_image(last_frame_image); // should never happen, but life has many doors ed-boy...
-			} else {
-				ZoneNamedN(__img_upate_fast, "Image update fast", true);
-				texture->update(last_frame_image);
-			}
+		if (_is_loop_cache_active()) {
+			// The recording finished with this update, the frame that ended it belongs to the next loop.
+			_update_loop_cache();
+			return;
+		}
+		_present_frame(last_frame);
+		if (loop_cache_recording && loop_cache->get_mode() == FFmpegLoopCache::MODE_VRAM) {
+			loop_cache->record_frame(last_frame, last_frame->get_time() - loop_cache_pass * decoder->get_duration());
 		}
 	}
 #endif
+	if (got_new_frame) {
+		// Frames replaced within the same update were never shown, unless the playback was only catching up after a seek.
+		if (!catching_up) {
+			metrics.dropped_frames += received_frames - 1;
+		}
+		if (_get_presentation_position() - last_frame->get_time() > LATE_FRAME_THRESHOLD) {
+			metrics.late_frames++;
+		}
+		if (seek_start_usec != 0) {
+			metrics.seek_latency_usec += OS::get_singleton()->get_ticks_usec() - seek_start_usec;
+			metrics.completed_seeks++;
+			seek_start_usec = 0;
+		}
+	}
 
 	if (available_frames.size() == 0) {
 		for (Ref<DecodedFrame> frame : decoder->get_decoded_frames()) {
@@ -234,28 +440,21 @@ void FFmpegVideoStreamPlayback::update_internal(double p_delta) {
 	bool audio_out_of_sync = false;
 
 	if (peek_audio_frame.is_valid()) {
-		audio_out_of_sync = Math::abs(playback_position - peek_audio_frame->get_time()) > LENIENCE_BEFORE_SEEK;
-
-		if (looping) {
-			out_of_sync &= Math::abs(playback_position - decoder->get_duration() - peek_audio_frame->get_time()) > LENIENCE_BEFORE_SEEK &&
-					Math::abs(playback_position + decoder->get_duration() - peek_audio_frame->get_time()) > LENIENCE_BEFORE_SEEK;
-		}
+		audio_out_of_sync = peek_audio_frame->get_time() < playback_position - LENIENCE_BEFORE_SEEK;
 	}
 
 	if (audio_out_of_sync) {
-		// TODO: seek audio stream individually if it desyncs
+		// Frames this far behind would never become valid and block the queue.
+		while (available_audio_frames.size() > 0 && available_audio_frames.front()->get()->get_time() < playback_position - LENIENCE_BEFORE_SEEK) {
+			available_audio_frames.pop_front();
+		}
 	}
 
 	List<Ref<DecodedAudioFrame>>::Element *next_audio_frame = available_audio_frames.front();
 	while (next_audio_frame && check_next_audio_frame_valid(next_audio_frame->get())) {
 		ZoneNamedN(__audio_mix, "Audio mix", true);
-		Ref<DecodedAudioFrame> audio_frame = next_audio_frame->get();
-		int sample_count = audio_frame->get_sample_data().size() / decoder->get_audio_channel_count();
-#ifdef GDEXTENSION
-		mix_audio(sample_count, audio_frame->get_sample_data(), 0);
-#else
-		mix_callback(mix_udata, audio_frame->get_sample_data().ptr(), sample_count);
-#endif
+		_mix_audio_frame(next_audio_frame->get());
+		decoder->return_audio_frame(next_audio_frame->get());
 		next_audio_frame = next_audio_frame->next();
 		available_audio_frames.pop_front();
 	}
@@ -265,83 +464,364 @@ void FFmpegVideoStreamPlayback::update_internal(double p_delta) {
 		}
 	}
 
+	if (available_audio_frames.size() == 0 && decoder->get_decoder_state() == VideoDecoder::DecoderState::END_OF_STREAM) {
+		// No more audio is coming, the last partial block can't wait to be filled up.
+		_flush_audio_mix_buffer(audio_mix_buffer_frames);
+	}
+	_check_audio_underrun();
+
 	buffering = decoder->is_running() && available_frames.size() == 0;
+	playback_queue_plot.report(plotted_available_frames, available_frames.size());
 
 	if (frame_time != get_current_frame_time()) {
 		frames_processed++;
 	}
 }
 
+void FFmpegVideoStreamPlayback::_setup_loop_cache() {
+	loop_cache.unref();
+	loop_cache_recording = false;
+	if (!looping || loop_cache_mode == FFmpegLoopCache::MODE_DISABLED) {
+		return;
+	}
+	const double max_duration = FFmpegSettings::get_setting("ffmpeg/loop_cache/max_duration");
+	if (decoder->get_duration() <= 0.0 || decoder->get_duration() > max_duration) {
+		return;
+	}
+	if (audio_output_enabled && decoder->get_audio_channel_count() > 0) {
+		// Audio would still have to come from the decoder, keeping both in sync isn't worth it for this.
+		return;
+	}
+	if (FFmpegMemoryBudget::is_over_budget()) {
+		return;
+	}
+	loop_cache = Ref<FFmpegLoopCache>(memnew(FFmpegLoopCache(loop_cache_mode, FFmpegSettings::get_setting("ffmpeg/loop_cache/max_memory"), yuv_converter)));
+}
+
+void FFmpegVideoStreamPlayback::_update_loop_cache_recording(const Ref<DecodedFrame> &p_frame) {
+	if (loop_cache.is_null() || loop_cache->is_complete() || loop_cache->has_failed()) {
+		return;
+	}
+	// Timestamps keep growing while looping, a recording covers exactly one pass through the clip.
+	const int pass = (int)Math::floor(p_frame->get_time() / decoder->get_duration());
+	if (pass == loop_cache_pass) {
+		return;
+	}
+	if (loop_cache_recording) {
+		loop_cache_recording = false;
+		loop_cache->finish(decoder->get_duration());
+		if (loop_cache->is_complete()) {
+			// The decoder isn't needed anymore, it stops once its queue is full.
+			loop_cache_frame = -1;
+			return;
+		}
+	}
+	loop_cache_pass = pass;
+	loop_cache_recording = true;
+	loop_cache->clear();
+}
+
+double FFmpegVideoStreamPlayback::_wrap_loop_time(double p_time) const {
+	if (!looping || decoder->get_duration() <= 0.0) {
+		return p_time;
+	}
+	return Math::fposmod(p_time, decoder->get_duration());
+}
+
+bool FFmpegVideoStreamPlayback::_is_loop_cache_active() const {
+	return loop_cache.is_valid() && loop_cache->is_complete();
+}
+
+void FFmpegVideoStreamPlayback::_update_loop_cache() {
+	playback_position = Math::fposmod(playback_position, loop_cache->get_duration());
+	const int frame_index = loop_cache->get_frame_index(playback_position);
+	if (frame_index == loop_cache_frame || frame_index < 0) {
+		return;
+	}
+	loop_cache_frame = frame_index;
+	if (loop_cache->get_mode() == FFmpegLoopCache::MODE_VRAM) {
+		const uint64_t upload_start = OS::get_singleton()->get_ticks_usec();
+		loop_cache->present_texture(frame_index);
+		metrics.upload_time_usec += OS::get_singleton()->get_ticks_usec() - upload_start;
+		metrics.presented_frames++;
+	} else {
+		Ref<DecodedFrame> frame = loop_cache->get_frame(frame_index);
+		ERR_FAIL_COND(frame.is_null());
+		_present_frame(frame);
+	}
+	frames_processed++;
+}
+
+Ref<FFmpegIOSource> FFmpegVideoStreamPlayback::_create_io_source(Ref<FileAccess> p_file_access) {
+	PackedByteArray cached_data = FFmpegMediaCache::get_file_data(p_file_access);
+	if (cached_data.size() > 0) {
+		return memnew(FFmpegMemoryIOSource(cached_data));
+	}
+	return _create_file_io_source(p_file_access);
+}
+
+Ref<FFmpegIOSource> FFmpegVideoStreamPlayback::_create_file_io_source(Ref<FileAccess> p_file_access) {
+	if (FFmpegSettings::get_setting("ffmpeg/io/use_mmap")) {
+		// The OS already reads ahead on mapped files, no need for our own I/O thread.
+		Ref<FFmpegIOSource> mapped_source = FFmpegMappedFileIOSource::open(p_file_access);
+		if (mapped_source.is_valid()) {
+			return mapped_source;
+		}
+	}
+
+	Ref<FFmpegIOSource> source = memnew(FFmpegFileIOSource(p_file_access));
+	int read_ahead_size = FFmpegSettings::get_setting("ffmpeg/io/read_ahead_size");
+	if (read_ahead_size > 0) {
+		int read_ahead_block_size = FFmpegSettings::get_setting("ffmpeg/io/read_ahead_block_size");
+		source = Ref<FFmpegIOSource>(memnew(FFmpegReadAheadIOSource(source, read_ahead_size, read_ahead_block_size)));
+	}
+	return source;
+}
+
+String FFmpegVideoStreamPlayback::get_decode_key(const String &p_path) const {
+	// Everything that changes what the decoder outputs has to be part of the key.
+	return vformat("%s|%s|%d|%d|%d|%s|%d|%d", p_path, target_size, (int)_is_resampling_audio(), probe_options.probe_size, probe_options.analyze_duration_usec, probe_options.format_name, (int)probe_options.trust_container, (int)looping);
+}
+
+void FFmpegVideoStreamPlayback::_create_decoder(Ref<FileAccess> p_file_access) {
+	// Opening the input can mean reading the whole file into memory, that is left to the preparation.
+	decoder = Ref<VideoDecoder>(memnew(VideoDecoder(p_file_access, shared_caches_enabled ? &FFmpegVideoStreamPlayback::_create_io_source : &FFmpegVideoStreamPlayback::_create_file_io_source)));
+	decoder->set_avio_buffer_size(FFmpegSettings::get_setting("ffmpeg/io/avio_buffer_size"));
+	decoder->set_packet_cache_size(FFmpegSettings::get_setting("ffmpeg/io/packet_cache_size"));
+	decoder->set_probe_options(probe_options);
+	decoder->set_looping(looping);
+	decoder->set_decode_profile(_get_decoder_profile());
+	decoder->set_target_size(target_size);
+	if (_is_resampling_audio()) {
+		// Godot mixes in stereo, converting here saves the mixer from resampling on the audio thread.
+		decoder->set_target_audio_format(AudioServer::get_singleton()->get_mix_rate(), 2);
+	}
+	decoder->start_decoding(async_preparation);
+}
+
 Error FFmpegVideoStreamPlayback::load(Ref<FileAccess> p_file_access) {
-	decoder = Ref<VideoDecoder>(memnew(VideoDecoder(p_file_access)));
+	// The decoder picks the frame format for every frame, when a rendering device is available all of them go through the converter
+	// so the output texture stays the same object even if the format changes mid-stream (or isn't known yet).
+	if (RS::get_singleton()->get_rendering_device() != nullptr) {
+		yuv_converter.instantiate();
+	}
+
+	if (shared_caches_enabled && FFmpegDecoderPool::claim(get_decode_key(p_file_access->get_path()), decoder)) {
+		decoder_prerolled = true;
+		// Not part of the decode key, the profile can be switched on a running decoder.
+		decoder->set_decode_profile(_get_decoder_profile());
+		if (!async_preparation) {
+			// The decoder may have been prewarmed asynchronously, honor the synchronous load the caller asked for.
+			decoder->wait_for_preparation();
+		}
+	} else {
+		_create_decoder(p_file_access);
+	}
 
-	decoder->start_decoding();
-	Vector2i size = decoder->get_size();
 	if (decoder->get_decoder_state() == VideoDecoder::FAULTED) {
 		return FAILED;
 	}
 
-	if (decoder->get_frame_format() == FFmpegFrameFormat::YUV420P || decoder->get_frame_format() == FFmpegFrameFormat::YUVA420P) {
-		yuv_converter.instantiate();
-		yuv_converter->set_frame_size(size);
+	if (decoder->get_decoder_state() == VideoDecoder::PREPARING) {
+		preparing = true;
+		return OK;
+	}
+
+	_setup_output_texture();
+	return OK;
+}
+
+Error FFmpegVideoStreamPlayback::prewarm(Ref<FileAccess> p_file_access) {
+	if (FFmpegMemoryBudget::is_over_budget()) {
+		WARN_PRINT(vformat("Not prewarming %s, the FFmpeg memory budget is exhausted.", p_file_access->get_path()));
+		return ERR_OUT_OF_MEMORY;
+	}
+	// Not going through load(), it would claim a decoder that is already pooled for this file instead of adding one.
+	_create_decoder(p_file_access);
+	if (decoder->get_decoder_state() == VideoDecoder::FAULTED) {
+		decoder.unref();
+		return FAILED;
+	}
+	if (FFmpegMemoryBudget::is_over_budget()) {
+		// Opening the codec pushed usage over the budget, a pooled decoder nobody asked for yet isn't worth keeping.
+		WARN_PRINT(vformat("Not prewarming %s, the FFmpeg memory budget is exhausted.", p_file_access->get_path()));
+		decoder.unref();
+		return ERR_OUT_OF_MEMORY;
+	}
+	// Starting to decode is all the pre-rolling needed, the decoder thread fills its frame queue on its own.
+	FFmpegDecoderPool::add(get_decode_key(p_file_access->get_path()), decoder);
+	decoder.unref();
+	return OK;
+}
+
+void FFmpegVideoStreamPlayback::_setup_output_texture() {
+	frame_size = decoder->get_size();
+	if (yuv_converter.is_valid()) {
+		yuv_converter->set_frame_size(frame_size);
 		yuv_texture = yuv_converter->get_output_texture();
 	} else {
 #ifdef GDEXTENSION
-		texture = ImageTexture::create_from_image(Image::create(size.x, size.y, false, Image::FORMAT_RGBA8));
+		texture = ImageTexture::create_from_image(Image::create(frame_size.x, frame_size.y, false, Image::FORMAT_RGBA8));
 #else
-		texture = ImageTexture::create_from_image(Image::create_empty(size.x, size.y, false, Image::FORMAT_RGBA8));
+		texture = ImageTexture::create_from_image(Image::create_empty(frame_size.x, frame_size.y, false, Image::FORMAT_RGBA8));
 #endif
 	}
-	return OK;
+	_setup_loop_cache();
+}
+
+void FFmpegVideoStreamPlayback::_poll_preparation() {
+	VideoDecoder::DecoderState state = decoder->get_decoder_state();
+	if (state == VideoDecoder::PREPARING) {
+		return;
+	}
+	preparing = false;
+	if (state == VideoDecoder::FAULTED) {
+		playing = false;
+		ERR_FAIL_MSG("Failed to prepare video for playback.");
+	}
+	_setup_output_texture();
+	emit_signal("prepared");
+}
+
+void FFmpegVideoStreamPlayback::_update_shared(double p_delta) {
+	// Every follower forwards its update, only the first one each frame advances the leader.
+	const uint64_t process_frame = Engine::get_singleton()->get_process_frames();
+	if (process_frame == shared_last_update_frame) {
+		return;
+	}
+	shared_last_update_frame = process_frame;
+	update_internal(p_delta);
 }
 
 bool FFmpegVideoStreamPlayback::is_paused_internal() const {
+	if (shared_leader.is_valid()) {
+		return shared_leader->paused;
+	}
 	return paused;
 }
 
 bool FFmpegVideoStreamPlayback::is_playing_internal() const {
+	if (shared_leader.is_valid()) {
+		return shared_playing && shared_leader->playing;
+	}
 	return playing;
 }
 
 void FFmpegVideoStreamPlayback::set_paused_internal(bool p_paused) {
+	if (shared_leader.is_valid()) {
+		shared_leader->set_paused_internal(p_paused);
+		return;
+	}
+	if (paused == p_paused) {
+		return;
+	}
+	if (audio_clock_end_time >= 0.0) {
+		// The audio clock stands still while paused.
+		_anchor_audio_clock();
+	}
+	quality_controller.restart_window();
 	paused = p_paused;
 }
 
 void FFmpegVideoStreamPlayback::play_internal() {
+	if (shared_leader.is_valid()) {
+		if (!shared_playing) {
+			shared_playing = true;
+			shared_leader->shared_playing_count++;
+		}
+		// Followers joining a running leader pick up at its current position instead of restarting it for everyone.
+		if (!shared_leader->playing) {
+			shared_leader->play_internal();
+		}
+		return;
+	}
 	if (decoder->get_decoder_state() == VideoDecoder::FAULTED) {
 		playing = false;
 		return;
 	}
 	clear();
 	playback_position = 0;
-	decoder->seek(0, true);
+	quality_controller.restart_window();
+	if (_is_loop_cache_active()) {
+		playing = true;
+		_update_loop_cache();
+		return;
+	}
+	// A decoder that is still preparing or was pre-rolled is at the beginning already, waiting for the seek would only add latency.
+	if (!preparing && !decoder_prerolled) {
+		decoder->seek(0, true);
+	}
+	decoder_prerolled = false;
 	just_seeked = true;
 	playing = true;
 }
 
 void FFmpegVideoStreamPlayback::stop_internal() {
+	if (shared_leader.is_valid()) {
+		if (shared_playing) {
+			shared_playing = false;
+			shared_leader->shared_playing_count--;
+			if (shared_leader->shared_playing_count == 0) {
+				shared_leader->stop_internal();
+			}
+		}
+		return;
+	}
 	if (playing) {
 		clear();
 		playback_position = 0.0f;
-		decoder->seek(playback_position, true);
-		just_seeked = true;
+		if (!_is_loop_cache_active()) {
+			decoder->seek(playback_position, !preparing);
+			decoder_prerolled = false;
+			just_seeked = true;
+		}
 	}
 	playing = false;
 }
 
 void FFmpegVideoStreamPlayback::seek_internal(double p_time) {
-	decoder->seek(p_time * 1000.0f);
+	if (shared_leader.is_valid()) {
+		shared_leader->seek_internal(p_time);
+		return;
+	}
+	metrics.seeks++;
+	if (_is_loop_cache_active()) {
+		playback_position = p_time * 1000.0f;
+		loop_cache_frame = -1;
+		_update_loop_cache();
+		return;
+	}
+	seek_start_usec = OS::get_singleton()->get_ticks_usec();
+	playback_position = _wrap_loop_time(p_time * 1000.0f);
+	if (loop_cache_recording) {
+		// Frames after the seek wouldn't line up with the ones recorded so far, recording starts over with the next loop.
+		loop_cache_recording = false;
+		loop_cache->clear();
+	}
+	if (loop_cache.is_valid() && decoder->get_duration() > 0.0) {
+		loop_cache_pass = (int)Math::floor(playback_position / decoder->get_duration());
+	}
+	decoder->seek(playback_position);
+	decoder_prerolled = false;
 	just_seeked = true;
 	available_frames.clear();
 	available_audio_frames.clear();
-	playback_position = p_time * 1000.0f;
+	// Audio up to the seek was already due, hand off the partial block instead of cutting it short.
+	_flush_audio_mix_buffer(audio_mix_buffer_frames);
+	_reset_audio_output();
 }
 
 double FFmpegVideoStreamPlayback::get_length_internal() const {
+	if (shared_leader.is_valid()) {
+		return shared_leader->get_length_internal();
+	}
 	return decoder->get_duration() / 1000.0f;
 }
 
 Ref<Texture2D> FFmpegVideoStreamPlayback::get_texture_internal() const {
+	if (shared_leader.is_valid()) {
+		return shared_leader->get_texture_internal();
+	}
 #ifdef FFMPEG_MT_GPU_UPLOAD
 	return last_frame_texture;
 #else
@@ -353,18 +833,264 @@ Ref<Texture2D> FFmpegVideoStreamPlayback::get_texture_internal() const {
 }
 
 double FFmpegVideoStreamPlayback::get_playback_position_internal() const {
-	return playback_position / 1000.0;
+	if (shared_leader.is_valid()) {
+		return shared_leader->get_playback_position_internal();
+	}
+	if (_is_audio_clock_active()) {
+		return _wrap_loop_time(MAX(_get_audio_clock(), 0.0)) / 1000.0;
+	}
+	return _wrap_loop_time(playback_position) / 1000.0;
 }
 
 int FFmpegVideoStreamPlayback::get_mix_rate_internal() const {
+	if (shared_leader.is_valid()) {
+		// Shared playbacks are silent, there is no sensible way to mix the same audio from several places.
+		return 0;
+	}
+	if (preparing && _is_resampling_audio()) {
+		// The output format is already known, this lets the player set up audio before the input was probed.
+		return AudioServer::get_singleton()->get_mix_rate();
+	}
 	return decoder->get_audio_mix_rate();
 }
 
 int FFmpegVideoStreamPlayback::get_channels_internal() const {
+	if (shared_leader.is_valid()) {
+		return 0;
+	}
+	if (preparing && _is_resampling_audio()) {
+		return 2;
+	}
 	return decoder->get_audio_channel_count();
 }
 
+void FFmpegVideoStreamPlayback::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("get_io_statistics"), &FFmpegVideoStreamPlayback::get_io_statistics);
+	ClassDB::bind_method(D_METHOD("get_metrics"), &FFmpegVideoStreamPlayback::get_metrics);
+	ClassDB::bind_method(D_METHOD("is_preparing"), &FFmpegVideoStreamPlayback::is_preparing);
+	ClassDB::bind_method(D_METHOD("set_decode_profile", "decode_profile"), &FFmpegVideoStreamPlayback::set_decode_profile);
+	ClassDB::bind_method(D_METHOD("get_decode_profile"), &FFmpegVideoStreamPlayback::get_decode_profile);
+	ClassDB::bind_method(D_METHOD("set_auto_decode_profile", "auto_decode_profile"), &FFmpegVideoStreamPlayback::set_auto_decode_profile);
+	ClassDB::bind_method(D_METHOD("get_auto_decode_profile"), &FFmpegVideoStreamPlayback::get_auto_decode_profile);
+
+	ADD_SIGNAL(MethodInfo("resolution_changed", PropertyInfo(Variant::VECTOR2I, "size")));
+	ADD_SIGNAL(MethodInfo("prepared"));
+	// decode_profile is a FFmpegVideoStream.DecodeProfile value, load the decoding time per frame over the frame interval that caused the change.
+	ADD_SIGNAL(MethodInfo("decode_profile_changed", PropertyInfo(Variant::INT, "decode_profile"), PropertyInfo(Variant::FLOAT, "load")));
+}
+
+void FFmpegVideoStreamPlayback::set_target_size(const Vector2i &p_target_size) {
+	ERR_FAIL_COND_MSG(decoder.is_valid(), "Target size must be set before the playback is loaded.");
+	target_size = p_target_size;
+}
+
+Vector2i FFmpegVideoStreamPlayback::get_target_size() const {
+	return target_size;
+}
+
+void FFmpegVideoStreamPlayback::set_sync_to_audio(bool p_sync_to_audio) {
+	sync_to_audio = p_sync_to_audio;
+	_reset_audio_output();
+}
+
+bool FFmpegVideoStreamPlayback::get_sync_to_audio() const {
+	return sync_to_audio;
+}
+
+void FFmpegVideoStreamPlayback::set_resample_audio_to_mix_rate(bool p_resample_audio_to_mix_rate) {
+	ERR_FAIL_COND_MSG(decoder.is_valid(), "Audio resampling must be set before the playback is loaded.");
+	resample_audio_to_mix_rate = p_resample_audio_to_mix_rate;
+}
+
+bool FFmpegVideoStreamPlayback::get_resample_audio_to_mix_rate() const {
+	return resample_audio_to_mix_rate;
+}
+
+void FFmpegVideoStreamPlayback::set_async_preparation(bool p_async_preparation) {
+	ERR_FAIL_COND_MSG(decoder.is_valid(), "Async preparation must be set before the playback is loaded.");
+	async_preparation = p_async_preparation;
+}
+
+bool FFmpegVideoStreamPlayback::get_async_preparation() const {
+	return async_preparation;
+}
+
+bool FFmpegVideoStreamPlayback::is_preparing() const {
+	if (shared_leader.is_valid()) {
+		return shared_leader->preparing;
+	}
+	return preparing;
+}
+
+void FFmpegVideoStreamPlayback::set_probe_options(const VideoDecoder::ProbeOptions &p_probe_options) {
+	ERR_FAIL_COND_MSG(decoder.is_valid(), "Probe options must be set before the playback is loaded.");
+	probe_options = p_probe_options;
+}
+
+Dictionary FFmpegVideoStreamPlayback::get_io_statistics() const {
+	if (shared_leader.is_valid()) {
+		return shared_leader->get_io_statistics();
+	}
+	Dictionary statistics;
+	ERR_FAIL_COND_V(decoder.is_null(), statistics);
+	Ref<FFmpegIOSource> io_source = decoder->get_io_source();
+	if (io_source.is_null()) {
+		// Still preparing, nothing was read through it yet.
+		return statistics;
+	}
+	FFmpegIOSource::Statistics io_statistics = io_source->get_statistics();
+	statistics["bytes_read"] = io_statistics.bytes_read;
+	statistics["source_bytes_read"] = io_statistics.source_bytes_read;
+	statistics["source_read_time_usec"] = io_statistics.source_read_time_usec;
+	statistics["stall_time_usec"] = io_statistics.stall_time_usec;
+	statistics["stall_count"] = io_statistics.stall_count;
+	// Bytes per second while actually reading, excludes time the reader was idle.
+	statistics["source_throughput"] = io_statistics.source_read_time_usec > 0 ? io_statistics.source_bytes_read * 1000000.0 / io_statistics.source_read_time_usec : 0.0;
+	return statistics;
+}
+
+void FFmpegVideoStreamPlayback::set_looping(bool p_looping) {
+	looping = p_looping;
+}
+
+bool FFmpegVideoStreamPlayback::get_looping() const {
+	return looping;
+}
+
+void FFmpegVideoStreamPlayback::set_loop_cache_mode(FFmpegLoopCache::Mode p_loop_cache_mode) {
+	loop_cache_mode = p_loop_cache_mode;
+}
+
+void FFmpegVideoStreamPlayback::set_decode_profile(int p_decode_profile) {
+	ERR_FAIL_INDEX(p_decode_profile, VideoDecoder::DECODE_PROFILE_MAX + 1);
+	// Every follower shows the leader's output, one of them changing it would change it for all of them.
+	ERR_FAIL_COND_MSG(shared_leader.is_valid(), "The decode profile of a shared decode is set on the stream and can't be changed per playback.");
+	decode_profile = p_decode_profile;
+	_reset_quality_controller();
+	if (decoder.is_valid()) {
+		decoder->set_decode_profile(_get_decoder_profile());
+	}
+}
+
+void FFmpegVideoStreamPlayback::set_auto_decode_profile(bool p_auto_decode_profile) {
+	ERR_FAIL_COND_MSG(shared_leader.is_valid(), "The decode profile of a shared decode is set on the stream and can't be changed per playback.");
+	auto_decode_profile = p_auto_decode_profile;
+	_reset_quality_controller();
+	if (decoder.is_valid()) {
+		// Back to the selected profile, the controller starts over from it.
+		decoder->set_decode_profile(_get_decoder_profile());
+	}
+}
+
+bool FFmpegVideoStreamPlayback::get_auto_decode_profile() const {
+	if (shared_leader.is_valid()) {
+		return shared_leader->get_auto_decode_profile();
+	}
+	return auto_decode_profile;
+}
+
+void FFmpegVideoStreamPlayback::_reset_quality_controller() {
+	const int lowest_profile = FFmpegSettings::get_setting("ffmpeg/decoding/auto_profile_lowest");
+	quality_controller.reset(_get_decoder_profile(), (VideoDecoder::DecodeProfile)CLAMP(lowest_profile, 0, VideoDecoder::DECODE_PROFILE_MAX - 1));
+}
+
+void FFmpegVideoStreamPlayback::_update_auto_decode_profile() {
+	const uint64_t now_usec = OS::get_singleton()->get_ticks_usec();
+	if (!auto_decode_profile || !quality_controller.is_window_complete(now_usec)) {
+		return;
+	}
+
+	const VideoDecoder::Statistics decoder_statistics = decoder->get_statistics();
+	FFmpegQualityController::Sample sample;
+	sample.busy_usec = decoder_statistics.decode_time_usec + decoder_statistics.conversion_time_usec;
+	sample.decoded_frames = decoder_statistics.decoded_frames;
+	sample.dropped_frames = metrics.dropped_frames;
+	sample.discontinuities = decoder_statistics.discontinuities;
+	if (!quality_controller.update(sample, now_usec)) {
+		return;
+	}
+
+	const VideoDecoder::DecodeProfile profile = quality_controller.get_profile();
+	decoder->set_decode_profile(profile);
+	emit_signal("decode_profile_changed", profile + 1, quality_controller.get_load());
+}
+
+int FFmpegVideoStreamPlayback::get_decode_profile() const {
+	if (shared_leader.is_valid()) {
+		return shared_leader->get_decode_profile();
+	}
+	return decode_profile;
+}
+
+VideoDecoder::DecodeProfile FFmpegVideoStreamPlayback::_get_decoder_profile() const {
+	if (decode_profile == FFmpegVideoStream::DECODE_PROFILE_PROJECT_DEFAULT) {
+		const int project_profile = FFmpegSettings::get_setting("ffmpeg/decoding/profile");
+		return (VideoDecoder::DecodeProfile)CLAMP(project_profile, 0, VideoDecoder::DECODE_PROFILE_MAX - 1);
+	}
+	return (VideoDecoder::DecodeProfile)(decode_profile - 1);
+}
+
+void FFmpegVideoStreamPlayback::set_shared_leader(const String &p_key, Ref<FFmpegVideoStreamPlayback> p_leader) {
+	ERR_FAIL_COND_MSG(decoder.is_valid() || shared_leader.is_valid(), "Only fresh playbacks can follow a shared leader.");
+	shared_key = p_key;
+	shared_leader = p_leader;
+}
+
+void FFmpegVideoStreamPlayback::set_audio_output_enabled(bool p_enabled) {
+	audio_output_enabled = p_enabled;
+}
+
+void FFmpegVideoStreamPlayback::set_shared_caches_enabled(bool p_enabled) {
+	shared_caches_enabled = p_enabled;
+}
+
+bool FFmpegVideoStreamPlayback::collect_metrics(FFmpegPlaybackMetrics &r_metrics) {
+	if (shared_leader.is_valid() || decoder.is_null()) {
+		return false;
+	}
+	r_metrics = metrics;
+	const VideoDecoder::Statistics decoder_statistics = decoder->get_statistics();
+	r_metrics.decode_time_usec = decoder_statistics.decode_time_usec;
+	r_metrics.conversion_time_usec = decoder_statistics.conversion_time_usec;
+	r_metrics.decoded_frames = decoder_statistics.decoded_frames;
+	r_metrics.queued_frames = decoder_statistics.queued_frames + available_frames.size();
+	r_metrics.memory_usage = decoder->get_memory_usage();
+	Ref<FFmpegIOSource> io_source = decoder->get_io_source();
+	if (io_source.is_valid()) {
+		r_metrics.bytes_read = io_source->get_statistics().bytes_read;
+		r_metrics.memory_usage += io_source->get_memory_usage();
+	}
+	if (loop_cache.is_valid()) {
+		r_metrics.memory_usage += loop_cache->get_memory_usage();
+	}
+	return true;
+}
+
+Dictionary FFmpegVideoStreamPlayback::get_metrics() {
+	if (shared_leader.is_valid()) {
+		return shared_leader->get_metrics();
+	}
+	FFmpegPlaybackMetrics playback_metrics;
+	collect_metrics(playback_metrics);
+	return playback_metrics.to_dictionary();
+}
+
 FFmpegVideoStreamPlayback::FFmpegVideoStreamPlayback() {
+	if (FFmpegMetrics::get_singleton() != nullptr) {
+		FFmpegMetrics::get_singleton()->add_playback(this);
+	}
+}
+
+FFmpegVideoStreamPlayback::~FFmpegVideoStreamPlayback() {
+	playback_queue_plot.report(plotted_available_frames, 0);
+	if (FFmpegMetrics::get_singleton() != nullptr) {
+		FFmpegMetrics::get_singleton()->remove_playback(this);
+	}
+	if (shared_leader.is_valid()) {
+		stop_internal();
+		shared_leader.unref();
+		FFmpegSharedDecodeRegistry::release(shared_key);
+	}
 }
 
 void FFmpegVideoStreamPlayback::clear() {
@@ -374,20 +1100,21 @@ void FFmpegVideoStreamPlayback::clear() {
 	available_audio_frames.clear();
 	frames_processed = 0;
 	playing = false;
+	loop_cache_recording = false;
+	loop_cache_pass = -1;
+	loop_cache_frame = -1;
+	_reset_audio_output();
 }
 
 YUVGPUConverter::~YUVGPUConverter() {
-	for (size_t i = 0; i < std::size(yuv_planes_uniform_sets); i++) {
-		if (yuv_planes_uniform_sets[i].is_valid()) {
-			FREE_RD_RID(yuv_planes_uniform_sets[i]);
-		}
-		if (yuv_plane_textures[i].is_valid()) {
-			FREE_RD_RID(yuv_plane_textures[i]);
-		}
+	for (size_t i = 0; i < std::size(yuv_plane_textures); i++) {
+		_free_texture(yuv_plane_textures[i]);
 	}
 
-	if (out_texture.is_valid() && out_texture->get_texture_rd_rid().is_valid()) {
-		FREE_RD_RID(out_texture->get_texture_rd_rid());
+	_free_texture(out_texture_data);
+
+	for (int i = 0; i < texture_pool.size(); i++) {
+		_free_texture(texture_pool.write[i]);
 	}
 
 	if (pipeline.is_valid()) {
@@ -429,101 +1156,128 @@ void YUVGPUConverter::_ensure_pipeline() {
 	pipeline = rd->compute_pipeline_create(shader);
 }
 
-Error YUVGPUConverter::_ensure_plane_textures() {
+Vector2i YUVGPUConverter::_get_plane_size(int p_plane_idx) const {
+	// chroma planes are half the size of the luma plane
+	if (p_plane_idx == 0 || p_plane_idx == 3) {
+		return frame_size;
+	}
+	return Vector2i(Math::ceil(frame_size.width / 2.0f), Math::ceil(frame_size.height / 2.0f));
+}
+
+RID YUVGPUConverter::_create_texture(const Vector2i &p_size, int p_format, uint32_t p_usage_bits) {
 	RD *rd = RS::get_singleton()->get_rendering_device();
-	for (size_t i = 0; i < std::size(yuv_plane_textures); i++) {
-		if (yuv_plane_textures[i].is_valid()) {
-			RDTextureFormatC format = TEXTURE_FORMAT_COMPAT(rd->texture_get_format(yuv_plane_textures[i]));
 
-			int desired_frame_width = i == 0 || i == 3 ? frame_size.width : Math::ceil(frame_size.width / 2.0f);
-			int desired_frame_height = i == 0 || i == 3 ? frame_size.height : Math::ceil(frame_size.height / 2.0f);
+	RDTextureFormatC new_format;
+	new_format.format = (RenderingDevice::DataFormat)p_format;
+	new_format.width = p_size.width;
+	new_format.height = p_size.height;
+	new_format.depth = 1;
+	new_format.array_layers = 1;
+	new_format.mipmaps = 1;
+	new_format.usage_bits = p_usage_bits;
 
-			if (static_cast<int>(format.width) == desired_frame_width && static_cast<int>(format.height) == desired_frame_height) {
-				continue;
-			}
-			continue;
-		}
+#ifdef GDEXTENSION
+	Ref<RDTextureFormat> new_format_c = new_format.get_texture_format();
+	Ref<RDTextureViewC> texture_view;
+	texture_view.instantiate();
+#else
+	RD::TextureFormat new_format_c = new_format;
+	RDTextureViewC texture_view;
+#endif
 
-		// Texture didn't exist or was invalid, re-create it
+	return rd->texture_create(new_format_c, texture_view);
+}
+
+int64_t YUVGPUConverter::_get_texture_memory(const PooledTexture &p_texture) {
+	const int bytes_per_pixel = p_texture.format == RenderingDevice::DATA_FORMAT_R8_UNORM ? 1 : 4;
+	return (int64_t)p_texture.size.x * p_texture.size.y * bytes_per_pixel;
+}
 
-		// free existing texture if needed
-		if (yuv_plane_textures[i].is_valid()) {
-			FREE_RD_RID(yuv_plane_textures[i]);
+YUVGPUConverter::PooledTexture YUVGPUConverter::_acquire_texture(const Vector2i &p_size, int p_format, uint32_t p_usage_bits) {
+	for (int i = 0; i < texture_pool.size(); i++) {
+		const PooledTexture &pooled = texture_pool[i];
+		if (pooled.size == p_size && pooled.format == p_format && pooled.usage_bits == p_usage_bits) {
+			PooledTexture texture = pooled;
+			texture_pool.remove_at(i);
+			return texture;
 		}
+	}
 
-		RDTextureFormatC new_format;
-		new_format.format = RenderingDevice::DATA_FORMAT_R8_UNORM;
-		// chroma planes are half the size of the luma plane
-		new_format.width = i == 0 || i == 3 ? frame_size.width : Math::ceil(frame_size.width / 2.0f);
-		new_format.height = i == 0 || i == 3 ? frame_size.height : Math::ceil(frame_size.height / 2.0f);
-		new_format.depth = 1;
-		new_format.array_layers = 1;
-		new_format.mipmaps = 1;
-		new_format.usage_bits = RD::TEXTURE_USAGE_SAMPLING_BIT | RD::TEXTURE_USAGE_COLOR_ATTACHMENT_BIT | RD::TEXTURE_USAGE_STORAGE_BIT | RD::TEXTURE_USAGE_CAN_UPDATE_BIT;
+	PooledTexture texture;
+	texture.texture = _create_texture(p_size, p_format, p_usage_bits);
+	texture.uniform_set = _create_uniform_set(texture.texture);
+	texture.size = p_size;
+	texture.format = p_format;
+	texture.usage_bits = p_usage_bits;
+	texture_memory += _get_texture_memory(texture);
+	texture_memory_account.set(texture_memory);
+	return texture;
+}
 
-#ifdef GDEXTENSION
-		Ref<RDTextureFormat> new_format_c = new_format.get_texture_format();
-		Ref<RDTextureViewC> texture_view;
-		texture_view.instantiate();
-#else
-		RD::TextureFormat new_format_c = new_format;
-		RDTextureViewC texture_view;
-#endif
-		yuv_plane_textures[i] = rd->texture_create(new_format_c, texture_view);
+void YUVGPUConverter::_release_texture(PooledTexture &p_texture) {
+	if (!p_texture.texture.is_valid()) {
+		return;
+	}
 
-		if (yuv_planes_uniform_sets[i].is_valid()) {
-			FREE_RD_RID(yuv_planes_uniform_sets[i]);
+	texture_pool.push_back(p_texture);
+	p_texture = PooledTexture();
+
+	// The oldest textures belong to the least recently used frame size, drop those first.
+	while (texture_pool.size() > MAX_POOLED_TEXTURES) {
+		_free_texture(texture_pool.write[0]);
+		texture_pool.remove_at(0);
+	}
+}
+
+void YUVGPUConverter::_free_texture(PooledTexture &p_texture) {
+	if (p_texture.uniform_set.is_valid()) {
+		FREE_RD_RID(p_texture.uniform_set);
+	}
+	if (p_texture.texture.is_valid()) {
+		FREE_RD_RID(p_texture.texture);
+		texture_memory -= _get_texture_memory(p_texture);
+		texture_memory_account.set(texture_memory);
+	}
+	p_texture = PooledTexture();
+}
+
+Error YUVGPUConverter::_ensure_plane_textures() {
+	for (size_t i = 0; i < std::size(yuv_plane_textures); i++) {
+		const Vector2i desired_size = _get_plane_size(i);
+		if (yuv_plane_textures[i].texture.is_valid() && yuv_plane_textures[i].size == desired_size) {
+			continue;
 		}
 
-		yuv_planes_uniform_sets[i] = _create_uniform_set(yuv_plane_textures[i]);
+		// Texture didn't exist or has the wrong size, swap it for one from the pool
+		_release_texture(yuv_plane_textures[i]);
+		yuv_plane_textures[i] = _acquire_texture(desired_size, RenderingDevice::DATA_FORMAT_R8_UNORM, RD::TEXTURE_USAGE_SAMPLING_BIT | RD::TEXTURE_USAGE_COLOR_ATTACHMENT_BIT | RD::TEXTURE_USAGE_STORAGE_BIT | RD::TEXTURE_USAGE_CAN_UPDATE_BIT);
 	}
 
 	return OK;
 }
 
 Error YUVGPUConverter::_ensure_output_texture() {
+	if (frame_size.x <= 0 || frame_size.y <= 0) {
+		return ERR_UNCONFIGURED;
+	}
+
 	_ensure_pipeline();
-	RD *rd = RS::get_singleton()->get_rendering_device();
 	if (!out_texture.is_valid()) {
 		out_texture.instantiate();
 	}
 
-	if (out_texture->get_texture_rd_rid().is_valid()) {
-		RDTextureFormatC format = TEXTURE_FORMAT_COMPAT(rd->texture_get_format(out_texture->get_texture_rd_rid()));
-		if (static_cast<int>(format.width) == frame_size.width && static_cast<int>(format.height) == frame_size.height) {
-			return OK;
-		}
-	}
-
-	if (out_texture->get_texture_rd_rid().is_valid()) {
-		FREE_RD_RID(out_texture->get_texture_rd_rid());
+	if (out_texture_data.texture.is_valid() && out_texture_data.size == frame_size) {
+		return OK;
 	}
 
-	RDTextureFormatC out_texture_format;
-	out_texture_format.format = RenderingDevice::DATA_FORMAT_R8G8B8A8_UNORM;
-	out_texture_format.width = frame_size.width;
-	out_texture_format.height = frame_size.height;
-	out_texture_format.depth = 1;
-	out_texture_format.array_layers = 1;
-	out_texture_format.mipmaps = 1;
-	// RD::TEXTURE_USAGE_CAN_UPDATE_BIT not needed since we won't update it from the CPU
-	out_texture_format.usage_bits = RD::TEXTURE_USAGE_SAMPLING_BIT | RD::TEXTURE_USAGE_COLOR_ATTACHMENT_BIT | RD::TEXTURE_USAGE_STORAGE_BIT | RD::TEXTURE_USAGE_CAN_COPY_TO_BIT;
+	// The previous texture stays alive in the pool, it may still be in use by the frame being drawn.
+	_release_texture(out_texture_data);
+	// RD::TEXTURE_USAGE_CAN_UPDATE_BIT is needed for RGBA frames, which are uploaded directly, copying from it is for snapshots
+	out_texture_data = _acquire_texture(frame_size, RenderingDevice::DATA_FORMAT_R8G8B8A8_UNORM, RD::TEXTURE_USAGE_SAMPLING_BIT | RD::TEXTURE_USAGE_COLOR_ATTACHMENT_BIT | RD::TEXTURE_USAGE_STORAGE_BIT | RD::TEXTURE_USAGE_CAN_COPY_TO_BIT | RD::TEXTURE_USAGE_CAN_COPY_FROM_BIT | RD::TEXTURE_USAGE_CAN_UPDATE_BIT);
 
-#ifdef GDEXTENSION
-	Ref<RDTextureView> texture_view;
-	texture_view.instantiate();
-	Ref<RDTextureFormat> out_texture_format_c = out_texture_format.get_texture_format();
-#else
-	RD::TextureFormat out_texture_format_c = out_texture_format;
-	RD::TextureView texture_view;
-#endif
-	out_texture->set_texture_rd_rid(rd->texture_create(out_texture_format_c, texture_view));
-	rd->texture_clear(out_texture->get_texture_rd_rid(), Color(0, 0, 0, 0), 0, 1, 0, 1);
-
-	if (out_uniform_set.is_valid()) {
-		FREE_RD_RID(out_uniform_set);
-	}
-	out_uniform_set = _create_uniform_set(out_texture->get_texture_rd_rid());
+	RD *rd = RS::get_singleton()->get_rendering_device();
+	rd->texture_clear(out_texture_data.texture, Color(0, 0, 0, 0), 0, 1, 0, 1);
+	out_texture->set_texture_rd_rid(out_texture_data.texture);
 	return OK;
 }
 
@@ -553,11 +1307,12 @@ void YUVGPUConverter::_upload_plane_images() {
 		if (!yuv_plane_images[i].is_valid()) {
 			continue;
 		}
-		RS::get_singleton()->get_rendering_device()->texture_update(yuv_plane_textures[i], 0, yuv_plane_images[i]->get_data());
+		RS::get_singleton()->get_rendering_device()->texture_update(yuv_plane_textures[i].texture, 0, yuv_plane_images[i]->get_data());
 	}
 }
 
 void YUVGPUConverter::set_plane_image(int p_plane_idx, Ref<Image> p_image) {
+	rgba_image.unref();
 	if (!p_image.is_valid()) {
 		yuv_plane_images[p_plane_idx] = p_image;
 		return;
@@ -565,14 +1320,23 @@ void YUVGPUConverter::set_plane_image(int p_plane_idx, Ref<Image> p_image) {
 	ERR_FAIL_COND(!p_image.is_valid());
 	ERR_FAIL_INDEX((size_t)p_plane_idx, std::size(yuv_plane_images));
 	// Sanity checks
-	int desired_frame_width = p_plane_idx == 0 || p_plane_idx == 3 ? frame_size.width : Math::ceil(frame_size.width / 2.0f);
-	int desired_frame_height = p_plane_idx == 0 || p_plane_idx == 3 ? frame_size.height : Math::ceil(frame_size.height / 2.0f);
-	ERR_FAIL_COND_MSG(p_image->get_width() != desired_frame_width, vformat("Wrong YUV plane width for plane %d, expected %d got %d", p_plane_idx, desired_frame_width, p_image->get_width()));
-	ERR_FAIL_COND_MSG(p_image->get_height() != desired_frame_height, vformat("Wrong YUV plane height for plane %, expected %d got %d", p_plane_idx, desired_frame_height, p_image->get_height()));
+	const Vector2i desired_size = _get_plane_size(p_plane_idx);
+	ERR_FAIL_COND_MSG(p_image->get_width() != desired_size.width, vformat("Wrong YUV plane width for plane %d, expected %d got %d", p_plane_idx, desired_size.width, p_image->get_width()));
+	ERR_FAIL_COND_MSG(p_image->get_height() != desired_size.height, vformat("Wrong YUV plane height for plane %d, expected %d got %d", p_plane_idx, desired_size.height, p_image->get_height()));
 	ERR_FAIL_COND_MSG(p_image->get_format() != Image::FORMAT_R8, "Wrong image format, expected R8");
 	yuv_plane_images[p_plane_idx] = p_image;
 }
 
+void YUVGPUConverter::set_rgba_image(Ref<Image> p_image) {
+	ERR_FAIL_COND(!p_image.is_valid());
+	ERR_FAIL_COND_MSG(p_image->get_size() != frame_size, vformat("Wrong RGBA image size, expected %s got %s", frame_size, p_image->get_size()));
+	ERR_FAIL_COND_MSG(p_image->get_format() != Image::FORMAT_RGBA8, "Wrong image format, expected RGBA8");
+	for (size_t i = 0; i < std::size(yuv_plane_images); i++) {
+		yuv_plane_images[i].unref();
+	}
+	rgba_image = p_image;
+}
+
 Vector2i YUVGPUConverter::get_frame_size() const { return frame_size; }
 
 void YUVGPUConverter::set_frame_size(const Vector2i &p_frame_size) {
@@ -583,17 +1347,26 @@ void YUVGPUConverter::set_frame_size(const Vector2i &p_frame_size) {
 	yuv_plane_images[0].unref();
 	yuv_plane_images[1].unref();
 	yuv_plane_images[2].unref();
+	rgba_image.unref();
 }
 
 void YUVGPUConverter::convert() {
+	FFmpegTraceSpan gpu_convert_span("gpu_convert");
 	// First we must ensure everything we need exists
 	_ensure_pipeline();
-	_ensure_plane_textures();
-	_ensure_output_texture();
-	_upload_plane_images();
+	ERR_FAIL_COND(_ensure_output_texture() != OK);
 
 	RD *rd = RS::get_singleton()->get_rendering_device();
 
+	if (rgba_image.is_valid()) {
+		// Nothing to convert, RGBA frames are uploaded as-is
+		rd->texture_update(out_texture_data.texture, 0, rgba_image->get_data());
+		return;
+	}
+
+	_ensure_plane_textures();
+	_upload_plane_images();
+
 	push_constant.use_alpha = yuv_plane_images[3].is_valid();
 
 	PackedByteArray push_constant_data;
@@ -603,11 +1376,11 @@ void YUVGPUConverter::convert() {
 	ComputeListID compute_list = rd->compute_list_begin();
 	rd->compute_list_bind_compute_pipeline(compute_list, pipeline);
 	rd->compute_list_set_push_constant(compute_list, push_constant_data, push_constant_data.size());
-	rd->compute_list_bind_uniform_set(compute_list, yuv_planes_uniform_sets[0], 0);
-	rd->compute_list_bind_uniform_set(compute_list, yuv_planes_uniform_sets[1], 1);
-	rd->compute_list_bind_uniform_set(compute_list, yuv_planes_uniform_sets[2], 2);
-	rd->compute_list_bind_uniform_set(compute_list, yuv_planes_uniform_sets[3], 3);
-	rd->compute_list_bind_uniform_set(compute_list, out_uniform_set, 4);
+	rd->compute_list_bind_uniform_set(compute_list, yuv_plane_textures[0].uniform_set, 0);
+	rd->compute_list_bind_uniform_set(compute_list, yuv_plane_textures[1].uniform_set, 1);
+	rd->compute_list_bind_uniform_set(compute_list, yuv_plane_textures[2].uniform_set, 2);
+	rd->compute_list_bind_uniform_set(compute_list, yuv_plane_textures[3].uniform_set, 3);
+	rd->compute_list_bind_uniform_set(compute_list, out_texture_data.uniform_set, 4);
 	rd->compute_list_dispatch(compute_list, Math::ceil(frame_size.x / 8.0f), Math::ceil(frame_size.y / 8.0f), 1);
 	rd->compute_list_end();
 }
@@ -617,6 +1390,279 @@ Ref<Texture2D> YUVGPUConverter::get_output_texture() const {
 	return out_texture;
 }
 
+RID YUVGPUConverter::create_output_snapshot() {
+	ERR_FAIL_COND_V(_ensure_output_texture() != OK, RID());
+	RD *rd = RS::get_singleton()->get_rendering_device();
+	RID snapshot = _create_texture(frame_size, RenderingDevice::DATA_FORMAT_R8G8B8A8_UNORM, RD::TEXTURE_USAGE_SAMPLING_BIT | RD::TEXTURE_USAGE_CAN_COPY_TO_BIT | RD::TEXTURE_USAGE_CAN_COPY_FROM_BIT);
+	rd->texture_copy(out_texture_data.texture, snapshot, Vector3(), Vector3(), Vector3(frame_size.x, frame_size.y, 1), 0, 0, 0, 0);
+	return snapshot;
+}
+
+void YUVGPUConverter::present_snapshot(RID p_snapshot, const Vector2i &p_size) {
+	if (frame_size != p_size) {
+		set_frame_size(p_size);
+	}
+	ERR_FAIL_COND(_ensure_output_texture() != OK);
+	RD *rd = RS::get_singleton()->get_rendering_device();
+	rd->texture_copy(p_snapshot, out_texture_data.texture, Vector3(), Vector3(), Vector3(p_size.x, p_size.y, 1), 0, 0, 0, 0);
+}
+
+void YUVGPUConverter::free_snapshot(RID p_snapshot) {
+	if (p_snapshot.is_valid()) {
+		FREE_RD_RID(p_snapshot);
+	}
+}
+
 YUVGPUConverter::YUVGPUConverter() {
 	out_texture.instantiate();
 }
+
+void FFmpegVideoStream::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("prewarm"), &FFmpegVideoStream::prewarm);
+	ClassDB::bind_method(D_METHOD("set_target_size", "target_size"), &FFmpegVideoStream::set_target_size);
+	ClassDB::bind_method(D_METHOD("get_target_size"), &FFmpegVideoStream::get_target_size);
+	ClassDB::bind_method(D_METHOD("set_sync_to_audio", "sync_to_audio"), &FFmpegVideoStream::set_sync_to_audio);
+	ClassDB::bind_method(D_METHOD("get_sync_to_audio"), &FFmpegVideoStream::get_sync_to_audio);
+	ClassDB::bind_method(D_METHOD("set_resample_audio_to_mix_rate", "resample_audio_to_mix_rate"), &FFmpegVideoStream::set_resample_audio_to_mix_rate);
+	ClassDB::bind_method(D_METHOD("get_resample_audio_to_mix_rate"), &FFmpegVideoStream::get_resample_audio_to_mix_rate);
+	ClassDB::bind_method(D_METHOD("set_async_preparation", "async_preparation"), &FFmpegVideoStream::set_async_preparation);
+	ClassDB::bind_method(D_METHOD("get_async_preparation"), &FFmpegVideoStream::get_async_preparation);
+	ClassDB::bind_method(D_METHOD("set_shared_decode", "shared_decode"), &FFmpegVideoStream::set_shared_decode);
+	ClassDB::bind_method(D_METHOD("get_shared_decode"), &FFmpegVideoStream::get_shared_decode);
+	ClassDB::bind_method(D_METHOD("set_shared_decode_group", "shared_decode_group"), &FFmpegVideoStream::set_shared_decode_group);
+	ClassDB::bind_method(D_METHOD("get_shared_decode_group"), &FFmpegVideoStream::get_shared_decode_group);
+
+	ADD_PROPERTY(PropertyInfo(Variant::VECTOR2I, "target_size"), "set_target_size", "get_target_size");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "sync_to_audio"), "set_sync_to_audio", "get_sync_to_audio");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "resample_audio_to_mix_rate"), "set_resample_audio_to_mix_rate", "get_resample_audio_to_mix_rate");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "async_preparation"), "set_async_preparation", "get_async_preparation");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "shared_decode"), "set_shared_decode", "get_shared_decode");
+	ADD_PROPERTY(PropertyInfo(Variant::STRING, "shared_decode_group"), "set_shared_decode_group", "get_shared_decode_group");
+
+	ClassDB::bind_method(D_METHOD("set_probe_size", "probe_size"), &FFmpegVideoStream::set_probe_size);
+	ClassDB::bind_method(D_METHOD("get_probe_size"), &FFmpegVideoStream::get_probe_size);
+	ClassDB::bind_method(D_METHOD("set_probe_analyze_duration", "probe_analyze_duration"), &FFmpegVideoStream::set_probe_analyze_duration);
+	ClassDB::bind_method(D_METHOD("get_probe_analyze_duration"), &FFmpegVideoStream::get_probe_analyze_duration);
+	ClassDB::bind_method(D_METHOD("set_probe_format", "probe_format"), &FFmpegVideoStream::set_probe_format);
+	ClassDB::bind_method(D_METHOD("get_probe_format"), &FFmpegVideoStream::get_probe_format);
+	ClassDB::bind_method(D_METHOD("set_probe_trust_container", "probe_trust_container"), &FFmpegVideoStream::set_probe_trust_container);
+	ClassDB::bind_method(D_METHOD("get_probe_trust_container"), &FFmpegVideoStream::get_probe_trust_container);
+
+	ADD_GROUP("Probing", "probe_");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "probe_size", PROPERTY_HINT_RANGE, "-1,52428800,1024,suffix:B"), "set_probe_size", "get_probe_size");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "probe_analyze_duration", PROPERTY_HINT_RANGE, "-1,60000,1,suffix:ms"), "set_probe_analyze_duration", "get_probe_analyze_duration");
+	ADD_PROPERTY(PropertyInfo(Variant::STRING, "probe_format"), "set_probe_format", "get_probe_format");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "probe_trust_container", PROPERTY_HINT_ENUM, "Project Default,Disabled,Enabled"), "set_probe_trust_container", "get_probe_trust_container");
+
+	BIND_ENUM_CONSTANT(PROBE_TRUST_CONTAINER_PROJECT_DEFAULT);
+	BIND_ENUM_CONSTANT(PROBE_TRUST_CONTAINER_DISABLED);
+	BIND_ENUM_CONSTANT(PROBE_TRUST_CONTAINER_ENABLED);
+
+	ClassDB::bind_method(D_METHOD("set_loop", "loop"), &FFmpegVideoStream::set_loop);
+	ClassDB::bind_method(D_METHOD("get_loop"), &FFmpegVideoStream::get_loop);
+	ClassDB::bind_method(D_METHOD("set_loop_cache_mode", "loop_cache_mode"), &FFmpegVideoStream::set_loop_cache_mode);
+	ClassDB::bind_method(D_METHOD("get_loop_cache_mode"), &FFmpegVideoStream::get_loop_cache_mode);
+
+	ADD_GROUP("", "");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "loop"), "set_loop", "get_loop");
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "loop_cache_mode", PROPERTY_HINT_ENUM, "Disabled,RAM,RAM (Compressed),VRAM"), "set_loop_cache_mode", "get_loop_cache_mode");
+
+	BIND_ENUM_CONSTANT(LOOP_CACHE_DISABLED);
+	BIND_ENUM_CONSTANT(LOOP_CACHE_RAM);
+	BIND_ENUM_CONSTANT(LOOP_CACHE_RAM_COMPRESSED);
+	BIND_ENUM_CONSTANT(LOOP_CACHE_VRAM);
+
+	ClassDB::bind_method(D_METHOD("set_decode_profile", "decode_profile"), &FFmpegVideoStream::set_decode_profile);
+	ClassDB::bind_method(D_METHOD("get_decode_profile"), &FFmpegVideoStream::get_decode_profile);
+
+	ClassDB::bind_method(D_METHOD("set_auto_decode_profile", "auto_decode_profile"), &FFmpegVideoStream::set_auto_decode_profile);
+	ClassDB::bind_method(D_METHOD("get_auto_decode_profile"), &FFmpegVideoStream::get_auto_decode_profile);
+
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "decode_profile", PROPERTY_HINT_ENUM, "Project Default,Quality,Balanced,Fast,Thumbnail"), "set_decode_profile", "get_decode_profile");
+	ADD_PROPERTY(PropertyInfo(Variant::BOOL, "auto_decode_profile"), "set_auto_decode_profile", "get_auto_decode_profile");
+
+	BIND_ENUM_CONSTANT(DECODE_PROFILE_PROJECT_DEFAULT);
+	BIND_ENUM_CONSTANT(DECODE_PROFILE_QUALITY);
+	BIND_ENUM_CONSTANT(DECODE_PROFILE_BALANCED);
+	BIND_ENUM_CONSTANT(DECODE_PROFILE_FAST);
+	BIND_ENUM_CONSTANT(DECODE_PROFILE_THUMBNAIL);
+}
+
+Ref<FFmpegVideoStreamPlayback> FFmpegVideoStream::_create_playback() const {
+	Ref<FFmpegVideoStreamPlayback> pb;
+	pb.instantiate();
+	pb->set_target_size(target_size);
+	pb->set_sync_to_audio(sync_to_audio);
+	pb->set_resample_audio_to_mix_rate(resample_audio_to_mix_rate);
+	pb->set_async_preparation(async_preparation);
+	pb->set_probe_options(_get_probe_options());
+	pb->set_looping(loop);
+	pb->set_loop_cache_mode((FFmpegLoopCache::Mode)loop_cache_mode);
+	pb->set_decode_profile(decode_profile);
+	pb->set_auto_decode_profile(auto_decode_profile);
+	return pb;
+}
+
+Ref<VideoStreamPlayback> FFmpegVideoStream::_instantiate_shared_playback(Ref<FileAccess> p_file_access) const {
+	Ref<FFmpegVideoStreamPlayback> leader = _create_playback();
+	// The leader is never attached to a player, nothing would consume its audio.
+	leader->set_sync_to_audio(false);
+	leader->set_audio_output_enabled(false);
+	// Streams asking for different decode profiles don't share a decoder. The path is the one load() and the decoder pool
+	// see, get_file() may name the same file differently.
+	const String key = vformat("%s|%s|%d|%d", shared_decode_group, leader->get_decode_key(p_file_access->get_path()), (int)decode_profile, (int)auto_decode_profile);
+
+	Ref<FFmpegVideoStreamPlayback> shared_leader = FFmpegSharedDecodeRegistry::acquire(key);
+	if (shared_leader.is_null()) {
+		if (leader->load(p_file_access) != OK) {
+			return Ref<VideoStreamPlayback>();
+		}
+		if (!leader->is_preparing() && leader->STREAM_FUNCNAME(get_channels)() > 0) {
+			WARN_PRINT(vformat("%s has audio, but playbacks in shared decode group \"%s\" play without it.", p_file_access->get_path(), shared_decode_group));
+		}
+		shared_leader = FFmpegSharedDecodeRegistry::add(key, leader);
+	}
+
+	Ref<FFmpegVideoStreamPlayback> follower;
+	follower.instantiate();
+	follower->set_shared_leader(key, shared_leader);
+	return follower;
+}
+
+Error FFmpegVideoStream::prewarm() {
+	Ref<FileAccess> fa = FileAccess::open(get_file(), FileAccess::READ);
+	ERR_FAIL_COND_V_MSG(fa.is_null(), ERR_FILE_CANT_OPEN, vformat("Couldn't open %s for prewarming.", get_file()));
+	return _create_playback()->prewarm(fa);
+}
+
+VideoDecoder::ProbeOptions FFmpegVideoStream::_get_probe_options() const {
+	VideoDecoder::ProbeOptions options;
+	options.probe_size = probe_size >= 0 ? probe_size : (int64_t)FFmpegSettings::get_setting("ffmpeg/probing/probe_size");
+	const int analyze_duration = probe_analyze_duration >= 0 ? probe_analyze_duration : (int)FFmpegSettings::get_setting("ffmpeg/probing/analyze_duration");
+	options.analyze_duration_usec = analyze_duration * (int64_t)1000;
+	options.format_name = !probe_format.is_empty() ? probe_format : (String)FFmpegSettings::get_setting("ffmpeg/probing/format");
+	switch (probe_trust_container) {
+		case PROBE_TRUST_CONTAINER_PROJECT_DEFAULT: {
+			options.trust_container = FFmpegSettings::get_setting("ffmpeg/probing/trust_container");
+		} break;
+		case PROBE_TRUST_CONTAINER_DISABLED: {
+			options.trust_container = false;
+		} break;
+		case PROBE_TRUST_CONTAINER_ENABLED: {
+			options.trust_container = true;
+		} break;
+	}
+	return options;
+}
+
+void FFmpegVideoStream::set_target_size(const Vector2i &p_target_size) {
+	target_size = p_target_size;
+}
+
+Vector2i FFmpegVideoStream::get_target_size() const {
+	return target_size;
+}
+
+void FFmpegVideoStream::set_sync_to_audio(bool p_sync_to_audio) {
+	sync_to_audio = p_sync_to_audio;
+}
+
+bool FFmpegVideoStream::get_sync_to_audio() const {
+	return sync_to_audio;
+}
+
+void FFmpegVideoStream::set_resample_audio_to_mix_rate(bool p_resample_audio_to_mix_rate) {
+	resample_audio_to_mix_rate = p_resample_audio_to_mix_rate;
+}
+
+bool FFmpegVideoStream::get_resample_audio_to_mix_rate() const {
+	return resample_audio_to_mix_rate;
+}
+
+void FFmpegVideoStream::set_async_preparation(bool p_async_preparation) {
+	async_preparation = p_async_preparation;
+}
+
+bool FFmpegVideoStream::get_async_preparation() const {
+	return async_preparation;
+}
+
+void FFmpegVideoStream::set_shared_decode(bool p_shared_decode) {
+	shared_decode = p_shared_decode;
+}
+
+bool FFmpegVideoStream::get_shared_decode() const {
+	return shared_decode;
+}
+
+void FFmpegVideoStream::set_shared_decode_group(const String &p_shared_decode_group) {
+	shared_decode_group = p_shared_decode_group;
+}
+
+String FFmpegVideoStream::get_shared_decode_group() const {
+	return shared_decode_group;
+}
+
+void FFmpegVideoStream::set_probe_size(int64_t p_probe_size) {
+	probe_size = p_probe_size;
+}
+
+int64_t FFmpegVideoStream::get_probe_size() const {
+	return probe_size;
+}
+
+void FFmpegVideoStream::set_probe_analyze_duration(int p_probe_analyze_duration) {
+	probe_analyze_duration = p_probe_analyze_duration;
+}
+
+int FFmpegVideoStream::get_probe_analyze_duration() const {
+	return probe_analyze_duration;
+}
+
+void FFmpegVideoStream::set_probe_format(const String &p_probe_format) {
+	probe_format = p_probe_format;
+}
+
+String FFmpegVideoStream::get_probe_format() const {
+	return probe_format;
+}
+
+void FFmpegVideoStream::set_probe_trust_container(ProbeTrustContainer p_probe_trust_container) {
+	probe_trust_container = p_probe_trust_container;
+}
+
+FFmpegVideoStream::ProbeTrustContainer FFmpegVideoStream::get_probe_trust_container() const {
+	return probe_trust_container;
+}
+
+void FFmpegVideoStream::set_loop(bool p_loop) {
+	loop = p_loop;
+}
+
+bool FFmpegVideoStream::get_loop() const {
+	return loop;
+}
+
+void FFmpegVideoStream::set_loop_cache_mode(LoopCacheMode p_loop_cache_mode) {
+	loop_cache_mode = p_loop_cache_mode;
+}
+
+FFmpegVideoStream::LoopCacheMode FFmpegVideoStream::get_loop_cache_mode() const {
+	return loop_cache_mode;
+}
+
+void FFmpegVideoStream::set_decode_profile(DecodeProfile p_decode_profile) {
+	decode_profile = p_decode_profile;
+}
+
+FFmpegVideoStream::DecodeProfile FFmpegVideoStream::get_decode_profile() const {
+	return decode_profile;
+}
+
+void FFmpegVideoStream::set_auto_decode_profile(bool p_auto_decode_profile) {
+	auto_decode_profile = p_auto_decode_profile;
+}
+
+bool FFmpegVideoStream::get_auto_decode_profile() const {
+	return auto_decode_profile;
+}
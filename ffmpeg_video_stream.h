@@ -52,17 +52,35 @@ using namespace godot;
 
 #endif
 
+#include "ffmpeg_loop_cache.h"
+#include "ffmpeg_metrics.h"
+#include "ffmpeg_quality_controller.h"
 #include "video_decoder.h"
 
 class YUVGPUConverter : public RefCounted {
+	struct PooledTexture {
+		RID texture;
+		RID uniform_set;
+		Vector2i size;
+		int format = 0;
+		uint32_t usage_bits = 0;
+	};
+
+	// Enough to keep a full set of plane and output textures for a previous frame size around
+	const int MAX_POOLED_TEXTURES = 10;
+
 	RID shader;
 	Ref<Image> yuv_plane_images[4];
-	RID yuv_plane_textures[4];
-	RID yuv_planes_uniform_sets[4];
+	Ref<Image> rgba_image;
+	PooledTexture yuv_plane_textures[4];
 	RID pipeline;
 	Ref<Texture2DRD> out_texture;
-	RID out_uniform_set;
+	PooledTexture out_texture_data;
+	Vector<PooledTexture> texture_pool;
 	Vector2i frame_size;
+	// Plane, output and pooled textures, snapshots are accounted for by the loop cache.
+	int64_t texture_memory = 0;
+	FFmpegMemoryAccount texture_memory_account{ FFmpegMemoryBudget::CATEGORY_GPU_TEXTURES };
 
 	struct PushConstant {
 		uint8_t use_alpha;
@@ -71,6 +89,12 @@ class YUVGPUConverter : public RefCounted {
 
 private:
 	void _ensure_pipeline();
+	Vector2i _get_plane_size(int p_plane_idx) const;
+	RID _create_texture(const Vector2i &p_size, int p_format, uint32_t p_usage_bits);
+	static int64_t _get_texture_memory(const PooledTexture &p_texture);
+	PooledTexture _acquire_texture(const Vector2i &p_size, int p_format, uint32_t p_usage_bits);
+	void _release_texture(PooledTexture &p_texture);
+	void _free_texture(PooledTexture &p_texture);
 	Error _ensure_plane_textures();
 	Error _ensure_output_texture();
 	RID _create_uniform_set(const RID &p_texture_rd_rid);
@@ -78,10 +102,15 @@ private:
 
 public:
 	void set_plane_image(int p_plane_idx, Ref<Image> p_image);
+	void set_rgba_image(Ref<Image> p_image);
 	Vector2i get_frame_size() const;
 	void set_frame_size(const Vector2i &p_frame_size);
 	void convert();
 	Ref<Texture2D> get_output_texture() const;
+	// Copies of the current output, presenting one again is a GPU copy instead of a conversion.
+	RID create_output_snapshot();
+	void present_snapshot(RID p_snapshot, const Vector2i &p_size);
+	void free_snapshot(RID p_snapshot);
 	YUVGPUConverter();
 	~YUVGPUConverter();
 };
@@ -93,11 +122,18 @@ class FFmpegVideoStreamPlayback : public VideoStreamPlayback {
 	GDCLASS(FFmpegVideoStreamPlayback, VideoStreamPlayback);
 
 	const int LENIENCE_BEFORE_SEEK = 2500;
+	// Audio is handed to the mixer in blocks of this many frames
+	const int AUDIO_MIX_BLOCK_SIZE = 1024;
+	// Frames shown more than this many milliseconds after their time are counted as late.
+	const double LATE_FRAME_THRESHOLD = 50.0;
+	// Milliseconds the audio clock may wait past the accepted audio before presentation goes back to the frame delta.
+	const double AUDIO_UNDERRUN_THRESHOLD = 50.0;
 	double playback_position = 0.0f;
 
 	Ref<VideoDecoder> decoder;
 	List<Ref<DecodedFrame>> available_frames;
 	List<Ref<DecodedAudioFrame>> available_audio_frames;
+	int64_t plotted_available_frames = 0;
 	Ref<DecodedFrame> last_frame;
 #ifndef FFMPEG_MT_GPU_UPLOAD
 	Ref<ImageTexture> last_frame_texture;
@@ -108,6 +144,7 @@ class FFmpegVideoStreamPlayback : public VideoStreamPlayback {
 	bool looping = false;
 	bool buffering = false;
 	int frames_processed = 0;
+	Vector2i target_size;
 	void seek_into_sync();
 	double get_current_frame_time();
 	bool check_next_frame_valid(Ref<DecodedFrame> p_decoded_frame);
@@ -115,9 +152,85 @@ class FFmpegVideoStreamPlayback : public VideoStreamPlayback {
 	bool paused = false;
 	bool playing = false;
 	bool just_seeked = false;
+	Vector2i frame_size;
+	// Set while the decoder is still opening and probing the input, playback starts once it is done.
+	// Audio is always resampled to the mix format then, the player sets up its audio before the input's format is known.
+	bool async_preparation = false;
+	bool preparing = false;
+	VideoDecoder::ProbeOptions probe_options;
+	// The decoder came from the pool already positioned at the start, the first play() doesn't have to seek.
+	bool decoder_prerolled = false;
+	bool audio_output_enabled = true;
+	// Whether load() may take a decoder from FFmpegDecoderPool and read the file from FFmpegMediaCache.
+	bool shared_caches_enabled = true;
+	// FFmpegVideoStream::DecodeProfile, resolved to the decoder's profile by _get_decoder_profile.
+	int decode_profile = 0;
+	// Steps down from decode_profile while decoding can't keep up.
+	bool auto_decode_profile = false;
+	FFmpegQualityController quality_controller;
+
+	// Shared decode: followers have no decoder of their own and forward everything to a leader playback.
+	// Playing, pausing and seeking are shared by all followers of a leader.
+	Ref<FFmpegVideoStreamPlayback> shared_leader;
+	String shared_key;
+	bool shared_playing = false;
+	// Leader only.
+	int shared_playing_count = 0;
+	uint64_t shared_last_update_frame = UINT64_MAX;
+
+	// Short silent clips are recorded during their first loop, later loops are presented from the cache without decoding.
+	FFmpegLoopCache::Mode loop_cache_mode = FFmpegLoopCache::MODE_DISABLED;
+	Ref<FFmpegLoopCache> loop_cache;
+	bool loop_cache_recording = false;
+	// Pass through the clip being recorded, the decoder's timestamps grow by one clip length per loop.
+	int loop_cache_pass = -1;
+	int loop_cache_frame = -1;
+
+	// When syncing to audio frames are presented according to the audio the mixer actually accepted instead of the frame delta.
+	bool sync_to_audio = false;
+	// Stream time at the end of the last block the mixer accepted audio from, counted from what mix_audio reports as taken.
+	double audio_clock_end_time = -1.0;
+	// Between accepted blocks the clock runs on the wall clock from this stream time, capped at audio_clock_end_time.
+	double audio_clock_anchor_time = 0.0;
+	uint64_t audio_clock_anchor_usec = 0;
+	bool resample_audio_to_mix_rate = false;
+	PackedFloat32Array audio_mix_buffer;
+	int audio_mix_buffer_frames = 0;
+	double audio_mix_buffer_start_time = 0.0;
+	double audio_mix_buffer_duration = 0.0;
 
 	Ref<YUVGPUConverter> yuv_converter;
 
+	FFmpegPlaybackMetrics metrics;
+	// Time the last seek was requested at, cleared once a frame after it was presented.
+	uint64_t seek_start_usec = 0;
+
+	bool _is_resampling_audio() const;
+	bool _is_audio_clock_active() const;
+	double _get_interpolated_audio_time() const;
+	double _get_audio_clock() const;
+	void _anchor_audio_clock();
+	void _check_audio_underrun();
+	void _reset_audio_output();
+	double _get_presentation_position() const;
+	void _mix_audio_frame(const Ref<DecodedAudioFrame> &p_audio_frame);
+	void _flush_audio_mix_buffer(int p_frame_count);
+	static Ref<FFmpegIOSource> _create_io_source(Ref<FileAccess> p_file_access);
+	static Ref<FFmpegIOSource> _create_file_io_source(Ref<FileAccess> p_file_access);
+	void _update_shared(double p_delta);
+	void _setup_output_texture();
+	void _create_decoder(Ref<FileAccess> p_file_access);
+	void _poll_preparation();
+	void _present_frame(const Ref<DecodedFrame> &p_frame);
+	void _setup_loop_cache();
+	void _update_loop_cache_recording(const Ref<DecodedFrame> &p_frame);
+	double _wrap_loop_time(double p_time) const;
+	bool _is_loop_cache_active() const;
+	void _update_loop_cache();
+	VideoDecoder::DecodeProfile _get_decoder_profile() const;
+	void _reset_quality_controller();
+	void _update_auto_decode_profile();
+
 private:
 	bool is_paused_internal() const;
 	void update_internal(double p_delta);
@@ -134,10 +247,46 @@ private:
 
 protected:
 	void clear();
-	static void _bind_methods() {}; // Required by GDExtension, do not remove
+	static void _bind_methods();
 
 public:
 	Error load(Ref<FileAccess> p_file_access);
+	// Opens the file and hands the running decoder over to the decoder pool, the playback can't be used afterwards.
+	Error prewarm(Ref<FileAccess> p_file_access);
+	// Identifies the file and every setting that changes what the decoder outputs.
+	String get_decode_key(const String &p_path) const;
+	void set_shared_leader(const String &p_key, Ref<FFmpegVideoStreamPlayback> p_leader);
+	void set_audio_output_enabled(bool p_enabled);
+	// Must be set before load, benchmarks turn it off so every playback pays for its own decoder and I/O.
+	void set_shared_caches_enabled(bool p_enabled);
+
+	// Decoded frames are downscaled to fit inside this size, must be set before load.
+	void set_target_size(const Vector2i &p_target_size);
+	Vector2i get_target_size() const;
+	void set_sync_to_audio(bool p_sync_to_audio);
+	bool get_sync_to_audio() const;
+	void set_resample_audio_to_mix_rate(bool p_resample_audio_to_mix_rate);
+	bool get_resample_audio_to_mix_rate() const;
+	// When enabled load() returns right away and the input is probed on the decoder thread, "prepared" is emitted once it's ready.
+	void set_async_preparation(bool p_async_preparation);
+	bool get_async_preparation() const;
+	bool is_preparing() const;
+	void set_probe_options(const VideoDecoder::ProbeOptions &p_probe_options);
+	// Looping playbacks never finish, the decoder wraps around to the start on its own. Must be set before load.
+	void set_looping(bool p_looping);
+	bool get_looping() const;
+	void set_loop_cache_mode(FFmpegLoopCache::Mode p_loop_cache_mode);
+	// Takes FFmpegVideoStream::DecodeProfile values and can be changed during playback, shared decode followers use the stream's profile.
+	void set_decode_profile(int p_decode_profile);
+	int get_decode_profile() const;
+	// Emits "decode_profile_changed" on every step, only on the leader for shared decodes.
+	void set_auto_decode_profile(bool p_auto_decode_profile);
+	bool get_auto_decode_profile() const;
+	// Throughput and stall counters of the I/O source the decoder reads from.
+	Dictionary get_io_statistics() const;
+	// Fills in this playback's counters, returns false for playbacks without a decoder of their own.
+	bool collect_metrics(FFmpegPlaybackMetrics &r_metrics);
+	Dictionary get_metrics();
 
 	STREAM_FUNC_REDIRECT_0_CONST(bool, is_paused);
 	STREAM_FUNC_REDIRECT_1(void, update, double, p_delta);
@@ -152,20 +301,70 @@ public:
 	STREAM_FUNC_REDIRECT_0_CONST(int, get_mix_rate);
 	STREAM_FUNC_REDIRECT_0_CONST(int, get_channels);
 	FFmpegVideoStreamPlayback();
+	~FFmpegVideoStreamPlayback();
 };
 
 class FFmpegVideoStream : public VideoStream {
 	GDCLASS(FFmpegVideoStream, VideoStream);
 
+public:
+	enum ProbeTrustContainer {
+		PROBE_TRUST_CONTAINER_PROJECT_DEFAULT,
+		PROBE_TRUST_CONTAINER_DISABLED,
+		PROBE_TRUST_CONTAINER_ENABLED,
+	};
+
+	// Same order as FFmpegLoopCache::Mode.
+	enum LoopCacheMode {
+		LOOP_CACHE_DISABLED,
+		LOOP_CACHE_RAM,
+		LOOP_CACHE_RAM_COMPRESSED,
+		LOOP_CACHE_VRAM,
+	};
+
+	// Same order as VideoDecoder::DecodeProfile after the project default.
+	enum DecodeProfile {
+		DECODE_PROFILE_PROJECT_DEFAULT,
+		DECODE_PROFILE_QUALITY,
+		DECODE_PROFILE_BALANCED,
+		DECODE_PROFILE_FAST,
+		DECODE_PROFILE_THUMBNAIL,
+	};
+
+private:
+	Vector2i target_size;
+	bool sync_to_audio = false;
+	bool resample_audio_to_mix_rate = false;
+	bool async_preparation = false;
+	// Negative or empty falls back to the ffmpeg/probing/ project settings.
+	int64_t probe_size = -1;
+	int probe_analyze_duration = -1;
+	String probe_format;
+	ProbeTrustContainer probe_trust_container = PROBE_TRUST_CONTAINER_PROJECT_DEFAULT;
+	// Playbacks of this file in the same group all show the output of one decoder. They are silent, the same audio
+	// can't sensibly be mixed from several places.
+	bool shared_decode = false;
+	String shared_decode_group;
+	bool loop = false;
+	LoopCacheMode loop_cache_mode = LOOP_CACHE_DISABLED;
+	DecodeProfile decode_profile = DECODE_PROFILE_PROJECT_DEFAULT;
+	bool auto_decode_profile = false;
+
+	VideoDecoder::ProbeOptions _get_probe_options() const;
+	Ref<FFmpegVideoStreamPlayback> _create_playback() const;
+	Ref<VideoStreamPlayback> _instantiate_shared_playback(Ref<FileAccess> p_file_access) const;
+
 protected:
-	static void _bind_methods() {}; // Required by GDExtension, do not remove
+	static void _bind_methods();
 	Ref<VideoStreamPlayback> instantiate_playback_internal() {
 		Ref<FileAccess> fa = FileAccess::open(get_file(), FileAccess::READ);
 		if (!fa.is_valid()) {
 			return Ref<VideoStreamPlayback>();
 		}
-		Ref<FFmpegVideoStreamPlayback> pb;
-		pb.instantiate();
+		if (shared_decode) {
+			return _instantiate_shared_playback(fa);
+		}
+		Ref<FFmpegVideoStreamPlayback> pb = _create_playback();
 		if (pb->load(fa) != OK) {
 			return nullptr;
 		}
@@ -173,7 +372,44 @@ protected:
 	}
 
 public:
+	// Opens the file and decodes its first frames ahead of time so the next playback of this stream can start instantly.
+	Error prewarm();
+
+	void set_target_size(const Vector2i &p_target_size);
+	Vector2i get_target_size() const;
+	void set_sync_to_audio(bool p_sync_to_audio);
+	bool get_sync_to_audio() const;
+	void set_resample_audio_to_mix_rate(bool p_resample_audio_to_mix_rate);
+	bool get_resample_audio_to_mix_rate() const;
+	void set_async_preparation(bool p_async_preparation);
+	bool get_async_preparation() const;
+	void set_shared_decode(bool p_shared_decode);
+	bool get_shared_decode() const;
+	void set_shared_decode_group(const String &p_shared_decode_group);
+	String get_shared_decode_group() const;
+	void set_probe_size(int64_t p_probe_size);
+	int64_t get_probe_size() const;
+	void set_probe_analyze_duration(int p_probe_analyze_duration);
+	int get_probe_analyze_duration() const;
+	void set_probe_format(const String &p_probe_format);
+	String get_probe_format() const;
+	void set_probe_trust_container(ProbeTrustContainer p_probe_trust_container);
+	ProbeTrustContainer get_probe_trust_container() const;
+	void set_loop(bool p_loop);
+	bool get_loop() const;
+	void set_loop_cache_mode(LoopCacheMode p_loop_cache_mode);
+	LoopCacheMode get_loop_cache_mode() const;
+	// Only affects playbacks created afterwards, use FFmpegVideoStreamPlayback.set_decode_profile to switch a running one.
+	void set_decode_profile(DecodeProfile p_decode_profile);
+	DecodeProfile get_decode_profile() const;
+	void set_auto_decode_profile(bool p_auto_decode_profile);
+	bool get_auto_decode_profile() const;
+
 	STREAM_FUNC_REDIRECT_0(Ref<VideoStreamPlayback>, instantiate_playback);
 };
 
+VARIANT_ENUM_CAST(FFmpegVideoStream::ProbeTrustContainer);
+VARIANT_ENUM_CAST(FFmpegVideoStream::LoopCacheMode);
+VARIANT_ENUM_CAST(FFmpegVideoStream::DecodeProfile);
+
 #endif // FFMPEG_VIDEO_STREAM_H
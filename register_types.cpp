@@ -32,14 +32,27 @@
 
 #ifdef GDEXTENSION
 #include "gdextension_build/gdex_print.h"
+#include <godot_cpp/classes/engine.hpp>
 #include <godot_cpp/classes/resource_loader.hpp>
 #else
+#include "core/config/engine.h"
 #include "core/string/print_string.h"
 #endif
 
+#include "ffmpeg_decoder_pool.h"
+#include "ffmpeg_media_cache.h"
+#include "ffmpeg_memory_budget.h"
+#include "ffmpeg_metrics.h"
+#include "ffmpeg_settings.h"
+#include "ffmpeg_shared_decode.h"
+#include "ffmpeg_trace.h"
 #include "ffmpeg_video_stream.h"
 #include "video_stream_ffmpeg_loader.h"
 
+#ifdef FFMPEG_BENCHMARKS
+#include "benchmarks/ffmpeg_benchmarks.h"
+#endif
+
 Ref<VideoStreamFFMpegLoader> ffmpeg_loader;
 
 static void print_codecs() {
@@ -74,9 +87,36 @@ void initialize_ffmpeg_module(ModuleInitializationLevel p_level) {
 		return;
 	}
 	print_codecs();
+	FFmpegSettings::register_settings();
+	FFmpegMemoryBudget::set_budget(FFmpegSettings::get_setting("ffmpeg/memory/budget"));
+	FFmpegMediaCache::initialize();
+	FFmpegDecoderPool::initialize();
+	FFmpegSharedDecodeRegistry::initialize();
 	GDREGISTER_ABSTRACT_CLASS(FFmpegVideoStreamPlayback);
 	GDREGISTER_ABSTRACT_CLASS(VideoStreamFFMpegLoader);
 	GDREGISTER_CLASS(FFmpegVideoStream);
+	GDREGISTER_ABSTRACT_CLASS(FFmpegMetrics);
+	memnew(FFmpegMetrics);
+#ifdef GDEXTENSION
+	Engine::get_singleton()->register_singleton("FFmpegMetrics", FFmpegMetrics::get_singleton());
+#else
+	Engine::get_singleton()->add_singleton(Engine::Singleton("FFmpegMetrics", FFmpegMetrics::get_singleton()));
+#endif
+	callable_mp(FFmpegMetrics::get_singleton(), &FFmpegMetrics::register_monitors).call_deferred();
+	GDREGISTER_ABSTRACT_CLASS(FFmpegTrace);
+	memnew(FFmpegTrace);
+#ifdef GDEXTENSION
+	Engine::get_singleton()->register_singleton("FFmpegTrace", FFmpegTrace::get_singleton());
+#else
+	Engine::get_singleton()->add_singleton(Engine::Singleton("FFmpegTrace", FFmpegTrace::get_singleton()));
+#endif
+	FFmpegTrace::set_thread_name("Main thread");
+	if (FFmpegSettings::get_setting("ffmpeg/trace/record_on_startup")) {
+		FFmpegTrace::get_singleton()->start();
+	}
+#ifdef FFMPEG_BENCHMARKS
+	GDREGISTER_ABSTRACT_CLASS(FFmpegBenchmarks);
+#endif
 	ffmpeg_loader.instantiate();
 #ifdef GDEXTENSION
 	ResourceLoader::get_singleton()->add_resource_format_loader(ffmpeg_loader);
@@ -95,6 +135,21 @@ void uninitialize_ffmpeg_module(ModuleInitializationLevel p_level) {
 	ResourceLoader::remove_resource_format_loader(ffmpeg_loader);
 #endif
 	ffmpeg_loader.unref();
+	FFmpegSharedDecodeRegistry::clear();
+	FFmpegDecoderPool::clear();
+	FFmpegMediaCache::clear();
+#ifdef GDEXTENSION
+	Engine::get_singleton()->unregister_singleton("FFmpegMetrics");
+#else
+	Engine::get_singleton()->remove_singleton("FFmpegMetrics");
+#endif
+	memdelete(FFmpegMetrics::get_singleton());
+#ifdef GDEXTENSION
+	Engine::get_singleton()->unregister_singleton("FFmpegTrace");
+#else
+	Engine::get_singleton()->remove_singleton("FFmpegTrace");
+#endif
+	memdelete(FFmpegTrace::get_singleton());
 }
 
 #ifdef GDEXTENSION
@@ -39,6 +39,34 @@
 
 #include "modules/tracy/tracy.gen.h"
 
+#ifndef TracySetThreadName
+#define TracySetThreadName(x) tracy::SetThreadName(x)
+#endif
+
+#ifdef GDEXTENSION
+#include <godot_cpp/templates/safe_refcount.hpp>
+#else
+#include "core/templates/safe_refcount.h"
+#endif
+
+// Plots the sum of a value over every instance reporting it, a plot name is shared by all decoders or playbacks.
+// Each instance keeps its own last reported value in r_reported and reports 0 when it goes away.
+class TracySumPlot {
+	const char *name;
+	SafeNumeric<int64_t> total;
+
+public:
+	void report(int64_t &r_reported, int64_t p_value) {
+		add(p_value - r_reported);
+		r_reported = p_value;
+	}
+	void add(int64_t p_delta) {
+		TracyPlot(name, total.add(p_delta));
+	}
+
+	TracySumPlot(const char *p_name) { name = p_name; }
+};
+
 #else
 
 #define ZoneNamed(x, y)
@@ -70,6 +98,27 @@
 #define FrameMarkStart(x)
 #define FrameMarkEnd(x)
 
+#define TracyPlot(x, y)
+#define TracyPlotConfig(x, y, z, w, a)
+
+#define TracyAlloc(x, y)
+#define TracyFree(x)
+#define TracyAllocN(x, y, z)
+#define TracyFreeN(x, y)
+
+#define TracyMessage(x, y)
+#define TracyMessageL(x)
+
+#define TracySetThreadName(x)
+
+class TracySumPlot {
+public:
+	void report(int64_t &r_reported, int64_t p_value) {}
+	void add(int64_t p_delta) {}
+
+	TracySumPlot(const char *p_name) {}
+};
+
 #endif
 
 #endif // TRACY_IMPORT_H
@@ -30,6 +30,7 @@
 
 #include "video_decoder.h"
 #include "ffmpeg_frame.h"
+#include "ffmpeg_trace.h"
 
 #include "libavcodec/codec.h"
 #include "libavcodec/codec_id.h"
@@ -45,9 +46,50 @@
 extern "C" {
 #include "libavformat/avformat.h"
 #include "libavformat/avio.h"
+#include "libavutil/imgutils.h"
 }
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FFMPEG_AUDIO_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FFMPEG_AUDIO_NEON
+#endif
+
 const int MAX_PENDING_FRAMES = 3;
+// Decode-ahead depth while over the memory budget.
+const int MIN_PENDING_FRAMES = 1;
+// Reference and in-flight frames a codec keeps per thread on top of the ones it is outputting, for the memory estimate.
+const int CODEC_REFERENCE_FRAMES = 4;
+
+static TracySumPlot decoder_queue_plot("FFmpeg decoder queue");
+static TracySumPlot pending_seeks_plot("FFmpeg pending seeks");
+
+struct DecodeProfileOptions {
+	AVDiscard skip_loop_filter;
+	AVDiscard skip_idct;
+	AVDiscard skip_frame;
+	bool fast;
+	// Each step halves the decoded size, only codecs with lowres support (mostly MPEG-1/2/4 and MJPEG) honor it.
+	int lowres;
+	int thread_type;
+};
+
+// Indexed by VideoDecoder::DecodeProfile.
+const DecodeProfileOptions DECODE_PROFILE_OPTIONS[] = {
+	{ AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, false, 0, FF_THREAD_FRAME | FF_THREAD_SLICE },
+	{ AVDISCARD_NONREF, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, true, 0, FF_THREAD_FRAME | FF_THREAD_SLICE },
+	{ AVDISCARD_ALL, AVDISCARD_NONREF, AVDISCARD_NONREF, true, 0, FF_THREAD_FRAME | FF_THREAD_SLICE },
+	// Frame threading only adds latency when every frame is a keyframe.
+	{ AVDISCARD_ALL, AVDISCARD_NONKEY, AVDISCARD_NONKEY, true, 2, FF_THREAD_SLICE },
+};
+const int MAX_POOLED_AUDIO_FRAMES = 32;
+// Tracy identifies memory pools by the name's pointer.
+static const char *const TRACY_DECODED_FRAMES_POOL = "FFmpeg decoded frames";
+
+// A first GOP larger than this isn't kept for looping, the loop seam falls back to seeking.
+const int64_t MAX_FIRST_GOP_CACHE_SIZE = 8 * 1024 * 1024;
 
 bool is_hardware_pixel_format(AVPixelFormat p_fmt) {
 	switch (p_fmt) {
@@ -74,6 +116,46 @@ bool is_hardware_pixel_format(AVPixelFormat p_fmt) {
 	return false;
 }
 
+// Interleaves planar float audio, stereo being by far the most common layout gets a SIMD path.
+static void interleave_planar_float(const float *const *p_planes, int p_channel_count, int p_sample_count, float *r_out) {
+	if (p_channel_count == 1) {
+		memcpy(r_out, p_planes[0], p_sample_count * sizeof(float));
+		return;
+	}
+
+	if (p_channel_count == 2) {
+		const float *left = p_planes[0];
+		const float *right = p_planes[1];
+		int i = 0;
+#if defined(FFMPEG_AUDIO_SSE2)
+		for (; i + 4 <= p_sample_count; i += 4) {
+			const __m128 l = _mm_loadu_ps(left + i);
+			const __m128 r = _mm_loadu_ps(right + i);
+			_mm_storeu_ps(r_out + i * 2, _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(r_out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+		}
+#elif defined(FFMPEG_AUDIO_NEON)
+		for (; i + 4 <= p_sample_count; i += 4) {
+			float32x4x2_t lr;
+			lr.val[0] = vld1q_f32(left + i);
+			lr.val[1] = vld1q_f32(right + i);
+			vst2q_f32(r_out + i * 2, lr);
+		}
+#endif
+		for (; i < p_sample_count; i++) {
+			r_out[i * 2] = left[i];
+			r_out[i * 2 + 1] = right[i];
+		}
+		return;
+	}
+
+	for (int i = 0; i < p_sample_count; i++) {
+		for (int channel = 0; channel < p_channel_count; channel++) {
+			r_out[i * p_channel_count + channel] = p_planes[channel][i];
+		}
+	}
+}
+
 String ffmpeg_get_error_message(int p_error_code) {
 	const uint64_t buffer_size = 256;
 	Vector<char> buffer;
@@ -90,53 +172,62 @@ String ffmpeg_get_error_message(int p_error_code) {
 
 int VideoDecoder::_read_packet_callback(void *p_opaque, uint8_t *p_buf, int p_buf_size) {
 	VideoDecoder *decoder = (VideoDecoder *)p_opaque;
-	uint64_t read_bytes = decoder->video_file->get_buffer(p_buf, p_buf_size);
-	return read_bytes != 0 ? read_bytes : AVERROR_EOF;
+	int read_bytes = decoder->io_source->read(p_buf, p_buf_size);
+	return read_bytes > 0 ? read_bytes : AVERROR_EOF;
 }
 
 int64_t VideoDecoder::_stream_seek_callback(void *p_opaque, int64_t p_offset, int p_whence) {
 	VideoDecoder *decoder = (VideoDecoder *)p_opaque;
-	switch (p_whence) {
-		case SEEK_CUR: {
-			decoder->video_file->seek(decoder->video_file->get_position() + p_offset);
-		} break;
-		case SEEK_SET: {
-			decoder->video_file->seek(p_offset);
-		} break;
-		case SEEK_END: {
-			decoder->video_file->seek_end(p_offset);
-		} break;
-		case AVSEEK_SIZE: {
-			return decoder->video_file->get_length();
-		} break;
-		default: {
-			return -1;
-		} break;
-	}
-	return decoder->video_file->get_position();
+	return decoder->io_source->seek(p_offset, p_whence & ~AVSEEK_FORCE);
+}
+
+int VideoDecoder::_interrupt_callback(void *p_opaque) {
+	VideoDecoder *decoder = (VideoDecoder *)p_opaque;
+	return decoder->thread_abort.is_set() ? 1 : 0;
 }
 
 void VideoDecoder::prepare_decoding() {
-	avio_seek(io_context, 0, SEEK_SET);
 	if (!io_context) {
-		const int context_buffer_size = 4096;
-		unsigned char *context_buffer = (unsigned char *)av_malloc(context_buffer_size);
-		io_context = avio_alloc_context(context_buffer, context_buffer_size, 0, this, &VideoDecoder::_read_packet_callback, nullptr, &VideoDecoder::_stream_seek_callback);
+		unsigned char *context_buffer = (unsigned char *)av_malloc(avio_buffer_size);
+		io_context = avio_alloc_context(context_buffer, avio_buffer_size, 0, this, &VideoDecoder::_read_packet_callback, nullptr, &VideoDecoder::_stream_seek_callback);
+		io_memory.set(avio_buffer_size);
+	} else {
+		avio_seek(io_context, 0, SEEK_SET);
 	}
 
 	format_context = avformat_alloc_context();
 	format_context->pb = io_context;
+	// Lets the destructor abort a probe that is still running on the decoder thread.
+	format_context->interrupt_callback.callback = &VideoDecoder::_interrupt_callback;
+	format_context->interrupt_callback.opaque = this;
 	format_context->flags |= AVFMT_FLAG_GENPTS;
 	format_context->video_codec = forced_video_codec;
 
-	int open_input_res = avformat_open_input(&format_context, "dummy", nullptr, nullptr);
+	if (probe_options.probe_size > 0) {
+		format_context->probesize = probe_options.probe_size;
+	}
+	if (probe_options.analyze_duration_usec > 0) {
+		format_context->max_analyze_duration = probe_options.analyze_duration_usec;
+	}
+
+	const AVInputFormat *input_format = nullptr;
+	if (!probe_options.format_name.is_empty()) {
+		input_format = av_find_input_format(probe_options.format_name.utf8().get_data());
+		if (input_format == nullptr) {
+			WARN_PRINT(vformat("Unknown input format \"%s\", falling back to probing.", probe_options.format_name));
+		}
+	}
+
+	int open_input_res = avformat_open_input(&format_context, "dummy", input_format, nullptr);
 	input_opened = open_input_res >= 0;
 	ERR_FAIL_COND_MSG(!input_opened, vformat("Error opening file or stream: %s", ffmpeg_get_error_message(open_input_res)));
 
 	AVCodec *codec = nullptr;
 
-	int find_stream_info_result = avformat_find_stream_info(format_context, nullptr);
-	ERR_FAIL_COND_MSG(find_stream_info_result < 0, vformat("Error finding stream info: %s", ffmpeg_get_error_message(find_stream_info_result)));
+	if (!probe_options.trust_container || !_has_complete_stream_parameters()) {
+		int find_stream_info_result = avformat_find_stream_info(format_context, nullptr);
+		ERR_FAIL_COND_MSG(find_stream_info_result < 0, vformat("Error finding stream info: %s", ffmpeg_get_error_message(find_stream_info_result)));
+	}
 
 	int stream_index = av_find_best_stream(format_context, AVMEDIA_TYPE_VIDEO, -1, -1, (const AVCodec **)&codec, 0);
 	ERR_FAIL_COND_MSG(stream_index < 0, vformat("Couldn't find video stream: %s", ffmpeg_get_error_message(stream_index)));
@@ -171,20 +262,78 @@ void VideoDecoder::prepare_decoding() {
 	}
 }
 
+bool VideoDecoder::_has_complete_stream_parameters() const {
+	bool has_video = false;
+	for (unsigned int i = 0; i < format_context->nb_streams; i++) {
+		const AVCodecParameters *codec_params = format_context->streams[i]->codecpar;
+		switch (codec_params->codec_type) {
+			case AVMEDIA_TYPE_VIDEO: {
+				if (codec_params->codec_id == AV_CODEC_ID_NONE || codec_params->width <= 0 || codec_params->height <= 0) {
+					return false;
+				}
+				has_video = true;
+			} break;
+			case AVMEDIA_TYPE_AUDIO: {
+				if (codec_params->codec_id == AV_CODEC_ID_NONE || codec_params->sample_rate <= 0 || codec_params->ch_layout.nb_channels <= 0) {
+					return false;
+				}
+			} break;
+			default: {
+			} break;
+		}
+	}
+	return has_video;
+}
+
 Error VideoDecoder::recreate_codec_context() {
 	if (video_stream == nullptr) {
 		return ERR_BUG;
 	}
 
-	AVCodecParameters codec_params = *video_stream->codecpar;
 	// YUV conversion needs rendering device
-	bool has_rendering_device = RenderingServer::get_singleton()->get_rendering_device() != nullptr;
-	bool is_yuv_pixel_fmt = codec_params.format == AVPixelFormat::AV_PIX_FMT_YUV420P || codec_params.format == AVPixelFormat::AV_PIX_FMT_YUVA420P;
-	if (is_yuv_pixel_fmt && has_rendering_device) {
-		frame_format = codec_params.format == AVPixelFormat::AV_PIX_FMT_YUV420P ? FFmpegFrameFormat::YUV420P : FFmpegFrameFormat::YUVA420P;
-	} else {
-		frame_format = FFmpegFrameFormat::RGBA8;
+	has_rendering_device = RenderingServer::get_singleton()->get_rendering_device() != nullptr;
+	frame_format = _get_output_frame_format((AVPixelFormat)video_stream->codecpar->format);
+
+	Error video_codec_error = _open_video_codec_context();
+	if (video_codec_error != OK) {
+		return video_codec_error;
+	}
+	print_line("Successfully initialized video decoder:", video_codec_context->codec->long_name);
+
+	if (!audio_stream) {
+		return OK;
+	}
+
+	AVCodecParameters codec_params = *audio_stream->codecpar;
+	const AVCodec *codec = avcodec_find_decoder(codec_params.codec_id);
+	if (codec) {
+		if (audio_codec_context != nullptr) {
+			avcodec_free_context(&audio_codec_context);
+		}
+		audio_codec_context = avcodec_alloc_context3(codec);
+		ERR_FAIL_COND_V_MSG(audio_codec_context == nullptr, FAILED, vformat("Couldn't allocate audio codec context: %s", codec->name));
+		audio_codec_context->pkt_timebase = audio_stream->time_base;
+
+		int param_copy_result = avcodec_parameters_to_context(audio_codec_context, audio_stream->codecpar);
+		ERR_FAIL_COND_V_MSG(param_copy_result < 0, FAILED, vformat("Couldn't copy codec parameters from %s: %s", codec->name, ffmpeg_get_error_message(param_copy_result)));
+		int open_codec_result = avcodec_open2(audio_codec_context, codec, nullptr);
+		ERR_FAIL_COND_V_MSG(open_codec_result < 0, ERR_CANT_OPEN, vformat("Error trying to open %s codec: %s", codec->name, ffmpeg_get_error_message(open_codec_result)));
+
+		// Unless asked otherwise, audio is output at the stream's own rate and layout.
+		audio_output_sample_rate = target_audio_sample_rate > 0 ? target_audio_sample_rate : audio_codec_context->sample_rate;
+		av_channel_layout_uninit(&audio_output_ch_layout);
+		if (target_audio_channel_count > 0) {
+			av_channel_layout_default(&audio_output_ch_layout, target_audio_channel_count);
+		} else {
+			av_channel_layout_copy(&audio_output_ch_layout, &audio_codec_context->ch_layout);
+		}
+		has_audio = true;
 	}
+	return OK;
+}
+
+Error VideoDecoder::_open_video_codec_context() {
+	AVCodecParameters codec_params = *video_stream->codecpar;
 
 	const AVCodec *decoder = forced_video_codec;
 	if (!decoder) {
@@ -203,48 +352,223 @@ Error VideoDecoder::recreate_codec_context() {
 	ERR_FAIL_COND_V_MSG(param_copy_result < 0, FAILED, vformat("Couldn't copy codec parameters from %s: %s", decoder->name, ffmpeg_get_error_message(param_copy_result)));
 
 	video_codec_context->thread_count = 0;
+	video_codec_context->thread_type = DECODE_PROFILE_OPTIONS[decode_profile].thread_type;
+	video_codec_context->lowres = _get_decode_profile_lowres(decoder);
+	_apply_decode_profile_options(video_codec_context);
 
 	int open_codec_result = avcodec_open2(video_codec_context, decoder, nullptr);
 	ERR_FAIL_COND_V_MSG(open_codec_result < 0, FAILED, vformat("Error trying to open %s codec: %s", decoder->name, ffmpeg_get_error_message(open_codec_result)));
 
-	print_line("Succesfully initialized video decoder:", decoder->long_name);
+	codec_memory.set(_estimate_codec_memory());
+	_set_decoded_size(Vector2i(video_codec_context->width, video_codec_context->height));
+	return OK;
+}
+
+void VideoDecoder::_apply_decode_profile_options(AVCodecContext *p_codec_context) const {
+	// Decoders read these for every frame, they can be changed on an open codec.
+	const DecodeProfileOptions &options = DECODE_PROFILE_OPTIONS[decode_profile];
+	p_codec_context->skip_loop_filter = options.skip_loop_filter;
+	p_codec_context->skip_idct = options.skip_idct;
+	p_codec_context->skip_frame = options.skip_frame;
+	if (options.fast) {
+		p_codec_context->flags2 |= AV_CODEC_FLAG2_FAST;
+	} else {
+		p_codec_context->flags2 &= ~AV_CODEC_FLAG2_FAST;
+	}
+}
 
-	ERR_FAIL_COND_V_MSG(video_codec_context == nullptr, ERR_CANT_CREATE, vformat("Error creating video codec context: Exhausted all available decoders for codec %s", avcodec_get_name(codec_params.codec_id)));
+int VideoDecoder::_get_decode_profile_lowres(const AVCodec *p_codec) const {
+	const int target_size_lowres = _get_lowres_for_target_size(p_codec, Vector2i(video_stream->codecpar->width, video_stream->codecpar->height));
+	return MAX(target_size_lowres, MIN(DECODE_PROFILE_OPTIONS[decode_profile].lowres, (int)p_codec->max_lowres));
+}
 
-	if (!audio_stream) {
-		return OK;
+void VideoDecoder::_set_decode_profile_command(DecodeProfile p_profile) {
+	if (p_profile == decode_profile) {
+		return;
+	}
+	decode_profile = p_profile;
+	if (decoder_state.get() == DecoderState::FAULTED || video_codec_context == nullptr) {
+		return;
 	}
 
-	codec_params = *audio_stream->codecpar;
-	const AVCodec *codec = avcodec_find_decoder(codec_params.codec_id);
-	if (codec) {
-		if (audio_codec_context != nullptr) {
-			avcodec_free_context(&audio_codec_context);
-		}
-		audio_codec_context = avcodec_alloc_context3(codec);
-		ERR_FAIL_COND_V_MSG(audio_codec_context == nullptr, FAILED, vformat("Couldn't allocate audio codec context: %s", codec->name));
-		audio_codec_context->pkt_timebase = audio_stream->time_base;
+	const bool needs_reopen = video_codec_context->thread_type != DECODE_PROFILE_OPTIONS[decode_profile].thread_type || video_codec_context->lowres != _get_decode_profile_lowres(video_codec_context->codec);
+	if (!needs_reopen) {
+		_apply_decode_profile_options(video_codec_context);
+		return;
+	}
 
-		int param_copy_result = avcodec_parameters_to_context(audio_codec_context, audio_stream->codecpar);
-		ERR_FAIL_COND_V_MSG(param_copy_result < 0, FAILED, vformat("Couldn't copy codec parameters from %s: %s", codec->name, ffmpeg_get_error_message(param_copy_result)));
-		int open_codec_result = avcodec_open2(audio_codec_context, codec, nullptr);
-		ERR_FAIL_COND_V_MSG(open_codec_result < 0, ERR_CANT_OPEN, vformat("Error trying to open %s codec: %s", codec->name, ffmpeg_get_error_message(open_codec_result)));
-		has_audio = true;
+	// Frames still inside the old codec are lost, the demuxer keeps going so audio isn't interrupted.
+	if (_open_video_codec_context() != OK) {
+		decoder_state.set(DecoderState::FAULTED);
+		return;
 	}
-	return OK;
+	wait_for_video_keyframe = true;
 }
 
 void VideoDecoder::_seek_command(double p_target_timestamp) {
+	pending_seeks.decrement();
+	pending_seeks_plot.add(-1);
+	if (decoder_state.get() == DecoderState::FAULTED) {
+		return;
+	}
 	avcodec_flush_buffers(video_codec_context);
-	av_seek_frame(format_context, video_stream->index, (long)(p_target_timestamp / video_time_base_in_seconds / 1000.0), AVSEEK_FLAG_BACKWARD);
+	// Seeks always land on a keyframe.
+	wait_for_video_keyframe = false;
+	int64_t target_video_timestamp = (int64_t)(p_target_timestamp / video_time_base_in_seconds / 1000.0);
+	// Frame times count from the stream's start time, packet timestamps don't (MPEG-TS and some MP4s don't start at 0).
+	if (video_stream->start_time != AV_NOPTS_VALUE) {
+		target_video_timestamp += video_stream->start_time;
+	}
+	const bool replaying = packet_cache.start_replay(target_video_timestamp);
+	if (!replaying) {
+		av_seek_frame(format_context, video_stream->index, target_video_timestamp, AVSEEK_FLAG_BACKWARD);
+		packet_cache.reset(video_stream->index, p_target_timestamp <= 0.0);
+	}
 	// No need to seek the audio stream separately since it is seeked automatically with the video stream
 	// due to being in the same file
 	if (has_audio) {
 		avcodec_flush_buffers(audio_codec_context);
+		_reset_swr_context();
 	}
 	skip_output_until_time = p_target_timestamp;
-	decoder_state = DecoderState::READY;
+	decoder_state.set(DecoderState::READY);
 	skip_current_outputs.clear();
+	discontinuity_count.increment();
+
+	loop_time_offset = 0.0;
+	first_gop_replay_index = -1;
+	skip_audio_packets_until_pts = AV_NOPTS_VALUE;
+	if (!first_gop_complete) {
+		// Only a pass that starts reading at the beginning of the file can record the first GOP, replayed packets never
+		// reach _cache_first_gop_packet so the demuxer has to be at the file start too.
+		_clear_first_gop();
+		first_gop_caching = looping && p_target_timestamp <= 0.0 && !replaying;
+	}
+}
+
+void VideoDecoder::_loop_to_start() {
+	ZoneScopedN("Video decoder loop");
+	// Codecs were drained already, every frame of this loop is out.
+	avcodec_flush_buffers(video_codec_context);
+	wait_for_video_keyframe = false;
+	if (has_audio) {
+		avcodec_flush_buffers(audio_codec_context);
+	}
+
+	if (packet_cache.start_replay_from_file_start()) {
+		// The whole clip is still cached, the demuxer stays at the end of the file.
+		discontinuity_count.increment();
+		first_gop_caching = false;
+		loop_time_offset += duration > 0.0 ? duration : last_frame_end_time;
+		last_frame_end_time = 0.0;
+		return;
+	}
+
+	if (first_gop_caching && first_gop_packets.size() > 0) {
+		// No second keyframe, the whole clip is cached and the demuxer can stay at the end of the file.
+		first_gop_complete = true;
+	}
+
+	int seek_result = -1;
+	if (first_gop_complete) {
+		seek_result = first_gop_end_pts != AV_NOPTS_VALUE ? av_seek_frame(format_context, video_stream->index, first_gop_end_pts, AVSEEK_FLAG_BACKWARD) : 0;
+		first_gop_replay_index = seek_result >= 0 ? 0 : -1;
+	}
+	if (seek_result < 0) {
+		seek_result = av_seek_frame(format_context, video_stream->index, 0, AVSEEK_FLAG_BACKWARD);
+	}
+	if (seek_result < 0) {
+		print_line(vformat("Failed to loop video: %s", ffmpeg_get_error_message(seek_result)));
+		decoder_state.set(DecoderState::END_OF_STREAM);
+		return;
+	}
+
+	discontinuity_count.increment();
+	first_gop_caching = false;
+	// Replayed first GOP packets are pushed again, the new stretch starts at the beginning of the file either way.
+	packet_cache.reset(video_stream->index, true);
+	loop_time_offset += duration > 0.0 ? duration : last_frame_end_time;
+	last_frame_end_time = 0.0;
+}
+
+void VideoDecoder::_cache_first_gop_packet(const AVPacket *p_packet) {
+	const bool is_video = p_packet->stream_index == video_stream->index;
+	if (!is_video && !(has_audio && p_packet->stream_index == audio_stream->index)) {
+		return;
+	}
+	if (is_video && (p_packet->flags & AV_PKT_FLAG_KEY) && first_gop_packets.size() > 0) {
+		// The next keyframe ends the first GOP, this is where demuxing resumes after replaying it.
+		first_gop_end_pts = p_packet->pts != AV_NOPTS_VALUE ? p_packet->pts : p_packet->dts;
+		first_gop_complete = first_gop_end_pts != AV_NOPTS_VALUE;
+		first_gop_caching = false;
+		if (!first_gop_complete) {
+			_clear_first_gop();
+		}
+		return;
+	}
+	first_gop_size += p_packet->size;
+	if (first_gop_size > MAX_FIRST_GOP_CACHE_SIZE) {
+		_clear_first_gop();
+		first_gop_caching = false;
+		return;
+	}
+	if (!is_video) {
+		first_gop_last_audio_pts = p_packet->pts;
+	}
+	first_gop_packets.push_back(av_packet_clone(p_packet));
+	first_gop_memory.set(first_gop_size);
+}
+
+void VideoDecoder::_clear_first_gop() {
+	for (AVPacket *packet : first_gop_packets) {
+		av_packet_free(&packet);
+	}
+	first_gop_packets.clear();
+	first_gop_size = 0;
+	first_gop_memory.set(0);
+	first_gop_end_pts = AV_NOPTS_VALUE;
+	first_gop_last_audio_pts = AV_NOPTS_VALUE;
+	first_gop_complete = false;
+	first_gop_replay_index = -1;
+}
+
+int VideoDecoder::_read_packet(AVPacket *p_packet) {
+	if (packet_cache.is_replaying() && packet_cache.read(p_packet)) {
+		return 0;
+	}
+
+	if (first_gop_replay_index >= 0) {
+		const int result = av_packet_ref(p_packet, first_gop_packets[first_gop_replay_index]);
+		first_gop_replay_index++;
+		if (first_gop_replay_index >= first_gop_packets.size()) {
+			first_gop_replay_index = -1;
+			skip_audio_packets_until_pts = first_gop_last_audio_pts;
+		}
+		if (result >= 0) {
+			packet_cache.push(p_packet);
+		}
+		return result;
+	}
+
+	while (true) {
+		const int result = av_read_frame(format_context, p_packet);
+		if (result < 0) {
+			return result;
+		}
+		if (skip_audio_packets_until_pts != AV_NOPTS_VALUE && has_audio && p_packet->stream_index == audio_stream->index) {
+			// Demuxing resumed at a video keyframe, audio interleaved before it was part of the replayed packets.
+			if (p_packet->pts != AV_NOPTS_VALUE && p_packet->pts <= skip_audio_packets_until_pts) {
+				av_packet_unref(p_packet);
+				continue;
+			}
+			skip_audio_packets_until_pts = AV_NOPTS_VALUE;
+		}
+		if (first_gop_caching) {
+			_cache_first_gop_packet(p_packet);
+		}
+		packet_cache.push(p_packet);
+		return result;
+	}
 }
 
 void VideoDecoder::_thread_func(void *userdata) {
@@ -253,24 +577,32 @@ void VideoDecoder::_thread_func(void *userdata) {
 	AVFrame *receive_frame = av_frame_alloc();
 
 #ifdef GDEXTENSION
-	String video_decoding_str = vformat("Video decoding %d", OS::get_singleton()->get_thread_caller_id());
+	String video_decoding_str = vformat("FFmpeg decoder %d", OS::get_singleton()->get_thread_caller_id());
 #else
-	String video_decoding_str = vformat("Video decoding %d", Thread::get_caller_id());
+	String video_decoding_str = vformat("FFmpeg decoder %d", Thread::get_caller_id());
 #endif
-	CharString str = video_decoding_str.utf8();
+	// Demuxing happens on this thread too.
+	TracySetThreadName(video_decoding_str.utf8().get_data());
+	FFmpegTrace::set_thread_name(video_decoding_str);
+
+	if (decoder->decoder_state.get() == DecoderState::PREPARING) {
+		// Publish the state only once everything is set up, the getters rely on it.
+		decoder->decoder_state.set(decoder->_prepare() ? DecoderState::READY : DecoderState::FAULTED);
+		decoder->preparation_semaphore.post();
+	}
+
 	while (!decoder->thread_abort.is_set()) {
-		switch (decoder->decoder_state) {
+		switch (decoder->decoder_state.get()) {
 			case READY:
 			case RUNNING: {
 				decoder->decoded_frames_mutex.lock();
-				bool needs_frame = decoder->decoded_frames.size() < MAX_PENDING_FRAMES;
+				const int queued_frames = decoder->decoded_frames.size();
 				decoder->decoded_frames_mutex.unlock();
-				if (needs_frame) {
-					FrameMarkStart(video_decoding);
+				decoder_queue_plot.report(decoder->plotted_queued_frames, queued_frames);
+				if (queued_frames < decoder->_get_max_pending_frames()) {
 					decoder->_decode_next_frame(packet, receive_frame);
-					FrameMarkEnd(video_decoding);
 				} else {
-					decoder->decoder_state = DecoderState::READY;
+					decoder->decoder_state.set(DecoderState::READY);
 					OS::get_singleton()->delay_usec(1000);
 				}
 			} break;
@@ -279,6 +611,10 @@ void VideoDecoder::_thread_func(void *userdata) {
 				// A Seek() operation will trigger a state change, allowing decoding to potentially start again.
 				OS::get_singleton()->delay_usec(50000);
 			} break;
+			case FAULTED: {
+				// Nothing left to decode, keep flushing commands so callers waiting on a seek don't hang.
+				OS::get_singleton()->delay_usec(50000);
+			} break;
 			default: {
 				ERR_PRINT("Invalid decoder state");
 			} break;
@@ -289,8 +625,8 @@ void VideoDecoder::_thread_func(void *userdata) {
 	av_packet_free(&packet);
 	av_frame_free(&receive_frame);
 
-	if (decoder->decoder_state != DecoderState::FAULTED) {
-		decoder->decoder_state = DecoderState::STOPPED;
+	if (decoder->decoder_state.get() != DecoderState::FAULTED) {
+		decoder->decoder_state.set(DecoderState::STOPPED);
 	}
 }
 
@@ -299,15 +635,25 @@ void VideoDecoder::_decode_next_frame(AVPacket *p_packet, AVFrame *p_receive_fra
 	int read_frame_result = 0;
 
 	if (p_packet->buf == nullptr) {
-		read_frame_result = av_read_frame(format_context, p_packet);
+		const uint64_t read_start = OS::get_singleton()->get_ticks_usec();
+		read_frame_result = _read_packet(p_packet);
+		const uint64_t read_end = OS::get_singleton()->get_ticks_usec();
+		pending_read_usec += read_end - read_start;
+		FFmpegTrace::record("read", read_start, read_end);
 	}
 
 	if (read_frame_result >= 0) {
-		decoder_state = DecoderState::RUNNING;
+		decoder_state.set(DecoderState::RUNNING);
 
 		bool unref_packet = true;
 
-		if (p_packet->stream_index == video_stream->index || p_packet->stream_index == audio_stream->index) {
+		if (wait_for_video_keyframe && p_packet->stream_index == video_stream->index) {
+			// A reopened codec has no reference frames, anything before the next keyframe would decode to garbage.
+			wait_for_video_keyframe = !(p_packet->flags & AV_PKT_FLAG_KEY);
+		}
+
+		const bool drop_packet = wait_for_video_keyframe && p_packet->stream_index == video_stream->index;
+		if (!drop_packet && (p_packet->stream_index == video_stream->index || p_packet->stream_index == audio_stream->index)) {
 			AVCodecContext *codec_ctx = video_codec_context;
 			if (has_audio && p_packet->stream_index == audio_stream->index) {
 				codec_ctx = audio_codec_context;
@@ -326,14 +672,16 @@ void VideoDecoder::_decode_next_frame(AVPacket *p_packet, AVFrame *p_receive_fra
 		_send_packet(video_codec_context, p_receive_frame, nullptr);
 		if (has_audio) {
 			_send_packet(audio_codec_context, p_receive_frame, nullptr);
+			_drain_swr_context();
+			_reset_swr_context();
 		}
 		if (looping) {
-			seek(0);
+			_loop_to_start();
 		} else {
-			decoder_state = DecoderState::END_OF_STREAM;
+			decoder_state.set(DecoderState::END_OF_STREAM);
 		}
 	} else if (read_frame_result == -EAGAIN) {
-		decoder_state = DecoderState::READY;
+		decoder_state.set(DecoderState::READY);
 		OS::get_singleton()->delay_usec(1000);
 	} else {
 		print_line(vformat("Failed to read data into avcodec packet: %s", ffmpeg_get_error_message(read_frame_result)));
@@ -346,7 +694,15 @@ int VideoDecoder::_send_packet(AVCodecContext *p_codec_context, AVFrame *p_recei
 	int send_packet_result;
 	{
 		ZoneNamedN(__avcodec_send_packet, "avcodec_send_packet", true);
+		const uint64_t send_start = OS::get_singleton()->get_ticks_usec();
 		send_packet_result = avcodec_send_packet(p_codec_context, p_packet);
+		const uint64_t send_end = OS::get_singleton()->get_ticks_usec();
+		if (p_codec_context == video_codec_context) {
+			pending_decode_usec += send_end - send_start;
+			FFmpegTrace::record("send_packet", send_start, send_end);
+		} else {
+			FFmpegTrace::record("send_audio_packet", send_start, send_end);
+		}
 	}
 	// Note: EAGAIN can be returned if there's too many pending frames, which we have to read,
 	// otherwise we would get stuck in an infinite loop.
@@ -368,7 +724,11 @@ void VideoDecoder::_read_decoded_frames(AVFrame *p_received_frame) {
 	PackedByteArray unwrapped_frame;
 	while (true) {
 		ZoneScopedN("Video decoder read decoded frame");
+		const uint64_t receive_start = OS::get_singleton()->get_ticks_usec();
 		int receive_frame_result = avcodec_receive_frame(video_codec_context, p_received_frame);
+		const uint64_t receive_end = OS::get_singleton()->get_ticks_usec();
+		pending_decode_usec += receive_end - receive_start;
+		FFmpegTrace::record("receive_frame", receive_start, receive_end);
 
 		if (receive_frame_result < 0) {
 			if (receive_frame_result != -EAGAIN && receive_frame_result != AVERROR_EOF) {
@@ -381,8 +741,13 @@ void VideoDecoder::_read_decoded_frames(AVFrame *p_received_frame) {
 		// use `best_effort_timestamp` as it can be more accurate if timestamps from the source file (pts) are broken.
 		int64_t frame_timestamp = p_received_frame->best_effort_timestamp != AV_NOPTS_VALUE ? p_received_frame->best_effort_timestamp : p_received_frame->pts;
 		double frame_time = (frame_timestamp - video_stream->start_time) * video_time_base_in_seconds * 1000.0;
+		last_frame_end_time = MAX(last_frame_end_time, frame_time + p_received_frame->duration * video_time_base_in_seconds * 1000.0);
+		frame_time += loop_time_offset;
 
 		if (skip_output_until_time > frame_time || skip_current_outputs.is_set()) {
+			// Catching up to a seek target isn't representative of regular decoding.
+			pending_read_usec = 0;
+			pending_decode_usec = 0;
 			continue;
 		}
 
@@ -393,9 +758,35 @@ void VideoDecoder::_read_decoded_frames(AVFrame *p_received_frame) {
 
 		last_decoded_frame_time.set(frame_time);
 
-		if (frame_format == FFmpegFrameFormat::YUV420P || frame_format == FFmpegFrameFormat::YUVA420P) {
-			// Special path for YUV images
-			Ref<DecodedFrame> yuv_frame = _unwrap_yuv_frame(frame_time, frame, frame_format);
+		// Size and pixel format are checked for every frame, adaptive streams and concatenated files can change them mid-stream.
+		const Vector2i frame_size = Vector2i(frame->get_frame()->width, frame->get_frame()->height);
+		_set_decoded_size(frame_size);
+		const Vector2i output_size = _get_output_size(frame_size);
+		const FFmpegFrameFormat out_format = _get_output_frame_format((AVPixelFormat)frame->get_frame()->format);
+
+		if (out_format == FFmpegFrameFormat::YUV420P || out_format == FFmpegFrameFormat::YUVA420P) {
+			// Special path for YUV images, planes are only scaled when a target size smaller than the frame was requested
+			if (output_size != frame_size) {
+				{
+					FFmpegTraceSpan convert_span("convert", frame_time);
+					frame = _ensure_frame_pixel_format(frame, (AVPixelFormat)frame->get_frame()->format, output_size);
+				}
+				if (!frame.is_valid()) {
+					continue;
+				}
+			}
+			Ref<DecodedFrame> yuv_frame;
+			{
+				FFmpegTraceSpan copy_span("copy", frame_time);
+				yuv_frame = _unwrap_yuv_frame(frame_time, frame, out_format);
+			}
+			frame->do_return();
+			const uint64_t convert_usec = OS::get_singleton()->get_ticks_usec() - receive_end;
+			conversion_time_usec.add(convert_usec);
+			_record_frame_timing(convert_usec);
+			decoded_frame_count.increment();
+			yuv_frame->track_memory();
+			yuv_frame->set_queued_usec(OS::get_singleton()->get_ticks_usec());
 			decoded_frames_mutex.lock();
 			if (!skip_current_outputs.is_set()) {
 				decoded_frames.push_back(yuv_frame);
@@ -405,31 +796,23 @@ void VideoDecoder::_read_decoded_frames(AVFrame *p_received_frame) {
 		}
 
 		// Note: this is the pixel format that the video texture expects internally
-		frame = _ensure_frame_pixel_format(frame, AVPixelFormat::AV_PIX_FMT_RGBA);
+		{
+			FFmpegTraceSpan convert_span("convert", frame_time);
+			frame = _ensure_frame_pixel_format(frame, AVPixelFormat::AV_PIX_FMT_RGBA, output_size);
+		}
 		if (!frame.is_valid()) {
 			continue;
 		}
 
-		ZoneNamedN(image_unwrap, "Image unwrap", true);
-		// Unwrap the image
-		int width = frame->get_frame()->width;
-		int height = frame->get_frame()->height;
 		{
-			ZoneNamedN(image_unwrap_copy, "Image unwrap copy", true);
-
-			int frame_size = frame->get_frame()->buf[0]->size; // Change this if we ever allow RGBA
-			unwrapped_frame.resize(frame_size);
-			uint8_t *unwrapped_frame_ptrw = unwrapped_frame.ptrw();
-			{
-				ZoneNamedN(image_unwrap_memcopy, "memcpy", true);
-				for (int y = 0; y < height; y++) {
-					memcpy(unwrapped_frame_ptrw, frame->get_frame()->data[0] + y * frame->get_frame()->linesize[0], width * 4);
-					unwrapped_frame_ptrw += width * 4;
-				}
-			}
-			unwrapped_frame.resize(width * height * 4);
-			image = Image::create_from_data(width, height, false, Image::FORMAT_RGBA8, unwrapped_frame);
+			FFmpegTraceSpan copy_span("copy", frame_time);
+			image = _unwrap_rgba_frame(frame, unwrapped_frame);
 		}
+		frame->do_return();
+		const uint64_t convert_usec = OS::get_singleton()->get_ticks_usec() - receive_end;
+		conversion_time_usec.add(convert_usec);
+		_record_frame_timing(convert_usec);
+		decoded_frame_count.increment();
 #ifdef FFMPEG_MT_GPU_UPLOAD
 		Ref<ImageTexture> tex;
 		available_textures_mutex.lock();
@@ -452,17 +835,34 @@ void VideoDecoder::_read_decoded_frames(AVFrame *p_received_frame) {
 		decoded_frames.push_back(memnew(DecodedFrame(frame_time, tex)));
 		decoded_frames_mutex.unlock();
 #else
+		Ref<DecodedFrame> rgba_frame = memnew(DecodedFrame(frame_time, image));
+		rgba_frame->track_memory();
+		rgba_frame->set_queued_usec(OS::get_singleton()->get_ticks_usec());
 		decoded_frames_mutex.lock();
 		if (!skip_current_outputs.is_set()) {
-			decoded_frames.push_back(memnew(DecodedFrame(frame_time, image)));
+			decoded_frames.push_back(rgba_frame);
 		}
 		decoded_frames_mutex.unlock();
 #endif
 	}
 }
 
+void VideoDecoder::_record_frame_timing(uint64_t p_convert_usec) {
+	if (collect_frame_timings.is_set()) {
+		FrameTiming timing;
+		timing.read_usec = pending_read_usec;
+		timing.decode_usec = pending_decode_usec;
+		timing.convert_usec = p_convert_usec;
+		MutexLock lock(frame_timings_mutex);
+		frame_timings.push_back(timing);
+	}
+	// Packets that didn't produce a frame on their own are attributed to the next frame that is output.
+	decode_time_usec.add(pending_decode_usec);
+	pending_read_usec = 0;
+	pending_decode_usec = 0;
+}
+
 void VideoDecoder::_read_decoded_audio_frames(AVFrame *p_received_frame) {
-	Vector<uint8_t> unwrapped_frame;
 	while (true) {
 		ZoneScopedN("Audio decoder read decoded frame");
 		int receive_frame_result = avcodec_receive_frame(audio_codec_context, p_received_frame);
@@ -477,25 +877,21 @@ void VideoDecoder::_read_decoded_audio_frames(AVFrame *p_received_frame) {
 
 		// use `best_effort_timestamp` as it can be more accurate if timestamps from the source file (pts) are broken.
 		int64_t frame_timestamp = p_received_frame->best_effort_timestamp != AV_NOPTS_VALUE ? p_received_frame->best_effort_timestamp : p_received_frame->pts;
-		double frame_time = (frame_timestamp - audio_stream->start_time) * audio_time_base_in_seconds * 1000.0;
+		double frame_time = (frame_timestamp - audio_stream->start_time) * audio_time_base_in_seconds * 1000.0 + loop_time_offset;
 
 		if (skip_output_until_time > frame_time || skip_current_outputs.is_set()) {
 			continue;
 		}
 
-		AVFrame *frame = _ensure_frame_audio_format(p_received_frame, AV_SAMPLE_FMT_FLT);
+		Ref<DecodedAudioFrame> audio_frame = _get_pooled_audio_frame(frame_time);
 
-		if (!frame) {
+		if (!_convert_audio_frame(p_received_frame, audio_frame->sample_data)) {
 			av_frame_unref(p_received_frame);
 			return;
 		}
+		swr_input_end_time = frame_time + p_received_frame->nb_samples * 1000.0 / p_received_frame->sample_rate;
+		audio_frame->update_memory_tracking();
 
-		ERR_FAIL_COND_MSG(av_sample_fmt_is_planar((AVSampleFormat)frame->format), "Audio format should never be planar, bug?");
-
-		int data_size = av_samples_get_buffer_size(nullptr, frame->ch_layout.nb_channels, frame->nb_samples, (AVSampleFormat)frame->format, 0);
-		Ref<DecodedAudioFrame> audio_frame = memnew(DecodedAudioFrame(frame_time));
-		audio_frame->sample_data.resize(data_size / sizeof(float));
-		memcpy(audio_frame->sample_data.ptrw(), frame->data[0], data_size);
 		audio_buffer_mutex.lock();
 		if (!skip_current_outputs.is_set()) {
 			decoded_audio_frames.push_back(audio_frame);
@@ -503,32 +899,85 @@ void VideoDecoder::_read_decoded_audio_frames(AVFrame *p_received_frame) {
 		audio_buffer_mutex.unlock();
 
 		av_frame_unref(p_received_frame);
-		if (frame != p_received_frame) {
-			av_frame_free(&frame);
+	}
+}
+
+Ref<DecodedAudioFrame> VideoDecoder::_get_pooled_audio_frame(double p_frame_time) {
+	Ref<DecodedAudioFrame> audio_frame;
+	{
+		MutexLock lock(audio_frame_pool_mutex);
+		if (audio_frame_pool.size() > 0) {
+			audio_frame = audio_frame_pool.front()->get();
+			audio_frame_pool.pop_front();
 		}
 	}
+
+	if (!audio_frame.is_valid()) {
+		return memnew(DecodedAudioFrame(p_frame_time));
+	}
+	audio_frame->set_time(p_frame_time);
+	return audio_frame;
 }
 
 void VideoDecoder::_scaler_frame_return(Ref<FFmpegFrame> p_scaler_frame) {
 	scaler_frames.push_back(p_scaler_frame);
 }
 
-Ref<FFmpegFrame> VideoDecoder::_ensure_frame_pixel_format(Ref<FFmpegFrame> p_frame, AVPixelFormat p_target_pixel_format) {
-	ZoneScopedN("Video decoder rescale");
+FFmpegFrameFormat VideoDecoder::_get_output_frame_format(AVPixelFormat p_pixel_format) const {
+	if (has_rendering_device) {
+		switch (p_pixel_format) {
+			case AVPixelFormat::AV_PIX_FMT_YUV420P: {
+				return FFmpegFrameFormat::YUV420P;
+			}
+			case AVPixelFormat::AV_PIX_FMT_YUVA420P: {
+				return FFmpegFrameFormat::YUVA420P;
+			}
+			default: {
+			} break;
+		}
+	}
+	return FFmpegFrameFormat::RGBA8;
+}
 
-	print_line(p_frame->get_frame()->format);
-	if (p_frame->get_frame()->format == p_target_pixel_format) {
-		return p_frame;
+Vector2i VideoDecoder::_get_output_size(const Vector2i &p_frame_size) const {
+	if (target_size.x <= 0 || target_size.y <= 0 || p_frame_size.x <= 0 || p_frame_size.y <= 0) {
+		return p_frame_size;
 	}
+	// Fit inside the target size keeping the aspect ratio, we never upscale.
+	const double scale = MIN(target_size.x / (double)p_frame_size.x, target_size.y / (double)p_frame_size.y);
+	if (scale >= 1.0) {
+		return p_frame_size;
+	}
+	return Vector2i(MAX(1, (int)Math::round(p_frame_size.x * scale)), MAX(1, (int)Math::round(p_frame_size.y * scale)));
+}
+
+int VideoDecoder::_get_lowres_for_target_size(const AVCodec *p_codec, const Vector2i &p_frame_size) const {
+	const Vector2i output_size = _get_output_size(p_frame_size);
+	int lowres = 0;
+	// Each lowres step halves the decoded size, stop before going below the output size so the scaler only ever has to downsample.
+	while (lowres < p_codec->max_lowres && (p_frame_size.x >> (lowres + 1)) >= output_size.x && (p_frame_size.y >> (lowres + 1)) >= output_size.y) {
+		lowres++;
+	}
+	return lowres;
+}
+
+Ref<FFmpegFrame> VideoDecoder::_ensure_frame_pixel_format(Ref<FFmpegFrame> p_frame, AVPixelFormat p_target_pixel_format, const Vector2i &p_target_size) {
+	ZoneScopedN("Video decoder rescale");
 
 	int width = p_frame->get_frame()->width;
 	int height = p_frame->get_frame()->height;
 
+	if (p_frame->get_frame()->format == p_target_pixel_format && width == p_target_size.x && height == p_target_size.y) {
+		return p_frame;
+	}
+
+	const bool is_downscaling = width != p_target_size.x || height != p_target_size.y;
+
 	sws_context = sws_getCachedContext(
 			sws_context,
 			width, height, (AVPixelFormat)p_frame->get_frame()->format,
-			width, height, p_target_pixel_format,
-			1, nullptr, nullptr, nullptr);
+			p_target_size.x, p_target_size.y, p_target_pixel_format,
+			is_downscaling ? SWS_AREA : SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
 
 	Ref<FFmpegFrame> scaler_frame;
 	{
@@ -544,21 +993,27 @@ Ref<FFmpegFrame> VideoDecoder::_ensure_frame_pixel_format(Ref<FFmpegFrame> p_fra
 	}
 
 	// (re)initialize the scaler frame if needed.
-	if (scaler_frame->get_frame()->format != p_target_pixel_format || scaler_frame->get_frame()->width != width || scaler_frame->get_frame()->height != height) {
+	if (scaler_frame->get_frame()->format != p_target_pixel_format || scaler_frame->get_frame()->width != p_target_size.x || scaler_frame->get_frame()->height != p_target_size.y) {
+		if (scaler_frame->get_frame()->buf[0] != nullptr) {
+			scaler_frame_memory -= av_image_get_buffer_size((AVPixelFormat)scaler_frame->get_frame()->format, scaler_frame->get_frame()->width, scaler_frame->get_frame()->height, 1);
+		}
 		av_frame_unref(scaler_frame->get_frame());
 
 		// Note: this field determines the scaler's output pix format.
 		scaler_frame->get_frame()->format = p_target_pixel_format;
-		scaler_frame->get_frame()->width = width;
-		scaler_frame->get_frame()->height = height;
+		scaler_frame->get_frame()->width = p_target_size.x;
+		scaler_frame->get_frame()->height = p_target_size.y;
 
 		int get_buffer_result = av_frame_get_buffer(scaler_frame->get_frame(), 0);
 
 		if (get_buffer_result < 0) {
+			scaler_memory.set(scaler_frame_memory);
 			print_line("Failed to allocate SWS frame buffer:", ffmpeg_get_error_message(get_buffer_result));
 			p_frame->do_return();
 			return Ref<FFmpegFrame>();
 		}
+		scaler_frame_memory += av_image_get_buffer_size(p_target_pixel_format, p_target_size.x, p_target_size.y, 1);
+		scaler_memory.set(scaler_frame_memory);
 	}
 
 	int scaler_result = sws_scale(
@@ -577,6 +1032,25 @@ Ref<FFmpegFrame> VideoDecoder::_ensure_frame_pixel_format(Ref<FFmpegFrame> p_fra
 	return scaler_frame;
 }
 
+Ref<Image> VideoDecoder::_unwrap_rgba_frame(Ref<FFmpegFrame> p_frame, PackedByteArray &r_buffer) {
+	ZoneScopedN("Image unwrap");
+	const int width = p_frame->get_frame()->width;
+	const int height = p_frame->get_frame()->height;
+
+	int frame_size = p_frame->get_frame()->buf[0]->size; // Change this if we ever allow RGBA
+	r_buffer.resize(frame_size);
+	uint8_t *unwrapped_frame_ptrw = r_buffer.ptrw();
+	{
+		ZoneNamedN(image_unwrap_memcopy, "memcpy", true);
+		for (int y = 0; y < height; y++) {
+			memcpy(unwrapped_frame_ptrw, p_frame->get_frame()->data[0] + y * p_frame->get_frame()->linesize[0], width * 4);
+			unwrapped_frame_ptrw += width * 4;
+		}
+	}
+	r_buffer.resize(width * height * 4);
+	return Image::create_from_data(width, height, false, Image::FORMAT_RGBA8, r_buffer);
+}
+
 Ref<DecodedFrame> VideoDecoder::_unwrap_yuv_frame(double p_frame_time, Ref<FFmpegFrame> p_frame, FFmpegFrameFormat p_out_format) {
 	PackedByteArray temp_frame_storage;
 	Ref<DecodedFrame> out_frame = memnew(DecodedFrame(p_frame_time, Ref<Image>()));
@@ -611,47 +1085,115 @@ Ref<DecodedFrame> VideoDecoder::_unwrap_yuv_frame(double p_frame_time, Ref<FFmpe
 	return out_frame;
 }
 
-AVFrame *VideoDecoder::_ensure_frame_audio_format(AVFrame *p_frame, AVSampleFormat p_target_audio_format) {
-	ZoneScopedN("Audio decoder rescale");
-	if (p_frame->format == p_target_audio_format) {
-		return p_frame;
+bool VideoDecoder::_ensure_swr_context(const AVFrame *p_frame) {
+	const bool input_changed = swr_context == nullptr || swr_input_format != p_frame->format || swr_input_sample_rate != p_frame->sample_rate || av_channel_layout_compare(&swr_input_ch_layout, &p_frame->ch_layout) != 0;
+	if (!input_changed) {
+		return true;
 	}
 
 	int obtain_swr_ctx_result = swr_alloc_set_opts2(
 			&swr_context,
-			&audio_codec_context->ch_layout, p_target_audio_format, audio_codec_context->sample_rate,
-			&audio_codec_context->ch_layout, audio_codec_context->sample_fmt, audio_codec_context->sample_rate,
+			&audio_output_ch_layout, AV_SAMPLE_FMT_FLT, audio_output_sample_rate,
+			&p_frame->ch_layout, (AVSampleFormat)p_frame->format, p_frame->sample_rate,
 			0, nullptr);
 
 	if (obtain_swr_ctx_result < 0) {
-		print_line("Failed to obtain SWR context");
-		return nullptr;
+		print_line("Failed to obtain SWR context:", ffmpeg_get_error_message(obtain_swr_ctx_result));
+		return false;
+	}
+
+	int init_swr_ctx_result = swr_init(swr_context);
+
+	if (init_swr_ctx_result < 0) {
+		print_line("Failed to initialize SWR context:", ffmpeg_get_error_message(init_swr_ctx_result));
+		swr_free(&swr_context);
+		return false;
 	}
-	AVFrame *out_frame;
 
-	out_frame = av_frame_alloc();
-	out_frame->format = p_target_audio_format;
-	out_frame->ch_layout = audio_codec_context->ch_layout;
-	out_frame->sample_rate = audio_codec_context->sample_rate;
-	out_frame->nb_samples = p_frame->nb_samples;
+	swr_input_format = p_frame->format;
+	swr_input_sample_rate = p_frame->sample_rate;
+	av_channel_layout_uninit(&swr_input_ch_layout);
+	av_channel_layout_copy(&swr_input_ch_layout, &p_frame->ch_layout);
+	return true;
+}
 
-	int get_buffer_result = av_frame_get_buffer(out_frame, 0);
+bool VideoDecoder::_convert_audio_frame(const AVFrame *p_frame, PackedFloat32Array &r_samples) {
+	ZoneScopedN("Audio decoder convert");
+	const int channel_count = audio_output_ch_layout.nb_channels;
+	const bool matches_output_layout = av_channel_layout_compare(&p_frame->ch_layout, &audio_output_ch_layout) == 0 && p_frame->sample_rate == audio_output_sample_rate;
 
-	if (get_buffer_result < 0) {
-		print_line("Failed to allocate SWR frame buffer:", ffmpeg_get_error_message(get_buffer_result));
-		av_frame_unref(out_frame);
-		return nullptr;
+	if (matches_output_layout && p_frame->format == AV_SAMPLE_FMT_FLT) {
+		r_samples.resize(p_frame->nb_samples * channel_count);
+		memcpy(r_samples.ptrw(), p_frame->data[0], r_samples.size() * sizeof(float));
+		return true;
 	}
 
-	int converter_result = swr_convert_frame(swr_context, out_frame, p_frame);
+	if (matches_output_layout && p_frame->format == AV_SAMPLE_FMT_FLTP) {
+		// AAC and Opus decode to planar float, skip swresample and interleave straight into the output.
+		r_samples.resize(p_frame->nb_samples * channel_count);
+		interleave_planar_float((const float *const *)p_frame->extended_data, channel_count, p_frame->nb_samples, r_samples.ptrw());
+		return true;
+	}
+
+	if (!_ensure_swr_context(p_frame)) {
+		return false;
+	}
+
+	const int out_sample_count = swr_get_out_samples(swr_context, p_frame->nb_samples);
+	r_samples.resize(out_sample_count * channel_count);
+	uint8_t *out_data[] = { (uint8_t *)r_samples.ptrw() };
+
+	int converter_result = swr_convert(swr_context, out_data, out_sample_count, (const uint8_t **)p_frame->extended_data, p_frame->nb_samples);
 
 	if (converter_result < 0) {
 		print_line("Failed to convert audio frame:", ffmpeg_get_error_message(converter_result));
-		av_frame_unref(out_frame);
-		return nullptr;
+		return false;
 	}
 
-	return out_frame;
+	r_samples.resize(converter_result * channel_count);
+	return true;
+}
+
+void VideoDecoder::_drain_swr_context() {
+	if (swr_context == nullptr || skip_current_outputs.is_set()) {
+		return;
+	}
+	const int out_sample_count = swr_get_out_samples(swr_context, 0);
+	if (out_sample_count <= 0) {
+		return;
+	}
+	// The held back samples end where the input ended.
+	Ref<DecodedAudioFrame> audio_frame = _get_pooled_audio_frame(swr_input_end_time - swr_get_delay(swr_context, 1000));
+	const int channel_count = audio_output_ch_layout.nb_channels;
+	audio_frame->sample_data.resize(out_sample_count * channel_count);
+	uint8_t *out_data[] = { (uint8_t *)audio_frame->sample_data.ptrw() };
+
+	int converter_result = swr_convert(swr_context, out_data, out_sample_count, nullptr, 0);
+	if (converter_result <= 0) {
+		if (converter_result < 0) {
+			print_line("Failed to drain audio resampler:", ffmpeg_get_error_message(converter_result));
+		}
+		return;
+	}
+	audio_frame->sample_data.resize(converter_result * channel_count);
+	audio_frame->update_memory_tracking();
+
+	MutexLock lock(audio_buffer_mutex);
+	if (!skip_current_outputs.is_set()) {
+		decoded_audio_frames.push_back(audio_frame);
+	}
+}
+
+void VideoDecoder::_reset_swr_context() {
+	if (swr_context == nullptr) {
+		return;
+	}
+	// Reinitializing keeps the parameters but clears all buffered samples.
+	int init_swr_ctx_result = swr_init(swr_context);
+	if (init_swr_ctx_result < 0) {
+		print_line("Failed to reset SWR context:", ffmpeg_get_error_message(init_swr_ctx_result));
+		swr_free(&swr_context);
+	}
 }
 
 String VideoDecoder::_codec_id_to_libvpx(AVCodecID p_codec_id) const {
@@ -680,6 +1222,8 @@ void VideoDecoder::seek(double p_time, bool p_wait) {
 	skip_current_outputs.set();
 	decoded_frames_mutex.unlock();
 	audio_buffer_mutex.unlock();
+	pending_seeks.increment();
+	pending_seeks_plot.add(1);
 	if (p_wait) {
 		decoder_commands.push_and_sync(this, &VideoDecoder::_seek_command, p_time);
 	} else {
@@ -687,14 +1231,28 @@ void VideoDecoder::seek(double p_time, bool p_wait) {
 	}
 }
 
-void VideoDecoder::start_decoding() {
+bool VideoDecoder::_prepare() {
+	if (io_source.is_null() && io_source_factory != nullptr) {
+		io_source = io_source_factory(io_source_file);
+		io_source_file.unref();
+	}
+	ERR_FAIL_COND_V_MSG(io_source.is_null(), false, "Couldn't open the input for decoding.");
+	prepare_decoding();
+	Error codec_context_create_error = recreate_codec_context();
+	if (video_stream == nullptr || codec_context_create_error != OK) {
+		return false;
+	}
+	packet_cache.reset(video_stream->index, true);
+	return true;
+}
+
+void VideoDecoder::start_decoding(bool p_threaded_preparation) {
 	ERR_FAIL_COND_MSG(thread != nullptr, "Cannot start decoding once already started");
 	if (format_context == nullptr) {
-		prepare_decoding();
-		Error codec_context_create_error = recreate_codec_context();
-
-		if (video_stream == nullptr || codec_context_create_error != OK) {
-			decoder_state = DecoderState::FAULTED;
+		if (p_threaded_preparation) {
+			decoder_state.set(DecoderState::PREPARING);
+		} else if (!_prepare()) {
+			decoder_state.set(DecoderState::FAULTED);
 			return;
 		}
 	}
@@ -721,6 +1279,13 @@ Vector<Ref<DecodedFrame>> VideoDecoder::get_decoded_frames() {
 	return frames;
 }
 
+void VideoDecoder::return_audio_frame(Ref<DecodedAudioFrame> p_frame) {
+	MutexLock lock(audio_frame_pool_mutex);
+	if (audio_frame_pool.size() < MAX_POOLED_AUDIO_FRAMES) {
+		audio_frame_pool.push_back(p_frame);
+	}
+}
+
 Vector<Ref<DecodedAudioFrame>> VideoDecoder::get_decoded_audio_frames() {
 	MutexLock lock(audio_buffer_mutex);
 	Vector<Ref<DecodedAudioFrame>> frames = decoded_audio_frames.duplicate();
@@ -729,7 +1294,15 @@ Vector<Ref<DecodedAudioFrame>> VideoDecoder::get_decoded_audio_frames() {
 }
 
 VideoDecoder::DecoderState VideoDecoder::get_decoder_state() const {
-	return decoder_state;
+	return decoder_state.get();
+}
+
+void VideoDecoder::wait_for_preparation() {
+	if (decoder_state.get() != DecoderState::PREPARING) {
+		return;
+	}
+	preparation_semaphore.wait();
+	preparation_semaphore.post();
 }
 
 double VideoDecoder::get_last_decoded_frame_time() const {
@@ -737,36 +1310,150 @@ double VideoDecoder::get_last_decoded_frame_time() const {
 }
 
 bool VideoDecoder::is_running() const {
-	return decoder_state == DecoderState::RUNNING;
+	return decoder_state.get() == DecoderState::RUNNING;
 }
 
 double VideoDecoder::get_duration() const {
+	if (decoder_state.get() == DecoderState::PREPARING) {
+		return 0.0;
+	}
 	return duration;
 }
 
+void VideoDecoder::_set_decoded_size(const Vector2i &p_size) {
+	if (p_size == last_decoded_size) {
+		return;
+	}
+	last_decoded_size = p_size;
+	MutexLock lock(decoded_size_mutex);
+	decoded_size = p_size;
+}
+
 Vector2i VideoDecoder::get_size() const {
-	if (video_codec_context) {
-		return Vector2i(video_codec_context->width, video_codec_context->height);
+	if (decoder_state.get() == DecoderState::PREPARING) {
+		return Vector2i();
 	}
-	return Vector2i();
+	MutexLock lock(decoded_size_mutex);
+	return _get_output_size(decoded_size);
+}
+
+void VideoDecoder::set_target_size(const Vector2i &p_target_size) {
+	ERR_FAIL_COND_MSG(thread != nullptr, "Target size must be set before decoding starts.");
+	target_size = p_target_size;
+}
+
+Vector2i VideoDecoder::get_target_size() const {
+	return target_size;
 }
 
 int VideoDecoder::get_audio_mix_rate() const {
-	if (audio_stream) {
-		return audio_codec_context->sample_rate;
+	if (decoder_state.get() != DecoderState::PREPARING && has_audio) {
+		return audio_output_sample_rate;
 	}
 	return 0;
 }
 
 int VideoDecoder::get_audio_channel_count() const {
-	if (audio_stream) {
-		return audio_codec_context->ch_layout.nb_channels;
+	if (decoder_state.get() != DecoderState::PREPARING && has_audio) {
+		return audio_output_ch_layout.nb_channels;
 	}
 	return 0;
 }
 
-VideoDecoder::VideoDecoder(Ref<FileAccess> p_file) {
-	video_file = p_file;
+void VideoDecoder::set_target_audio_format(int p_sample_rate, int p_channel_count) {
+	ERR_FAIL_COND_MSG(thread != nullptr, "Target audio format must be set before decoding starts.");
+	target_audio_sample_rate = p_sample_rate;
+	target_audio_channel_count = p_channel_count;
+}
+
+void VideoDecoder::set_avio_buffer_size(int p_size) {
+	ERR_FAIL_COND_MSG(io_context != nullptr, "AVIO buffer size must be set before decoding starts.");
+	avio_buffer_size = MAX(p_size, 4096);
+}
+
+void VideoDecoder::set_probe_options(const ProbeOptions &p_probe_options) {
+	ERR_FAIL_COND_MSG(format_context != nullptr, "Probe options must be set before decoding starts.");
+	probe_options = p_probe_options;
+}
+
+void VideoDecoder::set_packet_cache_size(int64_t p_size) {
+	ERR_FAIL_COND_MSG(thread != nullptr, "Packet cache size must be set before decoding starts.");
+	packet_cache.set_memory_limit(p_size);
+}
+
+void VideoDecoder::set_decode_profile(DecodeProfile p_profile) {
+	ERR_FAIL_INDEX(p_profile, DECODE_PROFILE_MAX);
+	if (thread == nullptr) {
+		decode_profile = p_profile;
+		return;
+	}
+	decoder_commands.push(this, &VideoDecoder::_set_decode_profile_command, p_profile);
+}
+
+void VideoDecoder::set_looping(bool p_looping) {
+	ERR_FAIL_COND_MSG(thread != nullptr, "Looping must be set before decoding starts.");
+	looping = p_looping;
+	// Decoding starts at the beginning of the file.
+	first_gop_caching = p_looping;
+}
+
+VideoDecoder::Statistics VideoDecoder::get_statistics() {
+	Statistics statistics;
+	statistics.decode_time_usec = decode_time_usec.get();
+	statistics.conversion_time_usec = conversion_time_usec.get();
+	statistics.decoded_frames = decoded_frame_count.get();
+	statistics.discontinuities = discontinuity_count.get();
+	MutexLock lock(decoded_frames_mutex);
+	statistics.queued_frames = decoded_frames.size();
+	return statistics;
+}
+
+int VideoDecoder::_get_max_pending_frames() const {
+	return FFmpegMemoryBudget::is_over_budget() ? MIN_PENDING_FRAMES : MAX_PENDING_FRAMES;
+}
+
+int64_t VideoDecoder::_estimate_codec_memory() const {
+	if (video_codec_context == nullptr) {
+		return 0;
+	}
+	const AVPixelFormat pixel_format = video_codec_context->pix_fmt != AV_PIX_FMT_NONE ? video_codec_context->pix_fmt : AV_PIX_FMT_YUV420P;
+	const int frame_memory = av_image_get_buffer_size(pixel_format, video_codec_context->width, video_codec_context->height, 1);
+	if (frame_memory <= 0) {
+		return 0;
+	}
+	return (int64_t)frame_memory * (MAX(video_codec_context->thread_count, 1) + CODEC_REFERENCE_FRAMES);
+}
+
+void VideoDecoder::set_collect_frame_timings(bool p_collect) {
+	collect_frame_timings.set_to(p_collect);
+}
+
+Vector<VideoDecoder::FrameTiming> VideoDecoder::take_frame_timings() {
+	MutexLock lock(frame_timings_mutex);
+	Vector<FrameTiming> timings = frame_timings;
+	frame_timings.clear();
+	return timings;
+}
+
+int64_t VideoDecoder::get_memory_usage() const {
+	const Vector2i size = get_size();
+	return (int64_t)size.x * size.y * 4 * MAX_PENDING_FRAMES + io_memory.get() + first_gop_memory.get() + packet_cache.get_memory_usage() + scaler_memory.get() + codec_memory.get();
+}
+
+Ref<FFmpegIOSource> VideoDecoder::get_io_source() const {
+	if (decoder_state.get() == DecoderState::PREPARING) {
+		return Ref<FFmpegIOSource>();
+	}
+	return io_source;
+}
+
+VideoDecoder::VideoDecoder(Ref<FFmpegIOSource> p_io_source) {
+	io_source = p_io_source;
+}
+
+VideoDecoder::VideoDecoder(Ref<FileAccess> p_file_access, IOSourceFactory p_io_source_factory) {
+	io_source_file = p_file_access;
+	io_source_factory = p_io_source_factory;
 }
 
 VideoDecoder::~VideoDecoder() {
@@ -775,6 +1462,11 @@ VideoDecoder::~VideoDecoder() {
 		thread->join();
 		memdelete(thread);
 	}
+	// Seeks still queued when the thread stopped never ran.
+	pending_seeks_plot.add(-pending_seeks.get());
+	decoder_queue_plot.report(plotted_queued_frames, 0);
+
+	_clear_first_gop();
 
 	if (format_context != nullptr && input_opened) {
 		avformat_close_input(&format_context);
@@ -795,6 +1487,8 @@ VideoDecoder::~VideoDecoder() {
 	if (swr_context != nullptr) {
 		swr_free(&swr_context);
 	}
+	av_channel_layout_uninit(&swr_input_ch_layout);
+	av_channel_layout_uninit(&audio_output_ch_layout);
 
 	if (io_context != nullptr) {
 		av_free(io_context->buffer);
@@ -813,8 +1507,38 @@ DecodedFrame::DecodedFrame(double p_time, Ref<Image> p_image) {
 	format = FFmpegFrameFormat::RGBA8;
 }
 
+DecodedFrame::~DecodedFrame() {
+	if (memory_tracked) {
+		TracyFreeN(this, TRACY_DECODED_FRAMES_POOL);
+		FFmpegMemoryBudget::add(FFmpegMemoryBudget::CATEGORY_DECODED_FRAMES, -tracked_memory);
+	}
+}
+
 Ref<ImageTexture> DecodedFrame::get_texture() const { return texture; }
 
+int64_t DecodedFrame::get_memory_usage() const {
+	int64_t memory_usage = image.is_valid() ? image->get_data().size() : 0;
+	for (size_t i = 0; i < std::size(yuv_images); i++) {
+		memory_usage += yuv_images[i].is_valid() ? yuv_images[i]->get_data().size() : 0;
+	}
+	return memory_usage;
+}
+
+void DecodedFrame::track_memory() {
+	ERR_FAIL_COND(memory_tracked);
+	memory_tracked = true;
+	tracked_memory = get_memory_usage();
+	TracyAllocN(this, tracked_memory, TRACY_DECODED_FRAMES_POOL);
+	FFmpegMemoryBudget::add(FFmpegMemoryBudget::CATEGORY_DECODED_FRAMES, tracked_memory);
+}
+
+Vector2i DecodedFrame::get_size() const {
+	if (format == FFmpegFrameFormat::RGBA8) {
+		return image.is_valid() ? image->get_size() : Vector2i();
+	}
+	return yuv_images[0].is_valid() ? yuv_images[0]->get_size() : Vector2i();
+}
+
 void DecodedFrame::set_texture(const Ref<ImageTexture> &p_texture) { texture = p_texture; }
 
 double DecodedFrame::get_time() const { return time; }
@@ -831,6 +1555,16 @@ Ref<Image> DecodedFrame::get_yuv_image_plane(int p_plane_idx) const {
 	return yuv_images[p_plane_idx];
 }
 
+void DecodedAudioFrame::update_memory_tracking() {
+	const int64_t memory = sample_data.size() * (int64_t)sizeof(float);
+	FFmpegMemoryBudget::add(FFmpegMemoryBudget::CATEGORY_AUDIO, memory - tracked_memory);
+	tracked_memory = memory;
+}
+
+DecodedAudioFrame::~DecodedAudioFrame() {
+	FFmpegMemoryBudget::add(FFmpegMemoryBudget::CATEGORY_AUDIO, -tracked_memory);
+}
+
 double DecodedAudioFrame::get_time() const {
 	return time;
 }
@@ -41,6 +41,7 @@
 #include <godot_cpp/classes/image_texture.hpp>
 #include <godot_cpp/classes/mutex.hpp>
 #include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/semaphore.hpp>
 #include <godot_cpp/core/mutex_lock.hpp>
 #include <godot_cpp/godot.hpp>
 #include <godot_cpp/templates/list.hpp>
@@ -50,6 +51,7 @@ using namespace godot;
 #else
 
 #include "core/io/file_access.h"
+#include "core/os/semaphore.h"
 #include "core/templates/command_queue_mt.h"
 #include "scene/resources/image_texture.h"
 
@@ -57,6 +59,9 @@ using namespace godot;
 
 #include "ffmpeg_codec.h"
 #include "ffmpeg_frame.h"
+#include "ffmpeg_io_source.h"
+#include "ffmpeg_memory_budget.h"
+#include "ffmpeg_packet_cache.h"
 extern "C" {
 #include "libavformat/avformat.h"
 #include "libswresample/swresample.h"
@@ -65,6 +70,8 @@ extern "C" {
 
 #include <thread>
 
+String ffmpeg_get_error_message(int p_error_code);
+
 enum FFmpegFrameFormat {
 	RGBA8,
 	YUV420P,
@@ -76,12 +83,16 @@ class DecodedFrame : public RefCounted {
 	Ref<ImageTexture> texture;
 	Ref<Image> image;
 	Ref<Image> yuv_images[4];
-	FFmpegFrameFormat format;
+	FFmpegFrameFormat format = FFmpegFrameFormat::RGBA8;
+	bool memory_tracked = false;
+	int64_t tracked_memory = 0;
+	uint64_t queued_usec = 0;
 
 public:
 	Ref<ImageTexture> get_texture() const;
 	void set_texture(const Ref<ImageTexture> &p_texture);
 	Ref<Image> get_image() const { return image; };
+	Vector2i get_size() const;
 
 	double get_time() const;
 	void set_time(double p_time);
@@ -91,6 +102,14 @@ public:
 
 	DecodedFrame(double p_time, Ref<ImageTexture> p_texture);
 	DecodedFrame(double p_time, Ref<Image> p_image);
+	~DecodedFrame();
+
+	int64_t get_memory_usage() const;
+	// Reports the frame's buffers to Tracy and FFmpegMemoryBudget until it is destroyed, only frames coming out of the decoder are tracked.
+	void track_memory();
+	// When the decoder handed the frame over, for tracing how long it waited to be presented. 0 once it has been presented.
+	uint64_t get_queued_usec() const { return queued_usec; }
+	void set_queued_usec(uint64_t p_queued_usec) { queued_usec = p_queued_usec; }
 
 	FFmpegFrameFormat get_format() const { return format; }
 	void set_format(const FFmpegFrameFormat &p_format) { format = p_format; }
@@ -98,12 +117,17 @@ public:
 
 class DecodedAudioFrame : public RefCounted {
 	double time;
+	int64_t tracked_memory = 0;
 
 public:
 	PackedFloat32Array sample_data;
 	double get_time() const;
+	void set_time(double p_time) { time = p_time; }
 	PackedFloat32Array get_sample_data() const;
+	// Reports the current size of sample_data to FFmpegMemoryBudget, called after it was filled.
+	void update_memory_tracking();
 	DecodedAudioFrame(double p_time) { time = p_time; };
+	~DecodedAudioFrame();
 };
 
 class VideoDecoder : public RefCounted {
@@ -119,15 +143,58 @@ public:
 		APPLE_VIDEOTOOLBOX = 64,
 		ANY = INT_MAX,
 	};
+	// How much of the input libavformat may read and decode before playback starts, zero or empty means FFmpeg's default.
+	struct ProbeOptions {
+		int64_t probe_size = 0;
+		int64_t analyze_duration_usec = 0;
+		String format_name;
+		// Skip avformat_find_stream_info when the container header already describes the streams well enough.
+		bool trust_container = false;
+	};
+	// Cumulative since the decoder was created, conversion covers scaling and copying frames out of FFmpeg.
+	// Frames decoded only to reach a seek target aren't counted, neither is the time spent on them.
+	struct Statistics {
+		uint64_t decode_time_usec = 0;
+		uint64_t conversion_time_usec = 0;
+		uint64_t decoded_frames = 0;
+		int queued_frames = 0;
+		// Seeks and loops done so far.
+		uint64_t discontinuities = 0;
+	};
+	// Time spent on each pipeline stage for a single output frame, read and decode time of packets
+	// that didn't produce a frame is attributed to the next frame that does.
+	struct FrameTiming {
+		uint64_t read_usec = 0;
+		uint64_t decode_usec = 0;
+		uint64_t convert_usec = 0;
+	};
+	// Trade picture quality for decoding speed, from untouched output down to keyframes only at reduced resolution.
+	enum DecodeProfile {
+		DECODE_PROFILE_QUALITY,
+		// Skips the loop filter on non-reference frames and allows non spec compliant speedups.
+		DECODE_PROFILE_BALANCED,
+		// Skips the loop filter and non-reference frames entirely, visible blocking and a lower frame rate.
+		DECODE_PROFILE_FAST,
+		// Keyframes only, decoded at reduced resolution where the codec supports it.
+		DECODE_PROFILE_THUMBNAIL,
+		DECODE_PROFILE_MAX,
+	};
 	enum DecoderState {
 		READY,
 		RUNNING,
 		FAULTED,
 		END_OF_STREAM,
-		STOPPED
+		STOPPED,
+		// Probing the input and opening the codecs on the decoder thread.
+		PREPARING
 	};
+	typedef Ref<FFmpegIOSource> (*IOSourceFactory)(Ref<FileAccess> p_file_access);
 
 private:
+#ifdef FFMPEG_BENCHMARKS
+	// Microbenchmarks call the conversion paths directly.
+	friend class FFmpegBenchmarks;
+#endif
 	FFmpegFrameFormat frame_format;
 	Vector<Ref<DecodedAudioFrame>> decoded_audio_frames;
 
@@ -135,7 +202,23 @@ private:
 
 	SwsContext *sws_context = nullptr;
 	SwrContext *swr_context = nullptr;
-	DecoderState decoder_state = DecoderState::READY;
+	// Input parameters the resampler was initialized with, it is only rebuilt when these change.
+	int swr_input_format = -1;
+	int swr_input_sample_rate = 0;
+	AVChannelLayout swr_input_ch_layout = {};
+	// Stream time right after the last audio frame that went into the resampler.
+	double swr_input_end_time = 0.0;
+	// Rate and layout audio is converted to on the decoder thread, zero keeps the stream's own.
+	int target_audio_sample_rate = 0;
+	int target_audio_channel_count = 0;
+	int audio_output_sample_rate = 0;
+	AVChannelLayout audio_output_ch_layout = {};
+	Mutex audio_frame_pool_mutex;
+	List<Ref<DecodedAudioFrame>> audio_frame_pool;
+	// Read by the playback while the decoder thread updates it.
+	SafeNumeric<DecoderState> decoder_state{ DecoderState::READY };
+	// Posted once threaded preparation is over, wait_for_preparation passes it on so every waiter wakes up.
+	Semaphore preparation_semaphore;
 	mutable CommandQueueMT decoder_commands;
 	AVStream *video_stream = nullptr;
 	AVStream *audio_stream = nullptr;
@@ -146,13 +229,36 @@ private:
 	bool input_opened = false;
 	bool has_audio = false;
 	bool hw_decoding_allowed = false;
+	bool has_rendering_device = false;
 	double video_time_base_in_seconds;
 	double audio_time_base_in_seconds;
 	double duration;
+	// Size of the frames coming out of the codec, the codec context itself is only touched by the decoder thread.
+	mutable Mutex decoded_size_mutex;
+	Vector2i decoded_size;
+	// Decoder thread copy, avoids locking for every frame.
+	Vector2i last_decoded_size;
 	double skip_output_until_time = -1.0;
 	SafeFlag skip_current_outputs;
-	SafeNumeric<float> last_decoded_frame_time;
-	Ref<FileAccess> video_file;
+	// Milliseconds, they keep growing while looping so float precision would run out after a few hours.
+	SafeNumeric<double> last_decoded_frame_time;
+	SafeNumeric<uint64_t> decode_time_usec;
+	SafeNumeric<uint64_t> conversion_time_usec;
+	SafeNumeric<uint64_t> decoded_frame_count;
+	SafeNumeric<int> pending_seeks;
+	SafeNumeric<uint64_t> discontinuity_count;
+	SafeFlag collect_frame_timings;
+	// Only touched by the decoder thread.
+	uint64_t pending_read_usec = 0;
+	uint64_t pending_decode_usec = 0;
+	int64_t plotted_queued_frames = 0;
+	Mutex frame_timings_mutex;
+	Vector<FrameTiming> frame_timings;
+	Ref<FFmpegIOSource> io_source;
+	// The I/O source is only built while preparing when these are set, opening it can mean reading the whole file.
+	Ref<FileAccess> io_source_file;
+	IOSourceFactory io_source_factory = nullptr;
+	int avio_buffer_size = 65536;
 	BitField<HardwareVideoDecoder> target_hw_video_decoders = HardwareVideoDecoder::ANY;
 	Mutex available_textures_mutex;
 	List<Ref<ImageTexture>> available_textures;
@@ -165,29 +271,87 @@ private:
 	std::thread *thread = nullptr;
 	SafeFlag thread_abort;
 	AVCodec const *forced_video_codec = nullptr;
+	// Bounding box the decoded frames are scaled down to fit into, zero means native size.
+	Vector2i target_size;
+	// Only touched by the decoder thread once decoding started.
+	DecodeProfile decode_profile = DECODE_PROFILE_QUALITY;
+	// The video codec was reopened mid-stream, packets are dropped until it can start decoding again.
+	bool wait_for_video_keyframe = false;
+	ProbeOptions probe_options;
 
+	// Looping wraps around on the decoder thread instead of seeking, timestamps keep growing by one clip length per loop
+	// so the frames of the next loop queue up behind the current ones without the queue being flushed.
 	bool looping = false;
+	double loop_time_offset = 0.0;
+	double last_frame_end_time = 0.0;
+	// Packets of the clip's first GOP, replayed at the loop seam so only the rest of the file has to be read again.
+	// Demuxing resumes at first_gop_end_pts, the keyframe following the cached GOP.
+	Vector<AVPacket *> first_gop_packets;
+	int64_t first_gop_size = 0;
+	FFmpegMemoryAccount first_gop_memory{ FFmpegMemoryBudget::CATEGORY_PACKETS };
+	// Buffers of the frames used as scaler output, pooled in scaler_frames while not in use.
+	int64_t scaler_frame_memory = 0;
+	FFmpegMemoryAccount scaler_memory{ FFmpegMemoryBudget::CATEGORY_SCALER_FRAMES };
+	// Estimate of what libavcodec keeps internally, see _estimate_codec_memory.
+	FFmpegMemoryAccount codec_memory{ FFmpegMemoryBudget::CATEGORY_CODEC };
+	FFmpegMemoryAccount io_memory{ FFmpegMemoryBudget::CATEGORY_IO };
+	int64_t first_gop_end_pts = AV_NOPTS_VALUE;
+	int64_t first_gop_last_audio_pts = AV_NOPTS_VALUE;
+	bool first_gop_caching = false;
+	bool first_gop_complete = false;
+	int first_gop_replay_index = -1;
+	// Audio packets up to this one were already replayed from the cache.
+	int64_t skip_audio_packets_until_pts = AV_NOPTS_VALUE;
+	// Seeks and loops inside the recently demuxed stretch of the file replay packets from memory.
+	FFmpegPacketCache packet_cache;
 
 	static int _read_packet_callback(void *p_opaque, uint8_t *p_buf, int p_buf_size);
 	static int64_t _stream_seek_callback(void *p_opaque, int64_t p_offset, int p_whence);
 	void prepare_decoding();
+	bool _has_complete_stream_parameters() const;
+	bool _prepare();
+	static int _interrupt_callback(void *p_opaque);
 	Error recreate_codec_context();
+	Error _open_video_codec_context();
+	void _apply_decode_profile_options(AVCodecContext *p_codec_context) const;
+	int _get_decode_profile_lowres(const AVCodec *p_codec) const;
+	void _set_decode_profile_command(DecodeProfile p_profile);
 	static HardwareVideoDecoder from_av_hw_device_type(AVHWDeviceType p_device_type);
 
 	void _seek_command(double p_target_timestamp);
+	void _loop_to_start();
+	void _cache_first_gop_packet(const AVPacket *p_packet);
+	void _clear_first_gop();
+	int _read_packet(AVPacket *p_packet);
 	static void _thread_func(void *userdata);
 	void _decode_next_frame(AVPacket *p_packet, AVFrame *p_receive_frame);
 	int _send_packet(AVCodecContext *p_codec_context, AVFrame *p_receive_frame, AVPacket *p_packet);
 	void _try_disable_hw_decoding(int p_error_code);
 	void _read_decoded_frames(AVFrame *p_received_frame);
+	void _record_frame_timing(uint64_t p_convert_usec);
+	void _set_decoded_size(const Vector2i &p_size);
+	// Fewer frames are decoded ahead while FFmpegMemoryBudget is over budget.
+	int _get_max_pending_frames() const;
+	int64_t _estimate_codec_memory() const;
 	void _read_decoded_audio_frames(AVFrame *p_received_frame);
 
 	void _hw_transfer_frame_return(Ref<FFmpegFrame> p_hw_frame);
 	void _scaler_frame_return(Ref<FFmpegFrame> p_hw_frame);
 
-	Ref<FFmpegFrame> _ensure_frame_pixel_format(Ref<FFmpegFrame> p_frame, AVPixelFormat p_target_pixel_format);
+	FFmpegFrameFormat _get_output_frame_format(AVPixelFormat p_pixel_format) const;
+	Vector2i _get_output_size(const Vector2i &p_frame_size) const;
+	int _get_lowres_for_target_size(const AVCodec *p_codec, const Vector2i &p_frame_size) const;
+	Ref<FFmpegFrame> _ensure_frame_pixel_format(Ref<FFmpegFrame> p_frame, AVPixelFormat p_target_pixel_format, const Vector2i &p_target_size);
 	Ref<DecodedFrame> _unwrap_yuv_frame(double p_frame_time, Ref<FFmpegFrame> p_frame, FFmpegFrameFormat p_out_format);
-	AVFrame *_ensure_frame_audio_format(AVFrame *p_frame, AVSampleFormat p_target_audio_format);
+	// Copies the RGBA frame out of FFmpeg's padded rows, r_buffer is reused between frames.
+	Ref<Image> _unwrap_rgba_frame(Ref<FFmpegFrame> p_frame, PackedByteArray &r_buffer);
+	Ref<DecodedAudioFrame> _get_pooled_audio_frame(double p_frame_time);
+	bool _ensure_swr_context(const AVFrame *p_frame);
+	bool _convert_audio_frame(const AVFrame *p_frame, PackedFloat32Array &r_samples);
+	// Outputs the samples the resampler still holds back, needed once no more input follows.
+	void _drain_swr_context();
+	// Drops whatever the resampler holds back, its filter history belongs to audio before a discontinuity.
+	void _reset_swr_context();
 	String _codec_id_to_libvpx(AVCodecID p_codec_id) const;
 
 public:
@@ -196,22 +360,46 @@ public:
 		AVHWDeviceType device_type;
 	};
 	void seek(double p_time, bool p_wait = false);
-	void start_decoding();
+	// With p_threaded_preparation the input is probed on the decoder thread and the decoder stays PREPARING until that's done.
+	void start_decoding(bool p_threaded_preparation = false);
 	Vector<AvailableDecoderInfo> get_available_video_decoders(const AVInputFormat *p_format, AVCodecID p_codec_id, BitField<HardwareVideoDecoder> p_target_decoders);
 	void return_frames(Vector<Ref<DecodedFrame>> p_frames);
 	void return_frame(Ref<DecodedFrame> p_frame);
 	Vector<Ref<DecodedFrame>> get_decoded_frames();
+	void return_audio_frame(Ref<DecodedAudioFrame> p_frame);
 	Vector<Ref<DecodedAudioFrame>> get_decoded_audio_frames();
 	DecoderState get_decoder_state() const;
+	// Blocks until threaded preparation is over, returns right away if the decoder isn't preparing.
+	void wait_for_preparation();
 	double get_last_decoded_frame_time() const;
 	bool is_running() const;
 	double get_duration() const;
 	Vector2i get_size() const;
+	void set_target_size(const Vector2i &p_target_size);
+	Vector2i get_target_size() const;
 	int get_audio_mix_rate() const;
 	int get_audio_channel_count() const;
+	void set_target_audio_format(int p_sample_rate, int p_channel_count);
+	void set_avio_buffer_size(int p_size);
+	void set_probe_options(const ProbeOptions &p_probe_options);
+	void set_looping(bool p_looping);
+	// Can be changed while decoding, options that need the codec reopened take effect at the next keyframe.
+	void set_decode_profile(DecodeProfile p_profile);
+	// Memory for compressed packets kept around for seeking and looping, 0 disables the packet cache.
+	void set_packet_cache_size(int64_t p_size);
+	// Estimate of the memory held by frames waiting to be presented, the AVIO buffer, cached packets and the scaler, codec internals are estimated from the frame size.
+	int64_t get_memory_usage() const;
+	Statistics get_statistics();
+	// Per frame timings are meant for benchmarks, they pile up until taken.
+	void set_collect_frame_timings(bool p_collect);
+	Vector<FrameTiming> take_frame_timings();
 	FFmpegFrameFormat get_frame_format() const { return frame_format; }
 
-	VideoDecoder(Ref<FileAccess> p_file);
+	// Only valid once the decoder is no longer preparing.
+	Ref<FFmpegIOSource> get_io_source() const;
+
+	VideoDecoder(Ref<FFmpegIOSource> p_io_source);
+	VideoDecoder(Ref<FileAccess> p_file_access, IOSourceFactory p_io_source_factory);
 	~VideoDecoder();
 };
 